@@ -0,0 +1,29 @@
+#ifndef STANDIN_H
+#define STANDIN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define STANDIN_DS4_COUNT 2
+#define STANDIN_ESP32_COUNT 2
+#define STANDIN_PORT_PREFIX "/dev/ttyUSBSOAK"
+
+// Recursos vivos nos substitutos de libusb e libserialport; entre iterações tudo deve voltar a zero.
+typedef struct
+{
+	int contexts;
+	int handles;
+	int claimed;
+	int detached;
+} standin_usb_usage_t;
+
+typedef struct
+{
+	int ports;
+	int open;
+} standin_serial_usage_t;
+
+void standin_usb_usage(standin_usb_usage_t *usage_out);
+void standin_serial_usage(standin_serial_usage_t *usage_out);
+
+#endif
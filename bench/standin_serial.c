@@ -0,0 +1,287 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <libserialport.h>
+#include "libslip.h"
+#include "standin.h"
+
+#define STANDIN_NAME_MAX 64
+#define STANDIN_VID 0x10C4
+#define STANDIN_PID 0xEA60
+
+#define ROM_CMD_SYNC 0x08
+#define ROM_CMD_READ_REG 0x0A
+#define ROM_RESPONSE_SIZE 10
+
+// Família ESP32 clássica: magic da ROM e as duas palavras do MAC no eFuse.
+#define ROM_REG_MAGIC 0x40001000
+#define ROM_MAGIC_ESP32 0x00F01D83
+#define ROM_REG_MAC_LOW 0x3FF5A004
+#define ROM_REG_MAC_HIGH 0x3FF5A008
+
+// ROM do ESP32 simulada: cada quadro escrito gera na hora a resposta no buffer de leitura.
+struct sp_port
+{
+	char name[STANDIN_NAME_MAX];
+	char serial[STANDIN_NAME_MAX];
+	int index;
+	int fd;
+	slip_decoder_t decoder;
+	slip_buffer_t rx;
+	size_t rx_pos;
+};
+
+static standin_serial_usage_t usage;
+
+void standin_serial_usage(standin_serial_usage_t *usage_out)
+{
+	*usage_out = usage;
+}
+
+static uint32_t rom_register(const struct sp_port *port, uint32_t address)
+{
+	uint8_t mac[6] = {0x24, 0x0A, 0xC4, 0x50, 0x00, (uint8_t)(port->index + 1)};
+	switch (address)
+	{
+	case ROM_REG_MAGIC:
+		return ROM_MAGIC_ESP32;
+	case ROM_REG_MAC_LOW:
+		return (uint32_t)mac[2] << 24 | (uint32_t)mac[3] << 16 | (uint32_t)mac[4] << 8 | mac[5];
+	case ROM_REG_MAC_HIGH:
+		return (uint32_t)mac[0] << 8 | mac[1];
+	default:
+		return 0;
+	}
+}
+
+static void rom_respond(struct sp_port *port, const slip_buffer_t *frame)
+{
+	if (frame->len < SLIP_HEADER_SIZE || frame->data[0] != 0x00)
+		return;
+
+	uint8_t cmd = frame->data[1];
+	uint32_t value = 0;
+	if (cmd == ROM_CMD_READ_REG && frame->len >= SLIP_HEADER_SIZE + 4)
+	{
+		const uint8_t *addr = frame->data + SLIP_HEADER_SIZE;
+		value = rom_register(port, (uint32_t)addr[0] | (uint32_t)addr[1] << 8 |
+									   (uint32_t)addr[2] << 16 | (uint32_t)addr[3] << 24);
+	}
+	else if (cmd != ROM_CMD_SYNC)
+	{
+		return;
+	}
+
+	uint8_t response[ROM_RESPONSE_SIZE] = {0x01, cmd, 2, 0, (uint8_t)value, (uint8_t)(value >> 8),
+										   (uint8_t)(value >> 16), (uint8_t)(value >> 24), 0, 0};
+	if (!slip_buffer_reserve(&port->rx, SLIP_ENCODED_MAX(ROM_RESPONSE_SIZE)))
+		return;
+	port->rx.data[port->rx.len++] = SLIP_BYTE_END;
+	port->rx.len += slip_encode_span(response, sizeof(response), port->rx.data + port->rx.len);
+	port->rx.data[port->rx.len++] = SLIP_BYTE_END;
+}
+
+enum sp_return sp_get_port_by_name(const char *portname, struct sp_port **port_ptr)
+{
+	size_t prefix = strlen(STANDIN_PORT_PREFIX);
+	if (!portname || strncmp(portname, STANDIN_PORT_PREFIX, prefix) != 0)
+		return SP_ERR_ARG;
+
+	int index = atoi(portname + prefix);
+	if (index < 0 || index >= STANDIN_ESP32_COUNT)
+		return SP_ERR_ARG;
+
+	struct sp_port *port = calloc(1, sizeof(struct sp_port));
+	if (!port)
+		return SP_ERR_MEM;
+
+	snprintf(port->name, sizeof(port->name), STANDIN_PORT_PREFIX "%d", index);
+	snprintf(port->serial, sizeof(port->serial), "SOAK%04d", index);
+	port->index = index;
+	port->fd = -1;
+	slip_decoder_init(&port->decoder);
+	usage.ports++;
+	*port_ptr = port;
+	return SP_OK;
+}
+
+void sp_free_port(struct sp_port *port)
+{
+	if (!port)
+		return;
+	slip_decoder_free(&port->decoder);
+	slip_buffer_free(&port->rx);
+	free(port);
+	usage.ports--;
+}
+
+enum sp_return sp_list_ports(struct sp_port ***list_ptr)
+{
+	struct sp_port **list = calloc(STANDIN_ESP32_COUNT + 1, sizeof(struct sp_port *));
+	if (!list)
+		return SP_ERR_MEM;
+
+	char name[STANDIN_NAME_MAX];
+	for (int i = 0; i < STANDIN_ESP32_COUNT; i++)
+	{
+		snprintf(name, sizeof(name), STANDIN_PORT_PREFIX "%d", i);
+		sp_get_port_by_name(name, &list[i]);
+	}
+	*list_ptr = list;
+	return SP_OK;
+}
+
+void sp_free_port_list(struct sp_port **ports)
+{
+	for (int i = 0; ports && ports[i]; i++)
+		sp_free_port(ports[i]);
+	free(ports);
+}
+
+enum sp_return sp_open(struct sp_port *port, enum sp_mode flags)
+{
+	(void)flags;
+	port->fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+	if (port->fd < 0)
+		return SP_ERR_FAIL;
+	usage.open++;
+	return SP_OK;
+}
+
+enum sp_return sp_close(struct sp_port *port)
+{
+	if (port->fd < 0)
+		return SP_ERR_ARG;
+	close(port->fd);
+	port->fd = -1;
+	usage.open--;
+	return SP_OK;
+}
+
+char *sp_get_port_name(const struct sp_port *port)
+{
+	return (char *)port->name;
+}
+
+enum sp_transport sp_get_port_transport(const struct sp_port *port)
+{
+	(void)port;
+	return SP_TRANSPORT_USB;
+}
+
+enum sp_return sp_get_port_usb_vid_pid(const struct sp_port *port, int *usb_vid, int *usb_pid)
+{
+	(void)port;
+	*usb_vid = STANDIN_VID;
+	*usb_pid = STANDIN_PID;
+	return SP_OK;
+}
+
+char *sp_get_port_usb_product(const struct sp_port *port)
+{
+	(void)port;
+	return "CP2102 USB to UART Bridge Controller";
+}
+
+char *sp_get_port_usb_serial(const struct sp_port *port)
+{
+	return (char *)port->serial;
+}
+
+enum sp_return sp_set_baudrate(struct sp_port *port, int baudrate)
+{
+	(void)port;
+	(void)baudrate;
+	return SP_OK;
+}
+
+enum sp_return sp_set_bits(struct sp_port *port, int bits)
+{
+	(void)port;
+	(void)bits;
+	return SP_OK;
+}
+
+enum sp_return sp_set_parity(struct sp_port *port, enum sp_parity parity)
+{
+	(void)port;
+	(void)parity;
+	return SP_OK;
+}
+
+enum sp_return sp_set_stopbits(struct sp_port *port, int stopbits)
+{
+	(void)port;
+	(void)stopbits;
+	return SP_OK;
+}
+
+enum sp_return sp_set_rts(struct sp_port *port, enum sp_rts rts)
+{
+	(void)port;
+	(void)rts;
+	return SP_OK;
+}
+
+enum sp_return sp_set_dtr(struct sp_port *port, enum sp_dtr dtr)
+{
+	(void)port;
+	(void)dtr;
+	return SP_OK;
+}
+
+enum sp_return sp_set_flowcontrol(struct sp_port *port, enum sp_flowcontrol flowcontrol)
+{
+	(void)port;
+	(void)flowcontrol;
+	return SP_OK;
+}
+
+enum sp_return sp_flush(struct sp_port *port, enum sp_buffer buffers)
+{
+	if (buffers & SP_BUF_INPUT)
+	{
+		port->rx.len = 0;
+		port->rx_pos = 0;
+	}
+	return SP_OK;
+}
+
+enum sp_return sp_blocking_write(struct sp_port *port, const void *buf, size_t count, unsigned int timeout_ms)
+{
+	(void)timeout_ms;
+	const uint8_t *in = buf;
+	size_t offset = 0;
+
+	while (offset < count)
+	{
+		size_t consumed = 0;
+		bool done = slip_decode(&port->decoder, in + offset, count - offset, &consumed);
+		offset += consumed;
+		if (!done)
+			break;
+		rom_respond(port, &port->decoder.frame);
+		slip_decoder_reset(&port->decoder);
+	}
+	return (enum sp_return)count;
+}
+
+// Sem resposta pendente devolve 0 na hora: o timeout do chamador corre sem dormir.
+enum sp_return sp_blocking_read_next(struct sp_port *port, void *buf, size_t count, unsigned int timeout_ms)
+{
+	(void)timeout_ms;
+	size_t pending = port->rx.len - port->rx_pos;
+	if (pending == 0)
+	{
+		port->rx.len = 0;
+		port->rx_pos = 0;
+		return 0;
+	}
+
+	size_t n = pending < count ? pending : count;
+	memcpy(buf, port->rx.data + port->rx_pos, n);
+	port->rx_pos += n;
+	return (enum sp_return)n;
+}
@@ -0,0 +1,239 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <libusb.h>
+#include "standin.h"
+
+#ifndef LIBUSB_CALL
+#define LIBUSB_CALL
+#endif
+
+#define STANDIN_BUS 250
+#define STANDIN_VENDOR_ID 0x054C
+#define STANDIN_PRODUCT_ID 0x05C4
+#define STANDIN_MAC_LEN 6
+#define STANDIN_REPORT_LEN 16
+#define STANDIN_REP_PAIRING 0x0312
+#define STANDIN_REP_WRITE 0x0313
+
+// DS4 simulado: o driver do kernel começa ligado, como num controle recém-plugado.
+struct libusb_device
+{
+	uint8_t port;
+	bool driver_bound;
+	uint8_t device_mac[STANDIN_MAC_LEN];
+	uint8_t paired_mac[STANDIN_MAC_LEN];
+};
+
+// Cada contexto e handle segura um fd de verdade, para vazamentos aparecerem em /proc/self/fd.
+struct libusb_context
+{
+	int fd;
+};
+
+struct libusb_device_handle
+{
+	libusb_device *dev;
+	int fd;
+	bool claimed;
+};
+
+static libusb_device devices[STANDIN_DS4_COUNT];
+static bool devices_ready = false;
+static standin_usb_usage_t usage;
+
+static void devices_init(void)
+{
+	if (devices_ready)
+		return;
+	devices_ready = true;
+
+	for (int i = 0; i < STANDIN_DS4_COUNT; i++)
+	{
+		uint8_t mac[STANDIN_MAC_LEN] = {0x1C, 0x66, 0x6D, 0x50, 0x00, (uint8_t)(i + 1)};
+		devices[i].port = (uint8_t)(i + 1);
+		devices[i].driver_bound = true;
+		memcpy(devices[i].device_mac, mac, sizeof(mac));
+	}
+}
+
+void standin_usb_usage(standin_usb_usage_t *usage_out)
+{
+	*usage_out = usage;
+	usage_out->detached = 0;
+	for (int i = 0; i < STANDIN_DS4_COUNT; i++)
+		usage_out->detached += devices_ready && !devices[i].driver_bound;
+}
+
+int LIBUSB_CALL libusb_init(libusb_context **ctx)
+{
+	libusb_context *context = calloc(1, sizeof(libusb_context));
+	if (!context)
+		return LIBUSB_ERROR_NO_MEM;
+
+	context->fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+	devices_init();
+	usage.contexts++;
+	*ctx = context;
+	return LIBUSB_SUCCESS;
+}
+
+void LIBUSB_CALL libusb_exit(libusb_context *ctx)
+{
+	if (!ctx)
+		return;
+	close(ctx->fd);
+	free(ctx);
+	usage.contexts--;
+}
+
+int LIBUSB_CALL libusb_set_option(libusb_context *ctx, enum libusb_option option, ...)
+{
+	(void)ctx;
+	(void)option;
+	return LIBUSB_SUCCESS;
+}
+
+ssize_t LIBUSB_CALL libusb_get_device_list(libusb_context *ctx, libusb_device ***list)
+{
+	(void)ctx;
+	libusb_device **devs = calloc(STANDIN_DS4_COUNT + 1, sizeof(libusb_device *));
+	if (!devs)
+		return LIBUSB_ERROR_NO_MEM;
+
+	for (int i = 0; i < STANDIN_DS4_COUNT; i++)
+		devs[i] = &devices[i];
+	*list = devs;
+	return STANDIN_DS4_COUNT;
+}
+
+void LIBUSB_CALL libusb_free_device_list(libusb_device **list, int unref_devices)
+{
+	(void)unref_devices;
+	free(list);
+}
+
+int LIBUSB_CALL libusb_get_device_descriptor(libusb_device *dev, struct libusb_device_descriptor *desc)
+{
+	(void)dev;
+	memset(desc, 0, sizeof(*desc));
+	desc->idVendor = STANDIN_VENDOR_ID;
+	desc->idProduct = STANDIN_PRODUCT_ID;
+	return LIBUSB_SUCCESS;
+}
+
+uint8_t LIBUSB_CALL libusb_get_bus_number(libusb_device *dev)
+{
+	(void)dev;
+	return STANDIN_BUS;
+}
+
+int LIBUSB_CALL libusb_get_port_numbers(libusb_device *dev, uint8_t *port_numbers, int port_numbers_len)
+{
+	if (port_numbers_len < 1)
+		return LIBUSB_ERROR_OVERFLOW;
+	port_numbers[0] = dev->port;
+	return 1;
+}
+
+int LIBUSB_CALL libusb_open(libusb_device *dev, libusb_device_handle **dev_handle)
+{
+	libusb_device_handle *handle = calloc(1, sizeof(libusb_device_handle));
+	if (!handle)
+		return LIBUSB_ERROR_NO_MEM;
+
+	handle->dev = dev;
+	handle->fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+	usage.handles++;
+	*dev_handle = handle;
+	return LIBUSB_SUCCESS;
+}
+
+void LIBUSB_CALL libusb_close(libusb_device_handle *dev_handle)
+{
+	if (!dev_handle)
+		return;
+	usage.claimed -= dev_handle->claimed;
+	close(dev_handle->fd);
+	free(dev_handle);
+	usage.handles--;
+}
+
+int LIBUSB_CALL libusb_kernel_driver_active(libusb_device_handle *dev_handle, int interface_number)
+{
+	(void)interface_number;
+	return dev_handle->dev->driver_bound ? 1 : 0;
+}
+
+int LIBUSB_CALL libusb_detach_kernel_driver(libusb_device_handle *dev_handle, int interface_number)
+{
+	(void)interface_number;
+	if (!dev_handle->dev->driver_bound)
+		return LIBUSB_ERROR_NOT_FOUND;
+	dev_handle->dev->driver_bound = false;
+	return LIBUSB_SUCCESS;
+}
+
+int LIBUSB_CALL libusb_attach_kernel_driver(libusb_device_handle *dev_handle, int interface_number)
+{
+	(void)interface_number;
+	if (dev_handle->dev->driver_bound || dev_handle->claimed)
+		return LIBUSB_ERROR_BUSY;
+	dev_handle->dev->driver_bound = true;
+	return LIBUSB_SUCCESS;
+}
+
+int LIBUSB_CALL libusb_claim_interface(libusb_device_handle *dev_handle, int interface_number)
+{
+	(void)interface_number;
+	if (dev_handle->dev->driver_bound)
+		return LIBUSB_ERROR_BUSY;
+	if (!dev_handle->claimed)
+		usage.claimed++;
+	dev_handle->claimed = true;
+	return LIBUSB_SUCCESS;
+}
+
+int LIBUSB_CALL libusb_release_interface(libusb_device_handle *dev_handle, int interface_number)
+{
+	(void)interface_number;
+	if (!dev_handle->claimed)
+		return LIBUSB_ERROR_NOT_FOUND;
+	dev_handle->claimed = false;
+	usage.claimed--;
+	return LIBUSB_SUCCESS;
+}
+
+// Só os relatórios de feature de pareamento (0x12) e de gravação (0x13); os MACs trafegam invertidos.
+int LIBUSB_CALL libusb_control_transfer(libusb_device_handle *dev_handle, uint8_t request_type, uint8_t bRequest,
+										uint16_t wValue, uint16_t wIndex, unsigned char *data, uint16_t wLength,
+										unsigned int timeout)
+{
+	(void)request_type;
+	(void)bRequest;
+	(void)wIndex;
+	(void)timeout;
+	libusb_device *dev = dev_handle->dev;
+	if (!dev_handle->claimed)
+		return LIBUSB_ERROR_BUSY;
+
+	if (wValue == STANDIN_REP_PAIRING && wLength >= STANDIN_REPORT_LEN)
+	{
+		memset(data, 0, wLength);
+		data[0] = (uint8_t)(wValue & 0xFF);
+		for (int i = 0; i < STANDIN_MAC_LEN; i++)
+		{
+			data[1 + i] = dev->device_mac[STANDIN_MAC_LEN - 1 - i];
+			data[10 + i] = dev->paired_mac[STANDIN_MAC_LEN - 1 - i];
+		}
+		return STANDIN_REPORT_LEN;
+	}
+	if (wValue == STANDIN_REP_WRITE && wLength > STANDIN_MAC_LEN)
+	{
+		for (int i = 0; i < STANDIN_MAC_LEN; i++)
+			dev->paired_mac[i] = data[STANDIN_MAC_LEN - i];
+		return wLength;
+	}
+	return LIBUSB_ERROR_PIPE;
+}
@@ -0,0 +1,377 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "platform.h"
+#include "libslip.h"
+#include "libesp32.h"
+#include "libds4.h"
+#include "eventring.h"
+#include "mac.h"
+
+#define BENCH_REPEATS 5
+#define BENCH_PAYLOAD_MAX 16384
+#define BENCH_STREAM_FRAMES 16
+#define BENCH_FRAME_MAX SLIP_ENCODED_MAX(BENCH_PAYLOAD_MAX)
+#define BENCH_MAC_LIST 1024
+
+typedef struct
+{
+	const char *name;
+	size_t bytes_per_op;
+	uint64_t ops;
+	void (*run)(uint64_t ops);
+} BenchCase;
+
+// Impede que o compilador descarte o trabalho medido.
+static volatile uint64_t sink;
+
+static uint8_t payload_sync[36];
+static uint8_t payload_reg[4];
+static uint8_t payload_bulk[BENCH_PAYLOAD_MAX];
+static uint8_t stream[BENCH_STREAM_FRAMES * BENCH_FRAME_MAX];
+static size_t stream_len;
+static uint8_t mac_list[BENCH_MAC_LIST * MAC_LEN];
+static char mac_texts[BENCH_MAC_LIST * MAC_STRING_LEN];
+static const char *mac_text_list[BENCH_MAC_LIST];
+
+// Codec byte a byte anterior ao libslip vetorizado, mantido só como referência.
+static void legacy_encode_byte(uint8_t byte, uint8_t *buffer, size_t *index)
+{
+	if (byte == SLIP_BYTE_END)
+	{
+		buffer[(*index)++] = SLIP_BYTE_ESC;
+		buffer[(*index)++] = SLIP_BYTE_ESC_END;
+	}
+	else if (byte == SLIP_BYTE_ESC)
+	{
+		buffer[(*index)++] = SLIP_BYTE_ESC;
+		buffer[(*index)++] = SLIP_BYTE_ESC_ESC;
+	}
+	else
+	{
+		buffer[(*index)++] = byte;
+	}
+}
+
+static size_t legacy_encode_frame(uint8_t op, const uint8_t *data, uint16_t len, uint8_t *out)
+{
+	uint8_t header[SLIP_HEADER_SIZE] = {0x00, op, (uint8_t)(len & 0xFF), (uint8_t)(len >> 8), 0, 0, 0, 0};
+	size_t index = 0;
+
+	out[index++] = SLIP_BYTE_END;
+	for (int i = 0; i < SLIP_HEADER_SIZE; i++)
+		legacy_encode_byte(header[i], out, &index);
+	for (int i = 0; i < len; i++)
+		legacy_encode_byte(data[i], out, &index);
+	out[index++] = SLIP_BYTE_END;
+	return index;
+}
+
+typedef struct
+{
+	int count;
+	bool in_frame;
+	bool escaped;
+} LegacyDecoder;
+
+static int legacy_decode_byte(LegacyDecoder *decoder, uint8_t byte, uint8_t *out_buf, int max_len)
+{
+	if (byte == SLIP_BYTE_END)
+	{
+		if (decoder->in_frame)
+		{
+			int count = decoder->count;
+			*decoder = (LegacyDecoder){0, false, false};
+			return count;
+		}
+		decoder->in_frame = true;
+		decoder->count = 0;
+		return -1;
+	}
+	if (!decoder->in_frame)
+		return -1;
+	if (byte == SLIP_BYTE_ESC)
+	{
+		decoder->escaped = true;
+		return -1;
+	}
+	if (decoder->escaped)
+	{
+		if (byte == SLIP_BYTE_ESC_END)
+			byte = SLIP_BYTE_END;
+		else if (byte == SLIP_BYTE_ESC_ESC)
+			byte = SLIP_BYTE_ESC;
+		decoder->escaped = false;
+	}
+	if (decoder->count < max_len)
+		out_buf[decoder->count++] = byte;
+	return -1;
+}
+
+static uint32_t rng_state = 0x7431CC01u;
+
+static uint32_t rng_next(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+static void fill_random(uint8_t *buf, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+	{
+		// ~1/16 dos bytes são END/ESC, forçando o caminho de escape.
+		uint32_t r = rng_next();
+		if ((r & 0x1F) == 0)
+			buf[i] = SLIP_BYTE_END;
+		else if ((r & 0x1F) == 1)
+			buf[i] = SLIP_BYTE_ESC;
+		else
+			buf[i] = (uint8_t)(r >> 8);
+	}
+}
+
+// Bytes uniformes (~2/256 END/ESC), próximo de uma imagem de firmware.
+static void fill_plain(uint8_t *buf, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+	{
+		buf[i] = (uint8_t)(rng_next() >> 8);
+	}
+}
+
+static void prepare_inputs(void)
+{
+	fill_random(payload_sync, sizeof(payload_sync));
+	fill_random(payload_reg, sizeof(payload_reg));
+	fill_plain(payload_bulk, sizeof(payload_bulk));
+
+	stream_len = 0;
+	for (int i = 0; i < BENCH_STREAM_FRAMES; i++)
+	{
+		int size = slip_encode_frame(0x0A, payload_bulk, BENCH_PAYLOAD_MAX, (uint32_t)i,
+									 stream + stream_len, sizeof(stream) - stream_len);
+		if (size > 0)
+			stream_len += (size_t)size;
+		payload_bulk[i] ^= 0x5A;
+	}
+
+	fill_random(mac_list, sizeof(mac_list));
+	mac_format_array(mac_list, BENCH_MAC_LIST, ':', mac_texts);
+	for (int i = 0; i < BENCH_MAC_LIST; i++)
+		mac_text_list[i] = mac_texts + i * MAC_STRING_LEN;
+}
+
+static void run_encode_reg(uint64_t ops)
+{
+	uint8_t out[64];
+	for (uint64_t i = 0; i < ops; i++)
+	{
+		sink += (uint64_t)slip_encode_frame(0x0A, payload_reg, sizeof(payload_reg), 0, out, sizeof(out));
+	}
+}
+
+static void run_encode_sync(uint64_t ops)
+{
+	uint8_t out[128];
+	for (uint64_t i = 0; i < ops; i++)
+	{
+		sink += (uint64_t)slip_encode_frame(0x08, payload_sync, sizeof(payload_sync), 0, out, sizeof(out));
+	}
+}
+
+static void run_encode_bulk(uint64_t ops)
+{
+	static uint8_t out[BENCH_FRAME_MAX];
+	for (uint64_t i = 0; i < ops; i++)
+	{
+		sink += (uint64_t)slip_encode_frame(0x11, payload_bulk, BENCH_PAYLOAD_MAX, 0, out, sizeof(out));
+	}
+}
+
+static void run_legacy_encode_bulk(uint64_t ops)
+{
+	static uint8_t out[BENCH_FRAME_MAX];
+	for (uint64_t i = 0; i < ops; i++)
+	{
+		sink += legacy_encode_frame(0x11, payload_bulk, BENCH_PAYLOAD_MAX, out);
+	}
+}
+
+static void run_decode_stream(uint64_t ops)
+{
+	slip_decoder_t decoder;
+	slip_decoder_init(&decoder);
+	for (uint64_t i = 0; i < ops; i++)
+	{
+		size_t pos = 0;
+		slip_decoder_reset(&decoder);
+		while (pos < stream_len)
+		{
+			size_t consumed = 0;
+			if (slip_decode(&decoder, stream + pos, stream_len - pos, &consumed))
+				sink += decoder.frame.len;
+			pos += consumed;
+		}
+	}
+	slip_decoder_free(&decoder);
+}
+
+static void run_legacy_decode_stream(uint64_t ops)
+{
+	static uint8_t frame[BENCH_FRAME_MAX];
+	LegacyDecoder decoder;
+	for (uint64_t i = 0; i < ops; i++)
+	{
+		decoder = (LegacyDecoder){0, false, false};
+		for (size_t j = 0; j < stream_len; j++)
+		{
+			int len = legacy_decode_byte(&decoder, stream[j], frame, (int)sizeof(frame));
+			if (len >= 0)
+				sink += (uint64_t)len;
+		}
+	}
+}
+
+static void run_esp32_format_mac(uint64_t ops)
+{
+	char buf[18];
+	for (uint64_t i = 0; i < ops; i++)
+	{
+		esp32_format_mac((uint32_t)i * 2654435761u, (uint32_t)i & 0xFFFF, buf, sizeof(buf));
+		sink += (uint8_t)buf[16];
+	}
+}
+
+static void run_ds4_mac_to_string(uint64_t ops)
+{
+	uint8_t mac[DS4_MAC_ADDR_LEN] = {0x1C, 0xA0, 0xB8, 0x00, 0x00, 0x00};
+	char buf[18];
+	for (uint64_t i = 0; i < ops; i++)
+	{
+		mac[5] = (uint8_t)i;
+		ds4_mac_to_string(mac, buf);
+		sink += (uint8_t)buf[16];
+	}
+}
+
+static void run_ds4_string_to_mac(uint64_t ops)
+{
+	char text[18] = "1C:A0:B8:3F:7E:00";
+	uint8_t mac[DS4_MAC_ADDR_LEN];
+	for (uint64_t i = 0; i < ops; i++)
+	{
+		text[16] = "0123456789ABCDEF"[i & 0xF];
+		sink += ds4_string_to_mac(text, mac) ? mac[5] : 0;
+	}
+}
+
+// Conversões com sscanf/sprintf anteriores ao codec de tabela, mantidas só como referência.
+static void run_legacy_mac_to_string(uint64_t ops)
+{
+	uint8_t mac[DS4_MAC_ADDR_LEN] = {0x1C, 0xA0, 0xB8, 0x00, 0x00, 0x00};
+	char buf[18];
+	for (uint64_t i = 0; i < ops; i++)
+	{
+		mac[5] = (uint8_t)i;
+		snprintf(buf, sizeof(buf), "%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+		sink += (uint8_t)buf[16];
+	}
+}
+
+static void run_legacy_string_to_mac(uint64_t ops)
+{
+	char text[18] = "1C:A0:B8:3F:7E:00";
+	uint8_t mac[DS4_MAC_ADDR_LEN];
+	for (uint64_t i = 0; i < ops; i++)
+	{
+		text[16] = "0123456789ABCDEF"[i & 0xF];
+		int parsed = sscanf(text, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx", &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5]);
+		sink += parsed == DS4_MAC_ADDR_LEN ? mac[5] : 0;
+	}
+}
+
+static void run_mac_parse_list(uint64_t ops)
+{
+	uint8_t macs[BENCH_MAC_LIST * MAC_LEN];
+	for (uint64_t i = 0; i < ops; i++)
+	{
+		sink += mac_parse_array(mac_text_list, BENCH_MAC_LIST, macs);
+	}
+}
+
+static void run_mac_format_list(uint64_t ops)
+{
+	static char texts[BENCH_MAC_LIST * MAC_STRING_LEN];
+	for (uint64_t i = 0; i < ops; i++)
+	{
+		mac_format_array(mac_list, BENCH_MAC_LIST, ':', texts);
+		sink += (uint8_t)texts[i % sizeof(texts)];
+	}
+}
+
+static void run_ring_event(uint64_t ops)
+{
+	for (uint64_t i = 0; i < ops; i++)
+	{
+		ring_event(1, RING_ESP32_TIMEOUT, (int32_t)i);
+	}
+}
+
+// Melhor de BENCH_REPEATS rodadas: menos sensível a ruído do escalonador.
+static uint64_t measure(const BenchCase *bench)
+{
+	uint64_t best = UINT64_MAX;
+	bench->run(bench->ops / 10 + 1);
+	for (int i = 0; i < BENCH_REPEATS; i++)
+	{
+		uint64_t start = platform_monotonic_ns();
+		bench->run(bench->ops);
+		uint64_t elapsed = platform_monotonic_ns() - start;
+		if (elapsed < best)
+			best = elapsed;
+	}
+	return best;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *filter = argc > 1 ? argv[1] : NULL;
+
+	prepare_inputs();
+
+	BenchCase cases[] = {
+		{"slip_encode_reg", SLIP_HEADER_SIZE + sizeof(payload_reg), 2000000, run_encode_reg},
+		{"slip_encode_sync", SLIP_HEADER_SIZE + sizeof(payload_sync), 1000000, run_encode_sync},
+		{"slip_encode_bulk", SLIP_HEADER_SIZE + BENCH_PAYLOAD_MAX, 5000, run_encode_bulk},
+		{"legacy_encode_bulk", SLIP_HEADER_SIZE + BENCH_PAYLOAD_MAX, 5000, run_legacy_encode_bulk},
+		{"slip_decode_stream", stream_len, 200, run_decode_stream},
+		{"legacy_decode_stream", stream_len, 200, run_legacy_decode_stream},
+		{"esp32_format_mac", 0, 1000000, run_esp32_format_mac},
+		{"ds4_mac_to_string", 0, 1000000, run_ds4_mac_to_string},
+		{"ds4_string_to_mac", 0, 1000000, run_ds4_string_to_mac},
+		{"legacy_mac_to_string", 0, 1000000, run_legacy_mac_to_string},
+		{"legacy_string_to_mac", 0, 1000000, run_legacy_string_to_mac},
+		{"mac_parse_list", BENCH_MAC_LIST * (MAC_STRING_LEN - 1), 2000, run_mac_parse_list},
+		{"mac_format_list", BENCH_MAC_LIST * (MAC_STRING_LEN - 1), 2000, run_mac_format_list},
+		{"ring_event", 0, 5000000, run_ring_event},
+	};
+
+	// Saída TSV estável: nome, ns/op, MB/s (0 quando não se aplica), ops por rodada.
+	fprintf(stdout, "benchmark\tns_op\tmb_s\tops\n");
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+	{
+		if (filter && !strstr(cases[i].name, filter))
+			continue;
+
+		uint64_t elapsed = measure(&cases[i]);
+		double ns_op = (double)elapsed / (double)cases[i].ops;
+		double mb_s = cases[i].bytes_per_op ? (double)cases[i].bytes_per_op * 1e3 / ns_op : 0.0;
+		fprintf(stdout, "%s\t%.2f\t%.2f\t%llu\n", cases[i].name, ns_op, mb_s, (unsigned long long)cases[i].ops);
+	}
+	return 0;
+}
@@ -0,0 +1,308 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <dirent.h>
+#include "platform.h"
+#include "libds4.h"
+#include "libesp32.h"
+#include "mac.h"
+#include "standin.h"
+
+#define SOAK_SECONDS_DEFAULT 60
+#define SOAK_WINDOWS 600
+#define SOAK_WINDOW_MIN_MS 100
+#define SOAK_WARMUP_DIV 10
+#define SOAK_RSS_SLACK_KB 1024
+#define SOAK_RSS_SLACK_PCT 5
+#define SOAK_LATENCY_SLACK_PCT 25
+
+typedef struct
+{
+	double elapsed_s;
+	uint64_t iterations;
+	long rss_kb;
+	long fds;
+	double ds4_us;
+	double esp32_us;
+} SoakWindow;
+
+typedef struct
+{
+	char ds4[DS4_MAX_DEVICES][DS4_PATH_MAX];
+	int ds4_count;
+	char esp32[ESP32_MAX_PORTS][ESP32_PORT_NAME_MAX];
+	int esp32_count;
+	char esp32_mac[ESP32_MAX_PORTS][MAC_STRING_LEN];
+	uint64_t iteration;
+} SoakState;
+
+static SoakWindow windows[SOAK_WINDOWS];
+
+static void print_help(const char *prog_name)
+{
+	fprintf(stdout, "[HELP]: %s [-t <segundos>]\n", prog_name);
+	fprintf(stdout, "        -t: Duração do soak (padrão: %d s; um turno inteiro: 28800)\n", SOAK_SECONDS_DEFAULT);
+	fprintf(stdout, "[SAIDA]: TSV por janela (window, elapsed_s, iterations, rss_kb, fds, ds4_us, esp32_us);\n");
+	fprintf(stdout, "         falha se RSS, descritores ou latência crescerem ao longo da execução.\n");
+}
+
+// RSS e descritores vêm do /proc; fora do Linux os dois ficam em -1 e não são avaliados.
+static long sample_rss_kb(void)
+{
+#ifdef PLATFORM_LINUX
+	long pages = -1;
+	FILE *statm = fopen("/proc/self/statm", "r");
+	if (statm)
+	{
+		if (fscanf(statm, "%*d %ld", &pages) != 1)
+			pages = -1;
+		fclose(statm);
+	}
+	return pages < 0 ? -1 : pages * (sysconf(_SC_PAGESIZE) / 1024);
+#else
+	return -1;
+#endif
+}
+
+static long sample_fds(void)
+{
+#ifdef PLATFORM_LINUX
+	DIR *dir = opendir("/proc/self/fd");
+	if (!dir)
+		return -1;
+	long count = -1;
+	while (readdir(dir))
+		count++;
+	closedir(dir);
+	return count - 2;
+#else
+	return -1;
+#endif
+}
+
+static bool resources_released(void)
+{
+	standin_usb_usage_t usb;
+	standin_serial_usage_t serial;
+	standin_usb_usage(&usb);
+	standin_serial_usage(&serial);
+
+	if (usb.detached > 0)
+	{
+		fprintf(stderr, "[ERRO]: %d controle(s) ficaram sem o driver do kernel após destruir o contexto.\n", usb.detached);
+		return false;
+	}
+	if (usb.contexts || usb.handles || usb.claimed || serial.ports || serial.open)
+	{
+		fprintf(stderr, "[ERRO]: Recursos vivos após a iteração: %d contexto(s) USB, %d handle(s), %d interface(s), %d porta(s), %d aberta(s).\n",
+				usb.contexts, usb.handles, usb.claimed, serial.ports, serial.open);
+		return false;
+	}
+	return true;
+}
+
+// Criar, ler, gravar um MAC novo, conferir e destruir; o MAC muda a cada iteração.
+static bool cycle_ds4(SoakState *state, const char *path)
+{
+	ds4_context_t *ctx = ds4_create_context_at(path);
+	if (!ctx)
+		return false;
+
+	uint8_t target[DS4_MAC_ADDR_LEN] = {0x24, 0x0A, 0xC4, (uint8_t)(state->iteration >> 16),
+										(uint8_t)(state->iteration >> 8), (uint8_t)state->iteration};
+	uint8_t before[DS4_MAC_ADDR_LEN];
+	uint8_t after[DS4_MAC_ADDR_LEN];
+	bool ok = ds4_get_mac(ctx, before) && ds4_set_mac(ctx, target) && ds4_get_mac(ctx, after) &&
+			  memcmp(after, target, DS4_MAC_ADDR_LEN) == 0;
+
+	ds4_destroy_context(ctx);
+	return ok;
+}
+
+static bool cycle_esp32(SoakState *state, int index)
+{
+	esp32_session_t *session = esp32_session_open(state->esp32[index]);
+	if (!session)
+		return false;
+
+	char mac[MAC_STRING_LEN];
+	bool ok = esp32_session_sync(session) && esp32_session_read_mac(session, mac, sizeof(mac));
+	esp32_session_close(session);
+
+	if (ok && !state->esp32_mac[index][0])
+		snprintf(state->esp32_mac[index], sizeof(state->esp32_mac[index]), "%s", mac);
+	return ok && strcmp(mac, state->esp32_mac[index]) == 0;
+}
+
+static double field_ds4(const SoakWindow *w)
+{
+	return w->ds4_us;
+}
+
+static double field_esp32(const SoakWindow *w)
+{
+	return w->esp32_us;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static double quarter_median(const SoakWindow *w, int count, double (*field)(const SoakWindow *))
+{
+	double values[SOAK_WINDOWS];
+	for (int i = 0; i < count; i++)
+		values[i] = field(&w[i]);
+	qsort(values, (size_t)count, sizeof(double), compare_double);
+	return values[count / 2];
+}
+
+// Mediana do primeiro contra a do último quarto: picos isolados da máquina não contam como deriva.
+static bool check_latency(const char *name, const SoakWindow *w, int count, double (*field)(const SoakWindow *))
+{
+	int quarter = count / 4;
+	double base = quarter_median(w, quarter, field);
+	double last = quarter_median(w + count - quarter, quarter, field);
+	bool ok = last - base <= base * SOAK_LATENCY_SLACK_PCT / 100.0;
+	fprintf(ok ? stdout : stderr, "%s: Latência %s de %.1f µs para %.1f µs (limite +%d%%).\n",
+			ok ? "[INFO]" : "[ERRO]", name, base, last, SOAK_LATENCY_SLACK_PCT);
+	return ok;
+}
+
+// Descarta o aquecimento (caches, arquivos de trava, registro de portas) e julga só o regime.
+static bool analyze(const SoakWindow *all, int total)
+{
+	int warmup = total / SOAK_WARMUP_DIV;
+	const SoakWindow *w = all + warmup;
+	int count = total - warmup;
+	if (count < 4)
+	{
+		fprintf(stderr, "[ERRO]: Poucas janelas para avaliar tendência (%d).\n", count);
+		return false;
+	}
+
+	bool ok = check_latency("DS4", w, count, field_ds4);
+	ok = check_latency("ESP32", w, count, field_esp32) && ok;
+
+	if (w[0].rss_kb < 0 || w[0].fds < 0)
+	{
+		fprintf(stdout, "[INFO]: RSS e descritores só são medidos no Linux.\n");
+		return ok;
+	}
+
+	long rss_growth = w[count - 1].rss_kb - w[0].rss_kb;
+	long rss_slack = w[0].rss_kb * SOAK_RSS_SLACK_PCT / 100;
+	if (rss_slack < SOAK_RSS_SLACK_KB)
+		rss_slack = SOAK_RSS_SLACK_KB;
+	bool rss_ok = rss_growth <= rss_slack;
+	fprintf(rss_ok ? stdout : stderr, "%s: RSS de %ld KB para %ld KB (limite +%ld KB).\n", rss_ok ? "[INFO]" : "[ERRO]",
+			w[0].rss_kb, w[count - 1].rss_kb, rss_slack);
+
+	long fds_max = w[0].fds;
+	for (int i = 1; i < count; i++)
+		fds_max = w[i].fds > fds_max ? w[i].fds : fds_max;
+	bool fds_ok = fds_max <= w[0].fds;
+	fprintf(fds_ok ? stdout : stderr, "%s: Descritores abertos: %ld no início, máximo %ld.\n", fds_ok ? "[INFO]" : "[ERRO]",
+			w[0].fds, fds_max);
+
+	return ok && rss_ok && fds_ok;
+}
+
+int main(int argc, char *argv[])
+{
+	long seconds = SOAK_SECONDS_DEFAULT;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+		{
+			seconds = strtol(argv[++i], NULL, 10);
+		}
+		else
+		{
+			print_help(argv[0]);
+			return strcmp(argv[i], "-h") != 0;
+		}
+	}
+	if (seconds <= 0)
+	{
+		print_help(argv[0]);
+		return 1;
+	}
+
+	static SoakState state;
+	state.ds4_count = ds4_list_devices(state.ds4, DS4_MAX_DEVICES);
+	state.esp32_count = esp32_list_ports(state.esp32, ESP32_MAX_PORTS);
+	if (state.ds4_count <= 0 || state.esp32_count <= 0)
+	{
+		fprintf(stderr, "[ERRO]: Os substitutos de DS4/ESP32 não foram encontrados.\n");
+		return 1;
+	}
+
+	// As páginas das janelas entram no RSS já no início, senão o próprio registro pareceria vazamento.
+	memset(windows, 0, sizeof(windows));
+
+	uint64_t window_ns = (uint64_t)seconds * 1000000000ull / SOAK_WINDOWS;
+	if (window_ns < SOAK_WINDOW_MIN_MS * 1000000ull)
+		window_ns = SOAK_WINDOW_MIN_MS * 1000000ull;
+
+	fprintf(stdout, "window\telapsed_s\titerations\trss_kb\tfds\tds4_us\tesp32_us\n");
+	uint64_t start = platform_monotonic_ns();
+	uint64_t deadline = start + (uint64_t)seconds * 1000000000ull;
+	int count = 0;
+
+	while (count < SOAK_WINDOWS && platform_monotonic_ns() < deadline)
+	{
+		SoakWindow *w = &windows[count];
+		uint64_t window_end = platform_monotonic_ns() + window_ns;
+		uint64_t ds4_ns = 0;
+		uint64_t esp32_ns = 0;
+
+		while (platform_monotonic_ns() < window_end)
+		{
+			uint64_t t0 = platform_monotonic_ns();
+			bool ds4_ok = cycle_ds4(&state, state.ds4[state.iteration % (uint64_t)state.ds4_count]);
+			uint64_t t1 = platform_monotonic_ns();
+			bool esp32_ok = cycle_esp32(&state, (int)(state.iteration % (uint64_t)state.esp32_count));
+			uint64_t t2 = platform_monotonic_ns();
+
+			if (!ds4_ok || !esp32_ok)
+			{
+				fprintf(stderr, "[ERRO]: Iteração %llu falhou (%s).\n", (unsigned long long)state.iteration,
+						!ds4_ok ? "DS4" : "ESP32");
+				return 1;
+			}
+			if (!resources_released())
+				return 1;
+
+			ds4_ns += t1 - t0;
+			esp32_ns += t2 - t1;
+			state.iteration++;
+			w->iterations++;
+		}
+
+		w->elapsed_s = (double)(platform_monotonic_ns() - start) / 1e9;
+		w->rss_kb = sample_rss_kb();
+		w->fds = sample_fds();
+		w->ds4_us = w->iterations ? (double)ds4_ns / 1e3 / (double)w->iterations : 0;
+		w->esp32_us = w->iterations ? (double)esp32_ns / 1e3 / (double)w->iterations : 0;
+		fprintf(stdout, "%d\t%.1f\t%llu\t%ld\t%ld\t%.2f\t%.2f\n", count, w->elapsed_s,
+				(unsigned long long)w->iterations, w->rss_kb, w->fds, w->ds4_us, w->esp32_us);
+		fflush(stdout);
+		count++;
+	}
+
+	fprintf(stdout, "[INFO]: %llu iterações em %d janelas.\n", (unsigned long long)state.iteration, count);
+	if (!analyze(windows, count))
+	{
+		fprintf(stderr, "[ERRO]: Soak reprovado.\n");
+		return 1;
+	}
+	fprintf(stdout, "[INFO]: Soak aprovado.\n");
+	return 0;
+}
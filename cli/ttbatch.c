@@ -0,0 +1,420 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "libds4.h"
+#include "libesp32.h"
+#include "libledger.h"
+#include "libpipeline.h"
+#include "metrics.h"
+
+#define BATCH_MAX_ROWS 64
+#define BATCH_LINE_MAX 256
+#define BATCH_AUTO "auto"
+
+typedef enum
+{
+	FORMAT_CSV,
+	FORMAT_NDJSON
+} OutputFormat;
+
+typedef struct
+{
+	char esp32[ESP32_PORT_NAME_MAX];
+	char ds4[DS4_PATH_MAX];
+	char mac[18];
+	const char *status;
+	const char *error;
+	bool reused;
+	char previous_ds4[18];
+	double ms_esp32;
+	double ms_ds4;
+	double ms_total;
+} BatchRow;
+
+typedef struct
+{
+	BatchRow rows[BATCH_MAX_ROWS];
+	int count;
+	bool has_auto;
+	FILE *out;
+	OutputFormat format;
+	bool verbose;
+	pthread_mutex_t out_lock;
+} BatchJob;
+
+static void print_help(const char *prog_name)
+{
+	fprintf(stdout, "[HELP]: %s [-i] [-c] [-f csv|ndjson] -m <manifesto> -o <saida>\n", prog_name);
+	fprintf(stdout, "        -i: Informativo (Verbose)\n");
+	fprintf(stdout, "        -c: Continuar execução anterior (pula linhas já gravadas)\n");
+	fprintf(stdout, "        -f: Formato da saída (padrão: pela extensão do arquivo)\n");
+	fprintf(stdout, "        --metrics: Exporta latências e contadores em <arquivo> (textfile do Prometheus, atualizado a cada %d s)\n", METRICS_FLUSH_MS / 1000);
+	fprintf(stdout, "[MANIFESTO]: Uma linha por par \"<porta ESP32 | MAC> <caminho DS4>\" ou \"auto\".\n");
+	fprintf(stdout, "        Nomes sem vírgula, aspas ou barra invertida.\n");
+}
+
+static bool batch_has_esp32(const BatchJob *job, const char *port)
+{
+	for (int i = 0; i < job->count; i++)
+	{
+		if (strcmp(job->rows[i].esp32, port) == 0)
+			return true;
+	}
+	return false;
+}
+
+static bool batch_has_ds4(const BatchJob *job, const char *path)
+{
+	for (int i = 0; i < job->count; i++)
+	{
+		if (strcmp(job->rows[i].ds4, path) == 0)
+			return true;
+	}
+	return false;
+}
+
+// Os nomes vão crus para o CSV/NDJSON e para a busca do -c: vírgula, aspas, barra invertida
+// e controles quebrariam a linha e casariam o par errado ao continuar.
+static bool batch_token_safe(const char *token)
+{
+	for (; *token; token++)
+	{
+		if (*token == ',' || *token == '"' || *token == '\\' || (unsigned char)*token < 0x20)
+			return false;
+	}
+	return true;
+}
+
+static bool batch_add_row(BatchJob *job, const char *esp32, const char *ds4)
+{
+	if (job->count >= BATCH_MAX_ROWS || strlen(esp32) >= ESP32_PORT_NAME_MAX ||
+		strlen(ds4) >= DS4_PATH_MAX || !batch_token_safe(esp32) || !batch_token_safe(ds4))
+	{
+		return false;
+	}
+	BatchRow *row = &job->rows[job->count++];
+	memset(row, 0, sizeof(BatchRow));
+	snprintf(row->esp32, sizeof(row->esp32), "%s", esp32);
+	snprintf(row->ds4, sizeof(row->ds4), "%s", ds4);
+	return true;
+}
+
+static bool batch_load_manifest(BatchJob *job, const char *path)
+{
+	FILE *file = fopen(path, "r");
+	if (!file)
+	{
+		fprintf(stderr, "[ERRO]: Não foi possível abrir o manifesto %s.\n", path);
+		return false;
+	}
+
+	char line[BATCH_LINE_MAX];
+	int line_no = 0;
+	bool ok = true;
+
+	while (ok && fgets(line, sizeof(line), file))
+	{
+		line_no++;
+		char *comment = strchr(line, '#');
+		if (comment)
+			*comment = '\0';
+
+		char esp32[BATCH_LINE_MAX];
+		char ds4[BATCH_LINE_MAX];
+		int fields = sscanf(line, "%255s %255s", esp32, ds4);
+
+		if (fields <= 0)
+			continue;
+
+		if (fields == 1 && strcmp(esp32, BATCH_AUTO) == 0)
+		{
+			job->has_auto = true;
+		}
+		else if (fields != 2 || !batch_add_row(job, esp32, ds4))
+		{
+			fprintf(stderr, "[ERRO]: Manifesto inválido na linha %d.\n", line_no);
+			ok = false;
+		}
+	}
+	fclose(file);
+	return ok;
+}
+
+static void batch_expand_auto(BatchJob *job)
+{
+	char ports[ESP32_MAX_PORTS][ESP32_PORT_NAME_MAX];
+	char paths[DS4_MAX_DEVICES][DS4_PATH_MAX];
+	int port_count = esp32_list_ports(ports, ESP32_MAX_PORTS);
+	int path_count = ds4_list_devices(paths, DS4_MAX_DEVICES);
+	int p = 0;
+	int d = 0;
+
+	while (p < port_count && d < path_count)
+	{
+		if (batch_has_esp32(job, ports[p]))
+		{
+			p++;
+		}
+		else if (batch_has_ds4(job, paths[d]))
+		{
+			d++;
+		}
+		else if (!batch_add_row(job, ports[p++], paths[d++]))
+		{
+			break;
+		}
+	}
+
+	if (job->verbose)
+	{
+		fprintf(stdout, "[INFO]: auto: %d porta(s) ESP32, %d controle(s) DS4.\n",
+				port_count < 0 ? 0 : port_count, path_count < 0 ? 0 : path_count);
+	}
+}
+
+static bool batch_row_finished(const char *line, const BatchRow *row, OutputFormat format)
+{
+	char key[BATCH_LINE_MAX];
+	if (format == FORMAT_CSV)
+	{
+		snprintf(key, sizeof(key), "%s,%s,", row->esp32, row->ds4);
+		return strncmp(line, key, strlen(key)) == 0 && strstr(line, ",ok,") != NULL;
+	}
+	snprintf(key, sizeof(key), "\"esp32\":\"%s\",\"ds4\":\"%s\",", row->esp32, row->ds4);
+	return strstr(line, key) != NULL && strstr(line, "\"status\":\"ok\"") != NULL;
+}
+
+static int batch_mark_finished(BatchJob *job, const char *path)
+{
+	FILE *file = fopen(path, "r");
+	if (!file)
+		return 0;
+
+	char line[BATCH_LINE_MAX * 2];
+	int finished = 0;
+	while (fgets(line, sizeof(line), file))
+	{
+		for (int i = 0; i < job->count; i++)
+		{
+			if (!job->rows[i].status && batch_row_finished(line, &job->rows[i], job->format))
+			{
+				job->rows[i].status = "skip";
+				finished++;
+			}
+		}
+	}
+	fclose(file);
+	return finished;
+}
+
+static void batch_write_row(BatchJob *job, const BatchRow *row)
+{
+	pthread_mutex_lock(&job->out_lock);
+	if (job->format == FORMAT_CSV)
+	{
+		fprintf(job->out, "%s,%s,%s,%s,%.1f,%.1f,%.1f,%s,%d,%s\n",
+				row->esp32, row->ds4, row->mac, row->status,
+				row->ms_esp32, row->ms_ds4, row->ms_total, row->error ? row->error : "",
+				row->reused, row->previous_ds4);
+	}
+	else
+	{
+		fprintf(job->out,
+				"{\"esp32\":\"%s\",\"ds4\":\"%s\",\"mac\":\"%s\",\"status\":\"%s\","
+				"\"ms_esp32\":%.1f,\"ms_ds4\":%.1f,\"ms_total\":%.1f,\"error\":\"%s\","
+				"\"reused\":%s,\"previous_ds4\":\"%s\"}\n",
+				row->esp32, row->ds4, row->mac, row->status,
+				row->ms_esp32, row->ms_ds4, row->ms_total, row->error ? row->error : "",
+				row->reused ? "true" : "false", row->previous_ds4);
+	}
+	fflush(job->out);
+	if (job->verbose)
+	{
+		fprintf(stdout, "[INFO]: %s -> %s: %s (%.1f ms)\n", row->esp32, row->ds4, row->status, row->ms_total);
+	}
+	if (row->reused)
+	{
+		fprintf(stderr, "[INFO]: %s já foi gravado no controle %s.\n", row->mac, row->previous_ds4);
+	}
+	pthread_mutex_unlock(&job->out_lock);
+}
+
+// Chamado pelo estágio record, uma unidade por vez.
+static void batch_row_done(const pipeline_unit_t *unit, void *user)
+{
+	BatchJob *job = user;
+	BatchRow *row = unit->tag;
+
+	snprintf(row->mac, sizeof(row->mac), "%s", unit->mac);
+	row->status = unit->ok ? "ok" : "erro";
+	row->error = unit->ok ? NULL : unit->error;
+	row->reused = unit->reused;
+	row->previous_ds4[0] = '\0';
+	if (unit->reused)
+	{
+		ds4_mac_to_string(unit->previous_ds4, row->previous_ds4);
+	}
+	row->ms_esp32 = unit->ms[PIPELINE_DISCOVER] + unit->ms[PIPELINE_READ];
+	row->ms_ds4 = unit->ms[PIPELINE_WRITE] + unit->ms[PIPELINE_VERIFY];
+	row->ms_total = unit->ms_total;
+	batch_write_row(job, row);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *manifest_path = NULL;
+	const char *output_path = NULL;
+	const char *format_arg = NULL;
+	bool resume = false;
+
+	static BatchJob job;
+	memset(&job, 0, sizeof(job));
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-i") == 0)
+		{
+			job.verbose = true;
+		}
+		else if (strcmp(argv[i], "-c") == 0)
+		{
+			resume = true;
+		}
+		else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+		{
+			manifest_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+		{
+			output_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+		{
+			format_arg = argv[++i];
+		}
+		else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc)
+		{
+			if (!metrics_start(argv[++i], "ttbatch"))
+			{
+				fprintf(stderr, "[ERRO]: Não foi possível criar %s.\n", argv[i]);
+				return 1;
+			}
+			atexit(metrics_stop);
+		}
+		else if (strcmp(argv[i], "-h") == 0)
+		{
+			print_help(argv[0]);
+			return 0;
+		}
+		else
+		{
+			print_help(argv[0]);
+			return 1;
+		}
+	}
+
+	if (!manifest_path || !output_path)
+	{
+		print_help(argv[0]);
+		return 1;
+	}
+
+	const char *ext = strrchr(output_path, '.');
+	bool ndjson = format_arg ? strcmp(format_arg, "ndjson") == 0 : (ext && strcmp(ext, ".ndjson") == 0);
+	job.format = ndjson ? FORMAT_NDJSON : FORMAT_CSV;
+
+	if (!batch_load_manifest(&job, manifest_path))
+	{
+		return 1;
+	}
+	if (job.has_auto)
+	{
+		batch_expand_auto(&job);
+	}
+	if (job.count == 0)
+	{
+		fprintf(stderr, "[ERRO]: Nenhum par para processar.\n");
+		return 1;
+	}
+
+	int skipped = resume ? batch_mark_finished(&job, output_path) : 0;
+	if (job.verbose && skipped > 0)
+	{
+		fprintf(stdout, "[INFO]: %d par(es) já concluído(s), pulando.\n", skipped);
+	}
+
+	job.out = fopen(output_path, resume ? "a" : "w");
+	if (!job.out)
+	{
+		fprintf(stderr, "[ERRO]: Não foi possível abrir a saída %s.\n", output_path);
+		return 1;
+	}
+	fseek(job.out, 0, SEEK_END);
+	if (job.format == FORMAT_CSV && ftell(job.out) == 0)
+	{
+		fprintf(job.out, "esp32,ds4,mac,status,ms_esp32,ms_ds4,ms_total,error,reused,previous_ds4\n");
+	}
+	pthread_mutex_init(&job.out_lock, NULL);
+
+	// Leituras de ESP32 e gravações de DS4 de pares diferentes se sobrepõem; cada estágio tem um worker por par pendente.
+	int pending = job.count - skipped;
+	ledger_t *ledger = ledger_open(NULL);
+	if (!ledger)
+	{
+		fprintf(stderr, "[INFO]: Histórico de pareamentos indisponível; gravações não serão registradas.\n");
+	}
+	pipeline_config_t config;
+	pipeline_config_default(&config);
+	config.workers[PIPELINE_READ] = pending;
+	config.workers[PIPELINE_WRITE] = pending;
+	config.workers[PIPELINE_VERIFY] = pending;
+	config.ledger = ledger;
+	config.done = batch_row_done;
+	config.user = &job;
+
+	pipeline_t *pipeline = pipeline_create(&config);
+	if (!pipeline)
+	{
+		fprintf(stderr, "[ERRO]: Não foi possível iniciar o pipeline.\n");
+		ledger_close(ledger);
+		fclose(job.out);
+		return 1;
+	}
+
+	for (int i = 0; i < job.count; i++)
+	{
+		if (!job.rows[i].status)
+		{
+			pipeline_submit(pipeline, job.rows[i].esp32, job.rows[i].ds4, &job.rows[i]);
+		}
+	}
+	pipeline_finish(pipeline);
+	pipeline_destroy(pipeline);
+	ledger_close(ledger);
+
+	int failures = 0;
+	for (int i = 0; i < job.count; i++)
+	{
+		if (job.rows[i].status && strcmp(job.rows[i].status, "erro") == 0)
+		{
+			failures++;
+		}
+	}
+
+	pthread_mutex_destroy(&job.out_lock);
+	fclose(job.out);
+
+	if (failures > 0)
+	{
+		fprintf(stderr, "[ERRO]: %d de %d par(es) falharam.\n", failures, job.count);
+		return 1;
+	}
+	if (job.verbose)
+	{
+		fprintf(stdout, "[INFO]: %d par(es) processado(s).\n", job.count - skipped);
+	}
+	return 0;
+}
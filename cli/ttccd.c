@@ -0,0 +1,464 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include "libds4.h"
+#include "libesp32.h"
+#include "platform.h"
+#include "libpool.h"
+#include "libledger.h"
+#include "metrics.h"
+
+#define DAEMON_SOCKET_DEFAULT "/tmp/ttccd.sock"
+#define DAEMON_LINE_MAX 256
+#define DAEMON_BACKLOG 16
+#define DAEMON_POLL_MS 250
+#define DAEMON_SOCKET_MODE 0600
+
+typedef struct
+{
+	int fd;
+	device_pool_t *pool;
+	ledger_t *ledger;
+	bool verbose;
+} ClientTask;
+
+static volatile sig_atomic_t running = 1;
+static pthread_mutex_t clients_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t clients_done = PTHREAD_COND_INITIALIZER;
+static int clients_active = 0;
+
+static void print_help(const char *prog_name)
+{
+	fprintf(stdout, "[HELP]: %s [-i] [-s <socket>]\n", prog_name);
+	fprintf(stdout, "        -i: Informativo (Verbose)\n");
+	fprintf(stdout, "        -s: Caminho do socket (padrão: %s)\n", DAEMON_SOCKET_DEFAULT);
+	fprintf(stdout, "        --metrics: Exporta latências e contadores em <arquivo> (textfile do Prometheus, atualizado a cada %d s)\n", METRICS_FLUSH_MS / 1000);
+	fprintf(stdout, "[PROTOCOLO]: Uma requisição por linha, uma resposta \"OK ...\" ou \"ERR ...\".\n");
+	fprintf(stdout, "        LIST | READ <disp> | WRITE <ds4> <mac> | PAIR <esp32> [<ds4>] | REFRESH | QUIT\n");
+}
+
+static void handle_signal(int sig)
+{
+	(void)sig;
+	running = 0;
+}
+
+static bool send_line(int fd, const char *line)
+{
+	size_t len = strlen(line);
+	while (len > 0)
+	{
+		ssize_t sent = send(fd, line, len, 0);
+		if (sent < 0 && errno == EINTR)
+			continue;
+		if (sent <= 0)
+			return false;
+		line += sent;
+		len -= (size_t)sent;
+	}
+	return true;
+}
+
+static const char *entry_state(const pool_entry_t *entry)
+{
+	return entry->stale ? "stale" : "fresh";
+}
+
+static bool cmd_list(const ClientTask *task)
+{
+	pool_entry_t ds4[DS4_MAX_DEVICES];
+	pool_entry_t esp32[ESP32_MAX_PORTS];
+	int ds4_count = pool_list_ds4(task->pool, ds4, DS4_MAX_DEVICES);
+	int esp32_count = pool_list_esp32(task->pool, esp32, ESP32_MAX_PORTS);
+	char line[DAEMON_LINE_MAX];
+
+	snprintf(line, sizeof(line), "OK %d\n", ds4_count + esp32_count);
+	bool ok = send_line(task->fd, line);
+	for (int i = 0; ok && i < ds4_count; i++)
+	{
+		snprintf(line, sizeof(line), "DS4 %.*s %.*s %s\n", (int)sizeof(ds4[i].name), ds4[i].name,
+				 (int)sizeof(ds4[i].mac), ds4[i].mac, entry_state(&ds4[i]));
+		ok = send_line(task->fd, line);
+	}
+	for (int i = 0; ok && i < esp32_count; i++)
+	{
+		snprintf(line, sizeof(line), "ESP32 %.*s %.*s %s\n", (int)sizeof(esp32[i].name), esp32[i].name,
+				 (int)sizeof(esp32[i].mac), esp32[i].mac, entry_state(&esp32[i]));
+		ok = send_line(task->fd, line);
+	}
+	return ok;
+}
+
+static void cmd_read(const ClientTask *task, const char *name, char *reply, size_t size)
+{
+	pool_entry_t entry;
+	if (!pool_find(task->pool, name, &entry))
+	{
+		snprintf(reply, size, "ERR desconhecido\n");
+		return;
+	}
+	snprintf(reply, size, "OK %s %s\n", entry.mac, entry_state(&entry));
+}
+
+// Confere o ledger antes de gravar e registra o resultado; um MAC já gravado em outro
+// controle responde "OK <mac> reused <ds4>".
+static bool cmd_write(const ClientTask *task, const char *path, const char *mac, char *reply, size_t size)
+{
+	uint8_t target[DS4_MAC_ADDR_LEN];
+	if (!ds4_string_to_mac(mac, target))
+	{
+		snprintf(reply, size, "ERR mac\n");
+		return false;
+	}
+
+	ledger_record_t entry = {0};
+	ledger_record_t previous;
+	bool known = pool_ds4_device_mac(task->pool, path, entry.ds4_mac);
+	bool reused = task->ledger && ledger_find_esp(task->ledger, target, &previous) &&
+				  (!known || memcmp(previous.ds4_mac, entry.ds4_mac, DS4_MAC_ADDR_LEN) != 0);
+
+	bool ok = pool_ds4_set_mac(task->pool, path, target);
+	if (task->ledger)
+	{
+		memcpy(entry.esp_mac, target, DS4_MAC_ADDR_LEN);
+		snprintf(entry.ds4_path, sizeof(entry.ds4_path), "%s", path);
+		entry.result = ok ? 0 : 1;
+		if (!ledger_append(task->ledger, &entry))
+		{
+			fprintf(stderr, "[ERRO]: Falha ao registrar a gravação de %s no ledger.\n", path);
+		}
+	}
+
+	char mac_str[POOL_MAC_STR_LEN];
+	ds4_mac_to_string(target, mac_str);
+	if (!ok)
+	{
+		snprintf(reply, size, "ERR gravacao\n");
+	}
+	else if (reused)
+	{
+		char other[POOL_MAC_STR_LEN];
+		ds4_mac_to_string(previous.ds4_mac, other);
+		snprintf(reply, size, "OK %s reused %s\n", mac_str, other);
+	}
+	else
+	{
+		snprintf(reply, size, "OK %s\n", mac_str);
+	}
+	return ok;
+}
+
+// Mesma série do pipeline (caminho do DS4): o ciclo do PAIR aparece no --metrics do daemon.
+static void cmd_pair(const ClientTask *task, const char *port, const char *path, char *reply, size_t size)
+{
+	uint64_t start_ns = platform_monotonic_ns();
+	pool_entry_t entry;
+	pool_entry_t ds4;
+	if (!pool_find(task->pool, port, &entry) || entry.stale)
+	{
+		snprintf(reply, size, "ERR esp32\n");
+		metrics_count(metrics_series("station"), METRIC_PAIR_FAILURES, 1);
+		return;
+	}
+	// Sem controle indicado, resolve o caminho aqui para que o ledger registre qual foi gravado.
+	if (!path)
+	{
+		if (!pool_get_ds4(task->pool, &ds4) || ds4.stale)
+		{
+			snprintf(reply, size, "ERR ds4\n");
+			metrics_count(metrics_series("station"), METRIC_PAIR_FAILURES, 1);
+			return;
+		}
+		path = ds4.name;
+	}
+
+	metrics_series_t *series = metrics_series(path);
+	if (cmd_write(task, path, entry.mac, reply, size))
+		metrics_observe(series, METRIC_PAIR_CYCLE, platform_monotonic_ns() - start_ns);
+	else
+		metrics_count(series, METRIC_PAIR_FAILURES, 1);
+}
+
+static bool handle_request(const ClientTask *task, char *line)
+{
+	char cmd[16] = {0};
+	char arg1[DAEMON_LINE_MAX] = {0};
+	char arg2[DAEMON_LINE_MAX] = {0};
+	char reply[DAEMON_LINE_MAX];
+	int fields = sscanf(line, "%15s %255s %255s", cmd, arg1, arg2);
+
+	if (fields <= 0)
+		return true;
+
+	if (task->verbose)
+	{
+		fprintf(stdout, "[INFO]: [%d] %s\n", task->fd, line);
+	}
+
+	if (strcmp(cmd, "LIST") == 0)
+	{
+		return cmd_list(task);
+	}
+	if (strcmp(cmd, "QUIT") == 0)
+	{
+		send_line(task->fd, "OK\n");
+		return false;
+	}
+
+	if (strcmp(cmd, "READ") == 0 && fields == 2)
+	{
+		cmd_read(task, arg1, reply, sizeof(reply));
+	}
+	else if (strcmp(cmd, "WRITE") == 0 && fields == 3)
+	{
+		cmd_write(task, arg1, arg2, reply, sizeof(reply));
+	}
+	else if (strcmp(cmd, "PAIR") == 0 && fields >= 2)
+	{
+		cmd_pair(task, arg1, fields == 3 ? arg2 : NULL, reply, sizeof(reply));
+	}
+	else if (strcmp(cmd, "REFRESH") == 0)
+	{
+		pool_refresh(task->pool);
+		snprintf(reply, sizeof(reply), "OK\n");
+	}
+	else
+	{
+		snprintf(reply, sizeof(reply), "ERR comando\n");
+	}
+	return send_line(task->fd, reply);
+}
+
+static void *client_worker(void *arg)
+{
+	ClientTask *task = arg;
+	char buffer[DAEMON_LINE_MAX];
+	size_t used = 0;
+	bool open = true;
+
+	while (open && running)
+	{
+		struct pollfd pfd = {task->fd, POLLIN, 0};
+		if (poll(&pfd, 1, DAEMON_POLL_MS) == 0)
+			continue;
+
+		ssize_t got = recv(task->fd, buffer + used, sizeof(buffer) - 1 - used, 0);
+		if (got < 0 && errno == EINTR)
+			continue;
+		if (got <= 0)
+			break;
+		used += (size_t)got;
+		buffer[used] = '\0';
+
+		char *start = buffer;
+		char *newline;
+		while (open && (newline = strchr(start, '\n')))
+		{
+			*newline = '\0';
+			if (newline > start && newline[-1] == '\r')
+				newline[-1] = '\0';
+			open = handle_request(task, start);
+			start = newline + 1;
+		}
+
+		used = (size_t)(buffer + used - start);
+		memmove(buffer, start, used);
+		if (used == sizeof(buffer) - 1)
+		{
+			send_line(task->fd, "ERR linha\n");
+			break;
+		}
+	}
+
+	close(task->fd);
+	free(task);
+
+	pthread_mutex_lock(&clients_lock);
+	clients_active--;
+	pthread_cond_signal(&clients_done);
+	pthread_mutex_unlock(&clients_lock);
+	return NULL;
+}
+
+static int open_listener(const char *socket_path)
+{
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(socket_path) >= sizeof(addr.sun_path))
+	{
+		return -1;
+	}
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", socket_path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+	{
+		return -1;
+	}
+
+	// Outro ttccd atendendo no mesmo caminho: não rouba o socket (os dois brigariam pelo hardware).
+	// O arquivo só é removido quando ninguém atende (sobra de um daemon que caiu).
+	int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (probe >= 0)
+	{
+		bool alive = connect(probe, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+		int err = errno;
+		close(probe);
+		if (alive)
+		{
+			close(fd);
+			return -2;
+		}
+		if (err == ECONNREFUSED)
+		{
+			unlink(socket_path);
+		}
+	}
+
+	// Só o dono do daemon grava MACs: o socket nasce com modo 0600.
+	mode_t old_mask = umask(0177);
+	bool ok = bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+	umask(old_mask);
+	if (!ok || chmod(socket_path, DAEMON_SOCKET_MODE) != 0 || listen(fd, DAEMON_BACKLOG) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *socket_path = DAEMON_SOCKET_DEFAULT;
+	bool verbose = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-i") == 0)
+		{
+			verbose = true;
+		}
+		else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+		{
+			socket_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc)
+		{
+			if (!metrics_start(argv[++i], "ttccd"))
+			{
+				fprintf(stderr, "[ERRO]: Não foi possível criar %s.\n", argv[i]);
+				return 1;
+			}
+			atexit(metrics_stop);
+		}
+		else if (strcmp(argv[i], "-h") == 0)
+		{
+			print_help(argv[0]);
+			return 0;
+		}
+		else
+		{
+			print_help(argv[0]);
+			return 1;
+		}
+	}
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = handle_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	int listener = open_listener(socket_path);
+	if (listener == -2)
+	{
+		fprintf(stderr, "[ERRO]: Já existe um ttccd atendendo em %s.\n", socket_path);
+		return 1;
+	}
+	if (listener < 0)
+	{
+		fprintf(stderr, "[ERRO]: Falha ao abrir o socket %s.\n", socket_path);
+		return 1;
+	}
+
+	device_pool_t *pool = pool_create();
+	if (!pool)
+	{
+		fprintf(stderr, "[ERRO]: Falha ao iniciar o pool de dispositivos.\n");
+		close(listener);
+		unlink(socket_path);
+		return 1;
+	}
+
+	// Mesmo histórico de ttds4 e ttcc; sem ele o daemon grava, mas não registra nem avisa reuso.
+	ledger_t *ledger = ledger_open(NULL);
+	if (!ledger)
+	{
+		fprintf(stderr, "[INFO]: Histórico de pareamentos indisponível; gravações não serão registradas.\n");
+	}
+
+	if (verbose)
+	{
+		fprintf(stdout, "[INFO]: Escutando em %s\n", socket_path);
+	}
+
+	while (running)
+	{
+		struct pollfd pfd = {listener, POLLIN, 0};
+		if (poll(&pfd, 1, DAEMON_POLL_MS) <= 0)
+			continue;
+
+		int fd = accept(listener, NULL, NULL);
+		if (fd < 0)
+			continue;
+
+		ClientTask *task = malloc(sizeof(ClientTask));
+		pthread_t thread;
+		if (!task)
+		{
+			close(fd);
+			continue;
+		}
+		*task = (ClientTask){fd, pool, ledger, verbose};
+
+		pthread_mutex_lock(&clients_lock);
+		clients_active++;
+		pthread_mutex_unlock(&clients_lock);
+
+		if (pthread_create(&thread, NULL, client_worker, task) != 0)
+		{
+			close(fd);
+			free(task);
+			pthread_mutex_lock(&clients_lock);
+			clients_active--;
+			pthread_mutex_unlock(&clients_lock);
+			continue;
+		}
+		pthread_detach(thread);
+	}
+
+	// Os clientes conferem "running" a cada poll; o pool só é liberado depois deles.
+	pthread_mutex_lock(&clients_lock);
+	while (clients_active > 0)
+	{
+		pthread_cond_wait(&clients_done, &clients_lock);
+	}
+	pthread_mutex_unlock(&clients_lock);
+
+	close(listener);
+	unlink(socket_path);
+	pool_destroy(pool);
+	ledger_close(ledger);
+	return 0;
+}
@@ -1,12 +1,115 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "libds4.h"
+#include "libledger.h"
+#include "libmacpool.h"
+#include "instrument.h"
+#include "trace.h"
+#include "eventring.h"
+#include "metrics.h"
 
 static void print_help(const char *prog_name)
 {
-	fprintf(stdout, "[HELP]: %s [-i] [-d] [-r | -w <mac>]\n", prog_name);
+	fprintf(stdout, "[HELP]: %s [-i] [-d] [-r | -w <mac> | -w --pool]\n", prog_name);
+	fprintf(stdout, "        %s --pool-add <primeiro> <último>\n", prog_name);
 	fprintf(stdout, "        -i: Informativo (Verbose)\n");
-	fprintf(stdout, "        -d: Ativar Debug da porta USB\n");
+	fprintf(stdout, "        -d: Ativar Debug da porta USB e exibir o trace de eventos ao final\n");
+	fprintf(stdout, "        --trace: Grava as transferências USB em <arquivo> (formato binário TTTR)\n");
+	fprintf(stdout, "        --replay: Reproduz uma captura no lugar do controle (--realtime mantém os tempos gravados)\n");
+	fprintf(stdout, "        --pool: Grava o próximo MAC livre do pool da estação (para controles sem ESP32)\n");
+	fprintf(stdout, "        --pool-add: Acrescenta a faixa <primeiro>..<último> ao pool e lista as faixas\n");
+	fprintf(stdout, "        --metrics: Exporta latências e contadores em <arquivo> (textfile do Prometheus, atualizado a cada %d s)\n", METRICS_FLUSH_MS / 1000);
+}
+
+static int add_pool_range(const char *first_arg, const char *last_arg)
+{
+	uint8_t first[DS4_MAC_ADDR_LEN];
+	uint8_t last[DS4_MAC_ADDR_LEN];
+	if (!ds4_string_to_mac(first_arg, first) || !ds4_string_to_mac(last_arg, last))
+	{
+		fprintf(stderr, "[ERRO]: MAC inválido.\n");
+		return 1;
+	}
+
+	macpool_t *pool = macpool_open(NULL);
+	if (!pool)
+	{
+		fprintf(stderr, "[ERRO]: Não foi possível abrir o pool de MACs.\n");
+		return 1;
+	}
+	int exit_code = 0;
+	if (!macpool_add_range(pool, first, last))
+	{
+		fprintf(stderr, "[ERRO]: Faixa rejeitada (invertida, com mais de %u MACs, sobreposta ou acima de %d faixas).\n",
+				MACPOOL_RANGE_ADDRESSES_MAX, MACPOOL_RANGES_MAX);
+		exit_code = 1;
+	}
+
+	macpool_range_t range;
+	for (int i = 0; macpool_get_range(pool, i, &range); i++)
+	{
+		char from[18];
+		char to[18];
+		ds4_mac_to_string(range.first, from);
+		ds4_mac_to_string(range.last, to);
+		fprintf(stdout, "[INFO]: Faixa %d: %s - %s (%llu de %llu em uso)\n", i, from, to,
+				(unsigned long long)range.used, (unsigned long long)range.total);
+	}
+	macpool_close(pool);
+	return exit_code;
+}
+
+// Avisa se o MAC já foi gravado em outro controle e registra a gravação no ledger.
+// Com pool, o MAC é reservado aqui, devolvido se a gravação falhar e confirmado se der certo.
+static bool write_mac(ds4_context_t *ctx, uint8_t *mac, bool record, macpool_t *pool)
+{
+	ledger_t *ledger = record ? ledger_open(NULL) : NULL;
+	if (pool && !macpool_allocate(pool, ledger, mac))
+	{
+		fprintf(stderr, "[ERRO]: Pool de MACs sem endereços livres (use --pool-add).\n");
+		ledger_close(ledger);
+		return false;
+	}
+
+	ledger_record_t entry = {0};
+	ledger_record_t previous;
+	bool known = ds4_get_device_mac(ctx, entry.ds4_mac);
+
+	if (ledger && ledger_find_esp(ledger, mac, &previous) &&
+		(!known || memcmp(previous.ds4_mac, entry.ds4_mac, DS4_MAC_ADDR_LEN) != 0))
+	{
+		char other[18];
+		char when[32];
+		time_t stamp = (time_t)previous.time;
+		ds4_mac_to_string(previous.ds4_mac, other);
+		strftime(when, sizeof(when), "%Y-%m-%d %H:%M", localtime(&stamp));
+		fprintf(stderr, "[INFO]: Este MAC já foi gravado no controle %s (%s) em %s.\n", other, previous.ds4_path, when);
+	}
+
+	bool ok = ds4_set_mac(ctx, mac);
+	if (pool && !ok)
+	{
+		macpool_release(pool, mac);
+	}
+	if (ledger)
+	{
+		memcpy(entry.esp_mac, mac, DS4_MAC_ADDR_LEN);
+		snprintf(entry.ds4_path, sizeof(entry.ds4_path), "%s", ds4_get_path(ctx));
+		entry.result = ok ? 0 : 1;
+		if (!ledger_append(ledger, &entry))
+		{
+			fprintf(stderr, "[ERRO]: Falha ao registrar a gravação no ledger.\n");
+		}
+		ledger_close(ledger);
+	}
+	// Só depois do ledger: uma reserva recuperada de um processo morto ainda é pulada por constar nele.
+	if (pool && ok)
+	{
+		macpool_commit(pool, mac);
+	}
+	return ok;
 }
 
 int main(int argc, char *argv[])
@@ -22,6 +125,9 @@ int main(int argc, char *argv[])
 	bool mode_read = false;
 	bool mode_write = false;
 	char *mac_arg = NULL;
+	const char *replay_path = NULL;
+	bool replay_realtime = false;
+	bool use_pool = false;
 
 	for (int i = 1; i < argc; i++)
 	{
@@ -41,6 +147,40 @@ int main(int argc, char *argv[])
 		{
 			mode_write = true;
 		}
+		else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+		{
+			if (!trace_start(argv[++i]))
+			{
+				fprintf(stderr, "[ERRO]: Não foi possível criar %s.\n", argv[i]);
+				return 1;
+			}
+			atexit(trace_stop);
+		}
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+		{
+			replay_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "--realtime") == 0)
+		{
+			replay_realtime = true;
+		}
+		else if (strcmp(argv[i], "--pool") == 0)
+		{
+			use_pool = true;
+		}
+		else if (strcmp(argv[i], "--pool-add") == 0 && i + 2 < argc)
+		{
+			return add_pool_range(argv[i + 1], argv[i + 2]);
+		}
+		else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc)
+		{
+			if (!metrics_start(argv[++i], "ttds4"))
+			{
+				fprintf(stderr, "[ERRO]: Não foi possível criar %s.\n", argv[i]);
+				return 1;
+			}
+			atexit(metrics_stop);
+		}
 		else if (strcmp(argv[i], "-h") == 0)
 		{
 			print_help(argv[0]);
@@ -58,9 +198,25 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 
+	if (use_pool && (!mode_write || replay_path))
+	{
+		fprintf(stderr, "[ERRO]: --pool só vale com -w e sem --replay.\n");
+		return 1;
+	}
+
 	uint8_t mac_bytes[DS4_MAC_ADDR_LEN];
+	macpool_t *pool = NULL;
 
-	if (mode_write)
+	if (use_pool)
+	{
+		pool = macpool_open(NULL);
+		if (!pool)
+		{
+			fprintf(stderr, "[ERRO]: Não foi possível abrir o pool de MACs.\n");
+			return 1;
+		}
+	}
+	else if (mode_write)
 	{
 		bool ok = (mac_arg ? ds4_string_to_mac(mac_arg, mac_bytes) : ds4_scan_mac(mac_bytes));
 
@@ -71,10 +227,11 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	ds4_context_t *ctx = ds4_create_context();
+	ds4_context_t *ctx = replay_path ? ds4_replay_context(replay_path, NULL, replay_realtime) : ds4_create_context();
 	if (!ctx)
 	{
-		fprintf(stderr, "[ERRO]: Falha ao conectar ao controle.\n");
+		fprintf(stderr, "[ERRO]: Falha ao conectar ao controle (desconectado ou em uso).\n");
+		macpool_close(pool);
 		return 1;
 	}
 
@@ -105,9 +262,13 @@ int main(int argc, char *argv[])
 	}
 	else
 	{
-		if (ds4_set_mac(ctx, mac_bytes))
+		if (write_mac(ctx, mac_bytes, !replay_path, pool))
 		{
-			if (verbose)
+			if (pool && !verbose)
+			{
+				ds4_print_mac(mac_bytes);
+			}
+			else if (verbose)
 			{
 				fprintf(stdout, "[INFO]: MAC Gravado: ");
 				ds4_print_mac(mac_bytes);
@@ -121,5 +282,18 @@ int main(int argc, char *argv[])
 	}
 
 	ds4_destroy_context(ctx);
+	macpool_close(pool);
+	if (exit_code != 0 || debug_usb)
+	{
+		ring_dump(stderr);
+	}
+	if (replay_path)
+	{
+		fprintf(stderr, "[INFO]: Replay: %zu divergência(s) em relação à captura.\n", trace_divergences());
+	}
+	if (verbose)
+	{
+		instr_print_summary(stdout);
+	}
 	return exit_code;
 }
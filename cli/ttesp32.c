@@ -1,18 +1,410 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "platform.h"
+#include "md5.h"
 #include "libesp32.h"
+#include "instrument.h"
+#include "trace.h"
+#include "eventring.h"
+#include "metrics.h"
+
+#define BAUDRATE_FAST_DEFAULT 460800
+#define FLASH_SIZE_DEFAULT (4u * 1024u * 1024u)
+#define FLASH_OFFSET_DEFAULT 0x10000u
+#define DUMP_PATH_MAX 512
+#define DUMP_PROGRESS_STEP 4096
+
+typedef struct
+{
+	uint64_t start_ns;
+	size_t last_done;
+} DumpProgress;
+
+typedef struct
+{
+	const char *port;
+	const esp32_flash_image_t *image;
+	uint32_t offset;
+	uint32_t flash_size;
+	int baudrate;
+	bool show_progress;
+	bool ok;
+	const char *error;
+	uint64_t elapsed_ns;
+} FlashTask;
+
+// Com --replay, toda sessão é servida pela captura em vez da porta serial.
+static const char *replay_path = NULL;
+static bool replay_realtime = false;
 
 static void print_help(const char *prog_name)
 {
-	fprintf(stdout, "[HELP]: %s [-i] [-r <port>]\n", prog_name);
+	fprintf(stdout, "[HELP]: %s [-i] [-d] [-f] [-r <port>]\n", prog_name);
+	fprintf(stdout, "        %s [-i] [-b <baud>] [-s <tamanho>] --dump <arquivo> [<port>]\n", prog_name);
+	fprintf(stdout, "        %s [-i] [-b <baud>] [-s <tamanho>] [-a <endereço>] --flash <imagem> [<port>...]\n", prog_name);
+	fprintf(stdout, "        -i: Informativo (Verbose)\n");
+	fprintf(stdout, "        -f: Forçar leitura da placa (ignora o cache de MAC)\n");
+	fprintf(stdout, "        -d: Exibir o trace de eventos ao final (sempre exibido em caso de falha)\n");
+	fprintf(stdout, "        --dump: Copia a flash para <arquivo> e os blocos do eFuse para <arquivo>.efuse\n");
+	fprintf(stdout, "        --flash: Grava <imagem> em todas as portas dadas (ou em todas as encontradas) em paralelo\n");
+	fprintf(stdout, "        -a: Endereço de gravação (padrão: 0x%X)\n", FLASH_OFFSET_DEFAULT);
+	fprintf(stdout, "        -b: Baud rate após o sync (padrão: %d)\n", BAUDRATE_FAST_DEFAULT);
+	fprintf(stdout, "        -s: Tamanho da flash, aceita sufixo K/M (padrão: 4M)\n");
+	fprintf(stdout, "        --trace: Grava todo o tráfego serial em <arquivo> (formato binário TTTR)\n");
+	fprintf(stdout, "        --replay: Reproduz uma captura no lugar da placa (--realtime mantém os tempos gravados)\n");
+	fprintf(stdout, "        --metrics: Exporta latências e contadores em <arquivo> (textfile do Prometheus, atualizado a cada %d s)\n", METRICS_FLUSH_MS / 1000);
+}
+
+static bool parse_size(const char *text, uint32_t *size_out)
+{
+	char *end;
+	unsigned long value = strtoul(text, &end, 0);
+	if (end == text)
+		return false;
+	if (*end == 'K' || *end == 'k')
+	{
+		value *= 1024ul;
+		end++;
+	}
+	else if (*end == 'M' || *end == 'm')
+	{
+		value *= 1024ul * 1024ul;
+		end++;
+	}
+	if (*end != '\0' || value == 0 || value > 0x1000000ul)
+		return false;
+	*size_out = (uint32_t)value;
+	return true;
+}
+
+static bool parse_offset(const char *text, uint32_t *offset_out)
+{
+	char *end;
+	unsigned long value = strtoul(text, &end, 0);
+	if (end == text || *end != '\0' || value >= 0x1000000ul)
+		return false;
+	*offset_out = (uint32_t)value;
+	return true;
+}
+
+// Só taxas que os conversores USB-serial comuns e o ROM aceitam.
+static const int baudrates[] = {115200, 230400, 460800, 921600, 1500000, 2000000};
+
+static bool parse_baudrate(const char *text, int *baudrate_out)
+{
+	char *end;
+	long value = strtol(text, &end, 10);
+	if (end == text || *end != '\0')
+		return false;
+	for (size_t i = 0; i < sizeof(baudrates) / sizeof(baudrates[0]); i++)
+	{
+		if (value == baudrates[i])
+		{
+			*baudrate_out = baudrates[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+static void print_progress(size_t done, size_t total, void *user)
+{
+	DumpProgress *state = user;
+	if (done - state->last_done < DUMP_PROGRESS_STEP && done != total)
+		return;
+	state->last_done = done;
+
+	double seconds = (double)(platform_monotonic_ns() - state->start_ns) / 1e9;
+	double rate = seconds > 0 ? (double)done / 1024.0 / seconds : 0.0;
+	fprintf(stderr, "\r[INFO]: %zu/%zu KB (%.1f KB/s)", done / 1024, total / 1024, rate);
+	if (done == total)
+		fprintf(stderr, "\n");
+}
+
+static esp32_session_t *open_synced_session(const char *port_arg)
+{
+	if (port_arg || replay_path)
+	{
+		esp32_session_t *session = replay_path ? esp32_session_replay(replay_path, port_arg, replay_realtime)
+											   : esp32_session_open(port_arg);
+		if (session && !esp32_session_sync(session))
+		{
+			esp32_session_close(session);
+			session = NULL;
+		}
+		return session;
+	}
+
+	char names[ESP32_MAX_PORTS][ESP32_PORT_NAME_MAX];
+	int count = esp32_list_ports(names, ESP32_MAX_PORTS);
+	for (int i = 0; i < count; i++)
+	{
+		esp32_session_t *session = open_synced_session(names[i]);
+		if (session)
+			return session;
+	}
+	return NULL;
+}
+
+static int run_dump(const char *port_arg, const char *path, int baudrate, uint32_t size, bool verbose)
+{
+	char efuse_path[DUMP_PATH_MAX];
+	if ((size_t)snprintf(efuse_path, sizeof(efuse_path), "%s.efuse", path) >= sizeof(efuse_path))
+	{
+		fprintf(stderr, "[ERRO]: Caminho de saída muito longo.\n");
+		return 1;
+	}
+
+	esp32_session_t *session = open_synced_session(port_arg);
+	if (!session)
+	{
+		fprintf(stderr, "[ERRO]: Nenhuma placa respondeu ao sync (segure BOOT ou verifique a porta).\n");
+		return 1;
+	}
+	if (verbose)
+	{
+		fprintf(stdout, "[INFO]: Conectado em %s (%s, RTT %.1f ms).\n", esp32_session_port_name(session),
+				esp32_session_chip_name(session), (double)esp32_session_rtt_us(session) / 1000.0);
+	}
+
+	if (!esp32_session_set_baudrate(session, baudrate))
+	{
+		fprintf(stderr, "[INFO]: Placa recusou %d baud, seguindo na taxa padrão.\n", baudrate);
+	}
+
+	int exit_code = 1;
+	FILE *out = NULL;
+	FILE *efuse = NULL;
+
+	if (!esp32_session_flash_attach(session, size))
+	{
+		fprintf(stderr, "[ERRO]: Falha ao acessar a flash SPI.\n");
+	}
+	else if (!(out = fopen(path, "wb")) || !(efuse = fopen(efuse_path, "w")))
+	{
+		fprintf(stderr, "[ERRO]: Não foi possível criar %s.\n", out ? efuse_path : path);
+	}
+	else if (!esp32_session_dump_efuse(session, efuse))
+	{
+		fprintf(stderr, "[ERRO]: Falha ao ler o eFuse.\n");
+	}
+	else
+	{
+		DumpProgress progress = {platform_monotonic_ns(), 0};
+		if (esp32_session_dump_flash(session, 0, size, out, print_progress, &progress))
+		{
+			exit_code = 0;
+			if (verbose)
+			{
+				fprintf(stdout, "[INFO]: Flash salva em %s, eFuse em %s.\n", path, efuse_path);
+			}
+		}
+		else
+		{
+			fprintf(stderr, "\n[ERRO]: Falha na leitura da flash.\n");
+		}
+	}
+
+	if (out)
+		fclose(out);
+	if (efuse)
+		fclose(efuse);
+	esp32_session_close(session);
+	if (verbose)
+	{
+		instr_print_summary(stdout);
+	}
+	return exit_code;
+}
+
+// Lê, completa para múltiplo de 4 (0xFF como a flash apagada) e comprime uma única vez;
+// a imagem comprimida é compartilhada, só leitura, entre todas as threads de gravação.
+static uint8_t *load_image(const char *path, esp32_flash_image_t *image)
+{
+	FILE *file = fopen(path, "rb");
+	if (!file)
+		return NULL;
+
+	long size = -1;
+	if (fseek(file, 0, SEEK_END) == 0)
+		size = ftell(file);
+	if (size <= 0 || size > 0x1000000l || fseek(file, 0, SEEK_SET) != 0)
+	{
+		fclose(file);
+		return NULL;
+	}
+
+	size_t raw_size = ((size_t)size + 3) & ~(size_t)3;
+	uint8_t *raw = malloc(raw_size);
+	if (!raw || fread(raw, 1, (size_t)size, file) != (size_t)size)
+	{
+		free(raw);
+		fclose(file);
+		return NULL;
+	}
+	fclose(file);
+	memset(raw + size, 0xFF, raw_size - (size_t)size);
+
+	uint8_t digest[MD5_DIGEST_LEN];
+	md5_context_t md5;
+	md5_init(&md5);
+	md5_update(&md5, raw, raw_size);
+	md5_final(&md5, digest);
+	md5_to_hex(digest, image->md5);
+
+	uLongf deflated_size = compressBound((uLong)raw_size);
+	uint8_t *deflated = malloc(deflated_size);
+	if (!deflated || compress2(deflated, &deflated_size, raw, (uLong)raw_size, Z_BEST_COMPRESSION) != Z_OK)
+	{
+		free(deflated);
+		free(raw);
+		return NULL;
+	}
+	free(raw);
+
+	image->deflated = deflated;
+	image->deflated_size = deflated_size;
+	image->raw_size = (uint32_t)raw_size;
+	return deflated;
+}
+
+static void *flash_worker(void *arg)
+{
+	FlashTask *task = arg;
+	uint64_t start = platform_monotonic_ns();
+	DumpProgress progress = {start, 0};
+
+	esp32_session_t *session = open_synced_session(task->port);
+	if (!session)
+	{
+		task->error = "sync";
+		return NULL;
+	}
+
+	// Sem a taxa rápida a gravação continua, só que mais lenta.
+	esp32_session_set_baudrate(session, task->baudrate);
+
+	if (!esp32_session_flash_attach(session, task->flash_size))
+	{
+		task->error = "spi";
+	}
+	else if (!esp32_session_flash_deflated(session, task->offset, task->image,
+										   task->show_progress ? print_progress : NULL, &progress))
+	{
+		task->error = "gravacao/md5";
+	}
+	else
+	{
+		esp32_session_hard_reset(session);
+		task->ok = true;
+	}
+
+	esp32_session_close(session);
+	task->elapsed_ns = platform_monotonic_ns() - start;
+	return NULL;
+}
+
+static int run_flash(char **ports, int port_count, const char *path, uint32_t offset, uint32_t flash_size,
+					 int baudrate, bool verbose)
+{
+	char found[ESP32_MAX_PORTS][ESP32_PORT_NAME_MAX];
+	char *found_ptrs[ESP32_MAX_PORTS];
+	if (port_count == 0)
+	{
+		port_count = esp32_list_ports(found, ESP32_MAX_PORTS);
+		for (int i = 0; i < port_count; i++)
+			found_ptrs[i] = found[i];
+		ports = found_ptrs;
+	}
+	if (port_count <= 0)
+	{
+		fprintf(stderr, "[ERRO]: Nenhuma porta encontrada.\n");
+		return 1;
+	}
+
+	esp32_flash_image_t image = {0};
+	uint8_t *deflated = load_image(path, &image);
+	if (!deflated)
+	{
+		fprintf(stderr, "[ERRO]: Não foi possível ler/comprimir %s.\n", path);
+		return 1;
+	}
+	if ((uint64_t)offset + image.raw_size > flash_size)
+	{
+		fprintf(stderr, "[ERRO]: A imagem não cabe na flash (%u bytes em 0x%X).\n", (unsigned)image.raw_size, (unsigned)offset);
+		free(deflated);
+		return 1;
+	}
+	if (verbose)
+	{
+		fprintf(stdout, "[INFO]: %s: %u -> %zu bytes (md5 %s), %d porta(s).\n", path,
+				(unsigned)image.raw_size, image.deflated_size, image.md5, port_count);
+		fflush(stdout);
+	}
+
+	FlashTask tasks[ESP32_MAX_PORTS];
+	pthread_t threads[ESP32_MAX_PORTS];
+	bool started[ESP32_MAX_PORTS] = {false};
+
+	for (int i = 0; i < port_count; i++)
+	{
+		tasks[i] = (FlashTask){ports[i], &image, offset, flash_size, baudrate, verbose && port_count == 1, false, "thread", 0};
+		started[i] = pthread_create(&threads[i], NULL, flash_worker, &tasks[i]) == 0;
+	}
+
+	int failures = 0;
+	for (int i = 0; i < port_count; i++)
+	{
+		if (started[i])
+			pthread_join(threads[i], NULL);
+
+		double seconds = (double)tasks[i].elapsed_ns / 1e9;
+		if (tasks[i].ok)
+		{
+			fprintf(stdout, "[INFO]: %s: OK em %.1f s (%.1f KB/s)\n", tasks[i].port, seconds,
+					seconds > 0 ? (double)image.raw_size / 1024.0 / seconds : 0.0);
+		}
+		else
+		{
+			fprintf(stderr, "[ERRO]: %s: falha (%s)\n", tasks[i].port, tasks[i].error);
+			failures++;
+		}
+	}
+
+	free(deflated);
+	if (verbose)
+	{
+		instr_print_summary(stdout);
+	}
+	return failures == 0 ? 0 : 1;
+}
+
+static int finish(int exit_code, bool show_events)
+{
+	if (exit_code != 0 || show_events)
+	{
+		ring_dump(stderr);
+	}
+	return exit_code;
 }
 
 int main(int argc, char *argv[])
 {
 	bool verbose = false;
+	bool show_events = false;
 	bool mode_read = false;
 	char *port_arg = NULL;
+	char *ports[ESP32_MAX_PORTS];
+	int port_count = 0;
+	const char *dump_path = NULL;
+	const char *flash_path = NULL;
+	int baudrate = BAUDRATE_FAST_DEFAULT;
+	uint32_t flash_size = FLASH_SIZE_DEFAULT;
+	uint32_t flash_offset = FLASH_OFFSET_DEFAULT;
 
 	for (int i = 1; i < argc; i++)
 	{
@@ -24,6 +416,73 @@ int main(int argc, char *argv[])
 		{
 			mode_read = true;
 		}
+		else if (strcmp(argv[i], "-d") == 0)
+		{
+			show_events = true;
+		}
+		else if (strcmp(argv[i], "-f") == 0)
+		{
+			esp32_cache_enable(false);
+		}
+		else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc)
+		{
+			dump_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "--flash") == 0 && i + 1 < argc)
+		{
+			flash_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+		{
+			if (!trace_start(argv[++i]))
+			{
+				fprintf(stderr, "[ERRO]: Não foi possível criar %s.\n", argv[i]);
+				return 1;
+			}
+			atexit(trace_stop);
+		}
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+		{
+			replay_path = argv[++i];
+			esp32_cache_enable(false);
+		}
+		else if (strcmp(argv[i], "--realtime") == 0)
+		{
+			replay_realtime = true;
+		}
+		else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc)
+		{
+			if (!parse_offset(argv[++i], &flash_offset))
+			{
+				fprintf(stderr, "[ERRO]: Endereço inválido.\n");
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+		{
+			if (!parse_baudrate(argv[++i], &baudrate))
+			{
+				fprintf(stderr, "[ERRO]: Baud rate inválido (use 115200, 230400, 460800, 921600, 1500000 ou 2000000).\n");
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+		{
+			if (!parse_size(argv[++i], &flash_size))
+			{
+				fprintf(stderr, "[ERRO]: Tamanho de flash inválido.\n");
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc)
+		{
+			if (!metrics_start(argv[++i], "ttesp32"))
+			{
+				fprintf(stderr, "[ERRO]: Não foi possível criar %s.\n", argv[i]);
+				return 1;
+			}
+			atexit(metrics_stop);
+		}
 		else if (strcmp(argv[i], "-h") == 0)
 		{
 			print_help(argv[0]);
@@ -31,10 +490,32 @@ int main(int argc, char *argv[])
 		}
 		else
 		{
+			if (port_count >= ESP32_MAX_PORTS)
+			{
+				fprintf(stderr, "[ERRO]: Portas demais (máximo %d).\n", ESP32_MAX_PORTS);
+				return 1;
+			}
 			port_arg = argv[i];
+			ports[port_count++] = argv[i];
 		}
 	}
 
+	// Só --flash trabalha com várias placas; nos outros modos uma porta a mais seria ignorada.
+	if (!flash_path && port_count > 1)
+	{
+		fprintf(stderr, "[ERRO]: Informe uma única porta (várias portas só com --flash).\n");
+		return 1;
+	}
+
+	if (flash_path)
+	{
+		return finish(run_flash(ports, port_count, flash_path, flash_offset, flash_size, baudrate, verbose), show_events);
+	}
+	if (dump_path)
+	{
+		return finish(run_dump(port_arg, dump_path, baudrate, flash_size, verbose), show_events);
+	}
+
 	if (!mode_read)
 	{
 		print_help(argv[0]);
@@ -44,7 +525,14 @@ int main(int argc, char *argv[])
 	char mac_str[32];
 	bool success = false;
 
-	if (port_arg)
+	if (replay_path)
+	{
+		esp32_session_t *session = open_synced_session(port_arg);
+		success = session && esp32_session_read_mac(session, mac_str, sizeof(mac_str));
+		esp32_session_close(session);
+		fprintf(stderr, "[INFO]: Replay: %zu divergência(s) em relação à captura.\n", trace_divergences());
+	}
+	else if (port_arg)
 	{
 		if (!esp32_check_port_format(port_arg))
 		{
@@ -74,12 +562,21 @@ int main(int argc, char *argv[])
 			fprintf(stdout, "[INFO]: Dispositivo encontrado.\n");
 		}
 		esp32_print_mac(mac_str);
-		return 0;
+		if (verbose)
+		{
+			instr_print_summary(stdout);
+		}
+		return finish(0, show_events);
 	}
 
 	fprintf(stderr, "[ERRO]: Falha ao ler MAC. Verifique:\n");
 	fprintf(stderr, "        1. Se o dispositivo está conectado.\n");
 	fprintf(stderr, "        2. Permissões da porta (use sudo/admin).\n");
 	fprintf(stderr, "        3. Segure o botão BOOT se for a primeira vez.\n");
-	return 1;
+	fprintf(stderr, "        4. Se a porta não está em uso por outro ttesp32/ttcc.\n");
+	if (verbose)
+	{
+		instr_print_summary(stderr);
+	}
+	return finish(1, show_events);
 }
@@ -0,0 +1,223 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "platform.h"
+#include "eventring.h"
+
+typedef struct
+{
+	_Atomic uint32_t seq;
+	uint16_t device;
+	uint16_t event;
+	int32_t code;
+	uint64_t ticks;
+} RingEntry;
+
+typedef struct
+{
+	atomic_uint head;
+	RingEntry entries[RING_ENTRIES];
+} Ring;
+
+typedef struct
+{
+	uint64_t ticks;
+	int32_t code;
+	uint16_t device;
+	uint16_t event;
+	int slot;
+} RingCopy;
+
+static const char *event_names[RING_EVENT_COUNT] = {
+	"esp32_open",
+	"esp32_sync",
+	"esp32_reset",
+	"esp32_timeout",
+	"esp32_read_reg",
+	"esp32_status",
+	"esp32_baud",
+	"esp32_flash_retry",
+	"ds4_open",
+	"ds4_get_mac",
+	"ds4_fallback",
+	"ds4_set_mac",
+};
+
+// Id de dispositivo = geração << RING_DEVICE_SLOT_BITS | posição; geração 0 nunca é usada (id 0 = sem nome).
+#define RING_DEVICE_SLOT_BITS 6
+#define RING_DEVICE_GENERATIONS (UINT16_MAX >> RING_DEVICE_SLOT_BITS)
+
+_Static_assert(RING_DEVICES_MAX == 1 << RING_DEVICE_SLOT_BITS, "ids de dispositivo do anel");
+
+typedef struct
+{
+	char name[RING_DEVICE_NAME_MAX];
+	uint16_t generation;
+	uint64_t last_use;
+} RingDevice;
+
+static Ring rings[RING_SLOTS];
+static atomic_bool ring_busy[RING_SLOTS];
+static atomic_uint ring_dropped = 0;
+static _Thread_local Ring *local_ring = NULL;
+static pthread_key_t ring_key;
+static pthread_once_t ring_once = PTHREAD_ONCE_INIT;
+
+// Par de referência para converter ticks em ns no dump.
+static uint64_t origin_ticks = 0;
+static uint64_t origin_ns = 0;
+
+static RingDevice devices[RING_DEVICES_MAX];
+static uint64_t device_clock = 0;
+static pthread_mutex_t device_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// O anel de uma thread que terminou volta a ficar livre; o conteúdo continua valendo para o dump.
+static void ring_release(void *value)
+{
+	Ring *ring = value;
+	atomic_store_explicit(&ring_busy[ring - rings], false, memory_order_release);
+}
+
+static void ring_init(void)
+{
+	pthread_key_create(&ring_key, ring_release);
+	origin_ns = platform_monotonic_ns();
+	origin_ticks = platform_ticks();
+}
+
+static Ring *ring_claim(void)
+{
+	for (int slot = 0; slot < RING_SLOTS; slot++)
+	{
+		bool expected = false;
+		if (atomic_compare_exchange_strong_explicit(&ring_busy[slot], &expected, true, memory_order_acquire,
+													memory_order_relaxed))
+			return &rings[slot];
+	}
+	return NULL;
+}
+
+// Chamado só na abertura dos dispositivos. Tabela cheia recicla o nome usado há mais tempo;
+// eventos antigos dele passam a aparecer sem nome, já que a geração mudou.
+uint16_t ring_device(const char *name)
+{
+	if (!name)
+		return 0;
+
+	pthread_mutex_lock(&device_lock);
+	int slot = -1;
+	int oldest = 0;
+	for (int i = 0; i < RING_DEVICES_MAX && slot < 0; i++)
+	{
+		if (devices[i].generation && strcmp(devices[i].name, name) == 0)
+			slot = i;
+		else if (devices[i].last_use < devices[oldest].last_use)
+			oldest = i;
+	}
+	if (slot < 0)
+	{
+		slot = oldest;
+		RingDevice *device = &devices[slot];
+		device->generation = (uint16_t)(device->generation % RING_DEVICE_GENERATIONS + 1);
+		snprintf(device->name, sizeof(device->name), "%s", name);
+	}
+	devices[slot].last_use = ++device_clock;
+	uint16_t id = (uint16_t)(devices[slot].generation << RING_DEVICE_SLOT_BITS | slot);
+	pthread_mutex_unlock(&device_lock);
+	return id;
+}
+
+// Cada thread viva tem um anel só seu; com mais de RING_SLOTS threads ao mesmo tempo, as extras não registram.
+void ring_event(uint16_t device, ring_event_t event, int32_t code)
+{
+	Ring *ring = local_ring;
+	if (!ring)
+	{
+		pthread_once(&ring_once, ring_init);
+		ring = ring_claim();
+		if (!ring)
+		{
+			atomic_fetch_add_explicit(&ring_dropped, 1, memory_order_relaxed);
+			return;
+		}
+		pthread_setspecific(ring_key, ring);
+		local_ring = ring;
+	}
+
+	unsigned index = atomic_fetch_add_explicit(&ring->head, 1, memory_order_relaxed);
+	RingEntry *entry = &ring->entries[index % RING_ENTRIES];
+
+	atomic_store_explicit(&entry->seq, 0, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	entry->device = device;
+	entry->event = (uint16_t)event;
+	entry->code = code;
+	entry->ticks = platform_ticks();
+	atomic_store_explicit(&entry->seq, index + 1, memory_order_release);
+}
+
+static int compare_copy(const void *a, const void *b)
+{
+	const RingCopy *x = a;
+	const RingCopy *y = b;
+	return (x->ticks > y->ticks) - (x->ticks < y->ticks);
+}
+
+// Entradas sobrescritas durante a cópia são descartadas pela conferência do seq.
+static size_t ring_collect(RingCopy *copies)
+{
+	size_t count = 0;
+	for (int slot = 0; slot < RING_SLOTS; slot++)
+	{
+		for (int i = 0; i < RING_ENTRIES; i++)
+		{
+			RingEntry *entry = &rings[slot].entries[i];
+			uint32_t seq = atomic_load_explicit(&entry->seq, memory_order_acquire);
+			if (seq == 0)
+				continue;
+
+			RingCopy copy = {entry->ticks, entry->code, entry->device, entry->event, slot};
+			atomic_thread_fence(memory_order_acquire);
+			if (atomic_load_explicit(&entry->seq, memory_order_relaxed) == seq && copy.event < RING_EVENT_COUNT)
+				copies[count++] = copy;
+		}
+	}
+	qsort(copies, count, sizeof(RingCopy), compare_copy);
+	return count;
+}
+
+size_t ring_dump(FILE *out)
+{
+	if (!out)
+		return 0;
+
+	RingCopy *copies = malloc(sizeof(RingCopy) * RING_SLOTS * RING_ENTRIES);
+	if (!copies)
+		return 0;
+
+	pthread_once(&ring_once, ring_init);
+	size_t count = ring_collect(copies);
+	uint64_t elapsed_ticks = platform_ticks() - origin_ticks;
+	double ns_per_tick = elapsed_ticks ? (double)(platform_monotonic_ns() - origin_ns) / (double)elapsed_ticks : 1.0;
+	fprintf(out, "[TRACE]: %zu evento(s) (ms, thread, dispositivo, evento, código)\n", count);
+	unsigned dropped = atomic_load_explicit(&ring_dropped, memory_order_relaxed);
+	if (dropped)
+		fprintf(out, "[TRACE]: %u evento(s) descartado(s) por falta de anel livre.\n", dropped);
+
+	pthread_mutex_lock(&device_lock);
+	for (size_t i = 0; i < count; i++)
+	{
+		const RingCopy *copy = &copies[i];
+		const RingDevice *slot = &devices[copy->device & (RING_DEVICES_MAX - 1)];
+		uint16_t generation = (uint16_t)(copy->device >> RING_DEVICE_SLOT_BITS);
+		const char *device = generation && slot->generation == generation ? slot->name : "-";
+		fprintf(out, "         %10.3f  t%02d  %-20s %-18s %d\n",
+				(double)(copy->ticks - copies[0].ticks) * ns_per_tick / 1e6, copy->slot, device,
+				event_names[copy->event], (int)copy->code);
+	}
+	pthread_mutex_unlock(&device_lock);
+
+	free(copies);
+	return count;
+}
@@ -0,0 +1,36 @@
+#ifndef EVENTRING_H
+#define EVENTRING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define RING_ENTRIES 256
+#define RING_SLOTS 16
+#define RING_DEVICES_MAX 64
+#define RING_DEVICE_NAME_MAX 64
+
+typedef enum
+{
+	RING_ESP32_OPEN,
+	RING_ESP32_SYNC,
+	RING_ESP32_RESET,
+	RING_ESP32_TIMEOUT,
+	RING_ESP32_READ_REG,
+	RING_ESP32_STATUS,
+	RING_ESP32_BAUD,
+	RING_ESP32_FLASH_RETRY,
+	RING_DS4_OPEN,
+	RING_DS4_GET_MAC,
+	RING_DS4_FALLBACK,
+	RING_DS4_SET_MAC,
+	RING_EVENT_COUNT
+} ring_event_t;
+
+// Sempre ligado: cada thread escreve no seu anel sem travas; o dump junta todos por tempo.
+// O anel volta a ficar livre quando a thread termina.
+uint16_t ring_device(const char *name);
+void ring_event(uint16_t device, ring_event_t event, int32_t code);
+size_t ring_dump(FILE *out);
+
+#endif
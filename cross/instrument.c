@@ -0,0 +1,102 @@
+#include <string.h>
+#include <stdatomic.h>
+#include "instrument.h"
+
+static const char *phase_names[PHASE_COUNT] = {
+	"esp32_open",
+	"esp32_sync_fast",
+	"esp32_reset",
+	"esp32_sync_full",
+	"esp32_efuse",
+	"ds4_usb_init",
+	"ds4_open",
+	"ds4_detach",
+	"ds4_get_mac",
+	"ds4_fallback",
+	"ds4_set_mac",
+};
+
+static instr_entry_t registry[INSTR_MAX_DEVICES];
+static int registry_count = 0;
+static atomic_flag registry_lock = ATOMIC_FLAG_INIT;
+
+static void registry_acquire(void)
+{
+	while (atomic_flag_test_and_set_explicit(&registry_lock, memory_order_acquire))
+	{
+	}
+}
+
+static void registry_release(void)
+{
+	atomic_flag_clear_explicit(&registry_lock, memory_order_release);
+}
+
+bool instr_enabled(void)
+{
+#ifdef TTCC_INSTRUMENT
+	return true;
+#else
+	return false;
+#endif
+}
+
+instr_stats_t *instr_device(const char *name)
+{
+	if (!instr_enabled() || !name)
+		return NULL;
+
+	instr_stats_t *stats = NULL;
+	registry_acquire();
+	for (int i = 0; i < registry_count && !stats; i++)
+	{
+		if (strcmp(registry[i].name, name) == 0)
+			stats = &registry[i].stats;
+	}
+	if (!stats && registry_count < INSTR_MAX_DEVICES)
+	{
+		instr_entry_t *entry = &registry[registry_count++];
+		memset(entry, 0, sizeof(instr_entry_t));
+		snprintf(entry->name, sizeof(entry->name), "%s", name);
+		stats = &entry->stats;
+	}
+	registry_release();
+	return stats;
+}
+
+int instr_snapshot(instr_entry_t *entries_out, int max_entries)
+{
+	if (!entries_out)
+		return 0;
+
+	registry_acquire();
+	int count = registry_count < max_entries ? registry_count : max_entries;
+	memcpy(entries_out, registry, sizeof(instr_entry_t) * (size_t)(count > 0 ? count : 0));
+	registry_release();
+	return count;
+}
+
+void instr_print_summary(FILE *out)
+{
+	static instr_entry_t entries[INSTR_MAX_DEVICES];
+	int count = instr_snapshot(entries, INSTR_MAX_DEVICES);
+
+	for (int i = 0; i < count; i++)
+	{
+		const instr_stats_t *stats = &entries[i].stats;
+		fprintf(out, "[INSTR]: %s\n", entries[i].name);
+		for (int p = 0; p < PHASE_COUNT; p++)
+		{
+			if (stats->phase_calls[p] == 0)
+				continue;
+			fprintf(out, "         %-16s %4ux %10.3f ms\n", phase_names[p],
+					stats->phase_calls[p], (double)stats->phase_ns[p] / 1e6);
+		}
+		fprintf(out, "         sync=%llu retries=%llu timeouts=%llu rx=%lluB tx=%lluB\n",
+				(unsigned long long)stats->counters[COUNTER_SYNC_ATTEMPTS],
+				(unsigned long long)stats->counters[COUNTER_RETRIES],
+				(unsigned long long)stats->counters[COUNTER_TIMEOUTS],
+				(unsigned long long)stats->counters[COUNTER_BYTES_READ],
+				(unsigned long long)stats->counters[COUNTER_BYTES_WRITTEN]);
+	}
+}
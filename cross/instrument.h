@@ -0,0 +1,86 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "platform.h"
+
+#define INSTR_NAME_MAX 64
+#define INSTR_MAX_DEVICES 32
+
+typedef enum
+{
+	PHASE_ESP32_OPEN,
+	PHASE_ESP32_SYNC_FAST,
+	PHASE_ESP32_RESET,
+	PHASE_ESP32_SYNC_FULL,
+	PHASE_ESP32_EFUSE,
+	PHASE_DS4_USB_INIT,
+	PHASE_DS4_OPEN,
+	PHASE_DS4_DETACH,
+	PHASE_DS4_GET_MAC,
+	PHASE_DS4_FALLBACK,
+	PHASE_DS4_SET_MAC,
+	PHASE_COUNT
+} instr_phase_t;
+
+typedef enum
+{
+	COUNTER_SYNC_ATTEMPTS,
+	COUNTER_RETRIES,
+	COUNTER_TIMEOUTS,
+	COUNTER_BYTES_READ,
+	COUNTER_BYTES_WRITTEN,
+	COUNTER_COUNT
+} instr_counter_t;
+
+typedef struct
+{
+	uint64_t phase_ns[PHASE_COUNT];
+	uint32_t phase_calls[PHASE_COUNT];
+	uint64_t counters[COUNTER_COUNT];
+} instr_stats_t;
+
+typedef struct
+{
+	char name[INSTR_NAME_MAX];
+	instr_stats_t stats;
+} instr_entry_t;
+
+bool instr_enabled(void);
+instr_stats_t *instr_device(const char *name);
+int instr_snapshot(instr_entry_t *entries_out, int max_entries);
+void instr_print_summary(FILE *out);
+
+// Com TTCC_INSTRUMENT desligado, as macros não geram código nenhum.
+#ifdef TTCC_INSTRUMENT
+#define INSTR_BEGIN(var) uint64_t var = platform_monotonic_ns()
+#define INSTR_END(stats, phase, var)                                      \
+	do                                                                    \
+	{                                                                     \
+		if (stats)                                                        \
+		{                                                                 \
+			(stats)->phase_ns[phase] += platform_monotonic_ns() - (var);  \
+			(stats)->phase_calls[phase]++;                                \
+		}                                                                 \
+	} while (0)
+#define INSTR_COUNT(stats, counter, n)                   \
+	do                                                   \
+	{                                                    \
+		if (stats)                                       \
+			(stats)->counters[counter] += (uint64_t)(n); \
+	} while (0)
+#else
+#define INSTR_BEGIN(var)
+#define INSTR_END(stats, phase, var) \
+	do                               \
+	{                                \
+	} while (0)
+#define INSTR_COUNT(stats, counter, n) \
+	do                                 \
+	{                                  \
+	} while (0)
+#endif
+
+#endif
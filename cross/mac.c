@@ -0,0 +1,105 @@
+#include <string.h>
+#include "mac.h"
+
+// Valor do dígito + 1; zero marca caractere inválido.
+static const uint8_t hex_value[256] = {
+	['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+	['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+	['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+	['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16};
+
+static const char hex_digit[16] = {'0', '1', '2', '3', '4', '5', '6', '7',
+								   '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
+
+// Aceita só "AA:BB:CC:DD:EE:FF", "AA-BB-CC-DD-EE-FF" ou "AABBCCDDEEFF", com o mesmo separador em todo o texto.
+bool mac_parse_n(const char *text, size_t len, uint8_t mac_out[MAC_LEN])
+{
+	if (!text || !mac_out)
+		return false;
+
+	size_t stride;
+	char separator = '\0';
+	if (len == MAC_LEN * 2)
+	{
+		stride = 2;
+	}
+	else if (len == MAC_STRING_LEN - 1 && (text[2] == ':' || text[2] == '-'))
+	{
+		stride = 3;
+		separator = text[2];
+	}
+	else
+	{
+		return false;
+	}
+
+	uint8_t mac[MAC_LEN];
+	unsigned invalid = 0;
+	for (size_t i = 0; i < MAC_LEN; i++)
+	{
+		const char *pair = text + i * stride;
+		unsigned high = hex_value[(uint8_t)pair[0]];
+		unsigned low = hex_value[(uint8_t)pair[1]];
+		invalid |= (high == 0) | (low == 0);
+		if (separator && i < MAC_LEN - 1)
+			invalid |= pair[2] != separator;
+		mac[i] = (uint8_t)(((high - 1) << 4) | ((low - 1) & 0xF));
+	}
+
+	if (invalid)
+		return false;
+	memcpy(mac_out, mac, MAC_LEN);
+	return true;
+}
+
+bool mac_parse(const char *text, uint8_t mac_out[MAC_LEN])
+{
+	if (!text)
+		return false;
+
+	size_t len = 0;
+	while (len < MAC_STRING_LEN && text[len])
+		len++;
+	return mac_parse_n(text, len, mac_out);
+}
+
+// Separador '\0' gera a forma compacta de 12 dígitos.
+void mac_format(const uint8_t mac[MAC_LEN], char separator, char text_out[MAC_STRING_LEN])
+{
+	if (!mac || !text_out)
+		return;
+
+	char *out = text_out;
+	for (size_t i = 0; i < MAC_LEN; i++)
+	{
+		if (separator && i > 0)
+			*out++ = separator;
+		*out++ = hex_digit[mac[i] >> 4];
+		*out++ = hex_digit[mac[i] & 0xF];
+	}
+	*out = '\0';
+}
+
+// Retorna quantas entradas foram convertidas antes da primeira inválida (count se todas forem válidas).
+size_t mac_parse_array(const char *const *texts, size_t count, uint8_t *macs_out)
+{
+	if (!texts || !macs_out)
+		return 0;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (!mac_parse(texts[i], macs_out + i * MAC_LEN))
+			return i;
+	}
+	return count;
+}
+
+// Cada texto ocupa MAC_STRING_LEN bytes em texts_out, terminado em '\0'.
+void mac_format_array(const uint8_t *macs, size_t count, char separator, char *texts_out)
+{
+	if (!macs || !texts_out)
+		return;
+
+	for (size_t i = 0; i < count; i++)
+		mac_format(macs + i * MAC_LEN, separator, texts_out + i * MAC_STRING_LEN);
+}
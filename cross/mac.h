@@ -0,0 +1,18 @@
+#ifndef MAC_H
+#define MAC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAC_LEN 6
+#define MAC_STRING_LEN 18
+
+bool mac_parse(const char *text, uint8_t mac_out[MAC_LEN]);
+bool mac_parse_n(const char *text, size_t len, uint8_t mac_out[MAC_LEN]);
+void mac_format(const uint8_t mac[MAC_LEN], char separator, char text_out[MAC_STRING_LEN]);
+
+size_t mac_parse_array(const char *const *texts, size_t count, uint8_t *macs_out);
+void mac_format_array(const uint8_t *macs, size_t count, char separator, char *texts_out);
+
+#endif
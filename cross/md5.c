@@ -0,0 +1,146 @@
+#include <string.h>
+#include "md5.h"
+
+// RFC 1321.
+static const uint32_t md5_k[64] = {
+	0xD76AA478, 0xE8C7B756, 0x242070DB, 0xC1BDCEEE, 0xF57C0FAF, 0x4787C62A, 0xA8304613, 0xFD469501,
+	0x698098D8, 0x8B44F7AF, 0xFFFF5BB1, 0x895CD7BE, 0x6B901122, 0xFD987193, 0xA679438E, 0x49B40821,
+	0xF61E2562, 0xC040B340, 0x265E5A51, 0xE9B6C7AA, 0xD62F105D, 0x02441453, 0xD8A1E681, 0xE7D3FBC8,
+	0x21E1CDE6, 0xC33707D6, 0xF4D50D87, 0x455A14ED, 0xA9E3E905, 0xFCEFA3F8, 0x676F02D9, 0x8D2A4C8A,
+	0xFFFA3942, 0x8771F681, 0x6D9D6122, 0xFDE5380C, 0xA4BEEA44, 0x4BDECFA9, 0xF6BB4B60, 0xBEBFBC70,
+	0x289B7EC6, 0xEAA127FA, 0xD4EF3085, 0x04881D05, 0xD9D4D039, 0xE6DB99E5, 0x1FA27CF8, 0xC4AC5665,
+	0xF4292244, 0x432AFF97, 0xAB9423A7, 0xFC93A039, 0x655B59C3, 0x8F0CCC92, 0xFFEFF47D, 0x85845DD1,
+	0x6FA87E4F, 0xFE2CE6E0, 0xA3014314, 0x4E0811A1, 0xF7537E82, 0xBD3AF235, 0x2AD7D2BB, 0xEB86D391};
+
+static const uint8_t md5_r[64] = {
+	7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+	5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+	4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+	6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21};
+
+static inline uint32_t rotl32(uint32_t x, uint8_t n)
+{
+	return (x << n) | (x >> (32 - n));
+}
+
+static void md5_transform(uint32_t state[4], const uint8_t block[64])
+{
+	uint32_t m[16];
+	for (int i = 0; i < 16; i++)
+	{
+		m[i] = (uint32_t)block[i * 4] | ((uint32_t)block[i * 4 + 1] << 8) |
+			   ((uint32_t)block[i * 4 + 2] << 16) | ((uint32_t)block[i * 4 + 3] << 24);
+	}
+
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+	for (int i = 0; i < 64; i++)
+	{
+		uint32_t f;
+		int g;
+		if (i < 16)
+		{
+			f = (b & c) | (~b & d);
+			g = i;
+		}
+		else if (i < 32)
+		{
+			f = (d & b) | (~d & c);
+			g = (5 * i + 1) % 16;
+		}
+		else if (i < 48)
+		{
+			f = b ^ c ^ d;
+			g = (3 * i + 5) % 16;
+		}
+		else
+		{
+			f = c ^ (b | ~d);
+			g = (7 * i) % 16;
+		}
+		uint32_t temp = d;
+		d = c;
+		c = b;
+		b = b + rotl32(a + f + md5_k[i] + m[g], md5_r[i]);
+		a = temp;
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+}
+
+void md5_init(md5_context_t *ctx)
+{
+	ctx->state[0] = 0x67452301;
+	ctx->state[1] = 0xEFCDAB89;
+	ctx->state[2] = 0x98BADCFE;
+	ctx->state[3] = 0x10325476;
+	ctx->length = 0;
+	ctx->used = 0;
+}
+
+void md5_update(md5_context_t *ctx, const void *data, size_t len)
+{
+	const uint8_t *bytes = data;
+	ctx->length += len;
+
+	if (ctx->used > 0)
+	{
+		size_t take = sizeof(ctx->block) - ctx->used;
+		if (take > len)
+			take = len;
+		memcpy(ctx->block + ctx->used, bytes, take);
+		ctx->used += take;
+		bytes += take;
+		len -= take;
+		if (ctx->used < sizeof(ctx->block))
+			return;
+		md5_transform(ctx->state, ctx->block);
+		ctx->used = 0;
+	}
+	for (; len >= sizeof(ctx->block); len -= sizeof(ctx->block), bytes += sizeof(ctx->block))
+	{
+		md5_transform(ctx->state, bytes);
+	}
+	memcpy(ctx->block, bytes, len);
+	ctx->used = len;
+}
+
+void md5_final(md5_context_t *ctx, uint8_t digest[MD5_DIGEST_LEN])
+{
+	uint64_t bits = ctx->length * 8;
+	uint8_t pad = 0x80;
+	uint8_t zero = 0x00;
+	uint8_t length_le[8];
+
+	md5_update(ctx, &pad, 1);
+	while (ctx->used != 56)
+	{
+		md5_update(ctx, &zero, 1);
+	}
+	for (int i = 0; i < 8; i++)
+	{
+		length_le[i] = (uint8_t)(bits >> (8 * i));
+	}
+	md5_update(ctx, length_le, sizeof(length_le));
+
+	for (int i = 0; i < 4; i++)
+	{
+		digest[i * 4] = (uint8_t)(ctx->state[i] & 0xFF);
+		digest[i * 4 + 1] = (uint8_t)((ctx->state[i] >> 8) & 0xFF);
+		digest[i * 4 + 2] = (uint8_t)((ctx->state[i] >> 16) & 0xFF);
+		digest[i * 4 + 3] = (uint8_t)((ctx->state[i] >> 24) & 0xFF);
+	}
+}
+
+void md5_to_hex(const uint8_t digest[MD5_DIGEST_LEN], char hex_out[MD5_HEX_LEN])
+{
+	static const char digits[] = "0123456789abcdef";
+	for (int i = 0; i < MD5_DIGEST_LEN; i++)
+	{
+		hex_out[i * 2] = digits[digest[i] >> 4];
+		hex_out[i * 2 + 1] = digits[digest[i] & 0x0F];
+	}
+	hex_out[MD5_HEX_LEN - 1] = '\0';
+}
@@ -0,0 +1,23 @@
+#ifndef MD5_H
+#define MD5_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MD5_DIGEST_LEN 16
+#define MD5_HEX_LEN 33
+
+typedef struct
+{
+	uint32_t state[4];
+	uint64_t length;
+	uint8_t block[64];
+	size_t used;
+} md5_context_t;
+
+void md5_init(md5_context_t *ctx);
+void md5_update(md5_context_t *ctx, const void *data, size_t len);
+void md5_final(md5_context_t *ctx, uint8_t digest[MD5_DIGEST_LEN]);
+void md5_to_hex(const uint8_t digest[MD5_DIGEST_LEN], char hex_out[MD5_HEX_LEN]);
+
+#endif
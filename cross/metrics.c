@@ -0,0 +1,287 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "platform.h"
+#include "metrics.h"
+
+#define METRICS_PATH_MAX 1024
+#define METRICS_LE_FIRST 7
+#define METRICS_LE_LAST 27
+
+typedef struct
+{
+	_Atomic uint64_t buckets[METRICS_BUCKETS];
+	_Atomic uint64_t sum_ns;
+} Histogram;
+
+struct metrics_series
+{
+	char device[METRICS_NAME_MAX];
+	Histogram histograms[METRIC_HISTOGRAM_COUNT];
+	_Atomic uint64_t counters[METRIC_COUNTER_COUNT];
+};
+
+typedef struct
+{
+	const char *name;
+	const char *help;
+} MetricInfo;
+
+static const MetricInfo histogram_info[METRIC_HISTOGRAM_COUNT] = {
+	{"ttcc_esp32_probe_seconds", "Da abertura da porta ao MAC do ESP32 lido."},
+	{"ttcc_ds4_read_seconds", "Leitura do MAC pareado no DS4."},
+	{"ttcc_ds4_write_seconds", "Gravação do MAC no DS4."},
+	{"ttcc_pair_cycle_seconds", "Ciclo de pareamento completo, da descoberta ao registro."},
+};
+
+static const MetricInfo counter_info[METRIC_COUNTER_COUNT] = {
+	{"ttcc_retries_total", "Comandos reenviados."},
+	{"ttcc_resets_total", "Resets do ESP32 para entrar no bootloader."},
+	{"ttcc_timeouts_total", "Leituras sem resposta dentro do prazo."},
+	{"ttcc_failures_total", "Operações de dispositivo que falharam."},
+	{"ttcc_pair_failures_total", "Ciclos de pareamento que falharam."},
+};
+
+// Séries só são acrescentadas; quem lê percorre até series_count sem trava.
+static metrics_series_t series_table[METRICS_SERIES_MAX];
+static atomic_int series_count = 0;
+static atomic_flag series_lock = ATOMIC_FLAG_INIT;
+
+static atomic_bool enabled = false;
+static char output_path[METRICS_PATH_MAX];
+static char program_name[METRICS_NAME_MAX];
+
+static pthread_mutex_t flusher_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t flusher_wake = PTHREAD_COND_INITIALIZER;
+static pthread_t flusher_thread;
+static bool flusher_running = false;
+
+static void series_acquire(void)
+{
+	while (atomic_flag_test_and_set_explicit(&series_lock, memory_order_acquire))
+	{
+	}
+}
+
+static void series_release(void)
+{
+	atomic_flag_clear_explicit(&series_lock, memory_order_release);
+}
+
+// Log-linear como no HDR: 8 sub-buckets por oitava de µs, erro relativo de até 12,5%.
+static int bucket_index(uint64_t us)
+{
+	if (us > UINT32_MAX)
+		us = UINT32_MAX;
+	if (us < METRICS_SUB_BUCKETS)
+		return (int)us;
+
+	int shift = 63 - __builtin_clzll(us) - METRICS_SUB_BITS;
+	return (shift + 1) * METRICS_SUB_BUCKETS + (int)((us >> shift) - METRICS_SUB_BUCKETS);
+}
+
+static metrics_series_t *series_find(const char *device, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		if (strcmp(series_table[i].device, device) == 0)
+			return &series_table[i];
+	}
+	return NULL;
+}
+
+metrics_series_t *metrics_series(const char *device)
+{
+	if (!device || !atomic_load_explicit(&enabled, memory_order_relaxed))
+		return NULL;
+
+	metrics_series_t *series = series_find(device, atomic_load_explicit(&series_count, memory_order_acquire));
+	if (series)
+		return series;
+
+	series_acquire();
+	int count = atomic_load_explicit(&series_count, memory_order_relaxed);
+	series = series_find(device, count);
+	if (!series && count < METRICS_SERIES_MAX)
+	{
+		series = &series_table[count];
+		snprintf(series->device, sizeof(series->device), "%s", device);
+		atomic_store_explicit(&series_count, count + 1, memory_order_release);
+	}
+	series_release();
+	return series;
+}
+
+void metrics_observe(metrics_series_t *series, metric_histogram_t histogram, uint64_t ns)
+{
+	if (!series)
+		return;
+
+	Histogram *hist = &series->histograms[histogram];
+	atomic_fetch_add_explicit(&hist->buckets[bucket_index(ns / 1000)], 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&hist->sum_ns, ns, memory_order_relaxed);
+}
+
+void metrics_count(metrics_series_t *series, metric_counter_t counter, uint64_t n)
+{
+	if (series && n)
+		atomic_fetch_add_explicit(&series->counters[counter], n, memory_order_relaxed);
+}
+
+static void write_label(FILE *out, const char *value)
+{
+	for (const char *c = value; *c; c++)
+	{
+		if (*c == '\\' || *c == '"')
+			fputc('\\', out);
+		if (*c == '\n')
+			fputs("\\n", out);
+		else
+			fputc(*c, out);
+	}
+}
+
+static void write_labels(FILE *out, const metrics_series_t *series)
+{
+	fputs("{program=\"", out);
+	write_label(out, program_name);
+	fputs("\",device=\"", out);
+	write_label(out, series->device);
+	fputc('"', out);
+}
+
+// Os limites exportados são as oitavas de 128 µs a ~134 s, sempre os mesmos para o Prometheus.
+// Cada limite 2^le inclui o bucket que começa nele, para que uma amostra de exatamente 2^le µs
+// conte em le (o resto desse bucket entra junto, dentro do erro de 12,5%).
+static void write_histogram(FILE *out, const metrics_series_t *series, metric_histogram_t histogram)
+{
+	const Histogram *hist = &series->histograms[histogram];
+	const char *name = histogram_info[histogram].name;
+	uint64_t cumulative = 0;
+	int bucket = 0;
+
+	for (int le = METRICS_LE_FIRST; le <= METRICS_LE_LAST; le++)
+	{
+		int end = (le - METRICS_SUB_BITS + 1) * METRICS_SUB_BUCKETS + 1;
+		for (; bucket < end; bucket++)
+			cumulative += atomic_load_explicit(&hist->buckets[bucket], memory_order_relaxed);
+
+		fprintf(out, "%s_bucket", name);
+		write_labels(out, series);
+		fprintf(out, ",le=\"%.6f\"} %llu\n", (double)(1ull << le) / 1e6, (unsigned long long)cumulative);
+	}
+	for (; bucket < METRICS_BUCKETS; bucket++)
+		cumulative += atomic_load_explicit(&hist->buckets[bucket], memory_order_relaxed);
+
+	fprintf(out, "%s_bucket", name);
+	write_labels(out, series);
+	fprintf(out, ",le=\"+Inf\"} %llu\n", (unsigned long long)cumulative);
+
+	fprintf(out, "%s_sum", name);
+	write_labels(out, series);
+	fprintf(out, "} %.6f\n", (double)atomic_load_explicit(&hist->sum_ns, memory_order_relaxed) / 1e9);
+
+	fprintf(out, "%s_count", name);
+	write_labels(out, series);
+	fprintf(out, "} %llu\n", (unsigned long long)cumulative);
+}
+
+// O arquivo é trocado inteiro: o coletor nunca lê uma escrita pela metade.
+static bool metrics_flush(void)
+{
+	char tmp_path[METRICS_PATH_MAX + 8];
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", output_path);
+
+	FILE *out = fopen(tmp_path, "w");
+	if (!out)
+		return false;
+
+	int count = atomic_load_explicit(&series_count, memory_order_acquire);
+	for (int h = 0; h < METRIC_HISTOGRAM_COUNT; h++)
+	{
+		fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n", histogram_info[h].name, histogram_info[h].help,
+				histogram_info[h].name);
+		for (int i = 0; i < count; i++)
+			write_histogram(out, &series_table[i], (metric_histogram_t)h);
+	}
+	for (int c = 0; c < METRIC_COUNTER_COUNT; c++)
+	{
+		fprintf(out, "# HELP %s %s\n# TYPE %s counter\n", counter_info[c].name, counter_info[c].help,
+				counter_info[c].name);
+		for (int i = 0; i < count; i++)
+		{
+			fputs(counter_info[c].name, out);
+			write_labels(out, &series_table[i]);
+			fprintf(out, "} %llu\n",
+					(unsigned long long)atomic_load_explicit(&series_table[i].counters[c], memory_order_relaxed));
+		}
+	}
+
+	if (fclose(out) != 0 || !platform_replace_file(tmp_path, output_path))
+	{
+		remove(tmp_path);
+		return false;
+	}
+	return true;
+}
+
+static void *flusher_worker(void *arg)
+{
+	(void)arg;
+
+	pthread_mutex_lock(&flusher_lock);
+	while (flusher_running)
+	{
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += (long)(METRICS_FLUSH_MS % 1000) * 1000000L;
+		deadline.tv_sec += METRICS_FLUSH_MS / 1000 + deadline.tv_nsec / 1000000000L;
+		deadline.tv_nsec %= 1000000000L;
+		pthread_cond_timedwait(&flusher_wake, &flusher_lock, &deadline);
+		if (!flusher_running)
+			break;
+
+		pthread_mutex_unlock(&flusher_lock);
+		metrics_flush();
+		pthread_mutex_lock(&flusher_lock);
+	}
+	pthread_mutex_unlock(&flusher_lock);
+	return NULL;
+}
+
+bool metrics_start(const char *path, const char *program)
+{
+	if (!path || !*path || strlen(path) >= sizeof(output_path) || flusher_running)
+		return false;
+
+	snprintf(output_path, sizeof(output_path), "%s", path);
+	snprintf(program_name, sizeof(program_name), "%s", program ? program : "ttcc");
+	if (!metrics_flush())
+		return false;
+
+	flusher_running = true;
+	if (pthread_create(&flusher_thread, NULL, flusher_worker, NULL) != 0)
+	{
+		flusher_running = false;
+		return false;
+	}
+	atomic_store_explicit(&enabled, true, memory_order_relaxed);
+	return true;
+}
+
+void metrics_stop(void)
+{
+	if (!flusher_running)
+		return;
+
+	pthread_mutex_lock(&flusher_lock);
+	flusher_running = false;
+	pthread_cond_signal(&flusher_wake);
+	pthread_mutex_unlock(&flusher_lock);
+	pthread_join(flusher_thread, NULL);
+
+	metrics_flush();
+	atomic_store_explicit(&enabled, false, memory_order_relaxed);
+}
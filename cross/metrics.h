@@ -0,0 +1,43 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define METRICS_SERIES_MAX 32
+#define METRICS_NAME_MAX 64
+#define METRICS_SUB_BITS 3
+#define METRICS_SUB_BUCKETS (1 << METRICS_SUB_BITS)
+#define METRICS_BUCKETS ((32 - METRICS_SUB_BITS + 1) * METRICS_SUB_BUCKETS)
+#define METRICS_FLUSH_MS 10000
+
+typedef enum
+{
+	METRIC_ESP32_PROBE,
+	METRIC_DS4_READ,
+	METRIC_DS4_WRITE,
+	METRIC_PAIR_CYCLE,
+	METRIC_HISTOGRAM_COUNT
+} metric_histogram_t;
+
+typedef enum
+{
+	METRIC_RETRIES,
+	METRIC_RESETS,
+	METRIC_TIMEOUTS,
+	METRIC_FAILURES,
+	METRIC_PAIR_FAILURES,
+	METRIC_COUNTER_COUNT
+} metric_counter_t;
+
+typedef struct metrics_series metrics_series_t;
+
+// Desligado até metrics_start: as séries voltam NULL e o registro não custa nada.
+bool metrics_start(const char *path, const char *program);
+void metrics_stop(void);
+
+metrics_series_t *metrics_series(const char *device);
+void metrics_observe(metrics_series_t *series, metric_histogram_t histogram, uint64_t ns);
+void metrics_count(metrics_series_t *series, metric_counter_t counter, uint64_t n);
+
+#endif
@@ -0,0 +1,448 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "platform.h"
+
+#ifdef PLATFORM_WINDOWS
+#include <windows.h>
+#include <process.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define LOCK_PREFIX "ttcc-"
+#define LOCK_SUFFIX ".lock"
+#define LOCK_PATH_MAX 256
+#define CACHE_DIR_NAME "ttcc"
+#define STATE_DIR_ENV "TTCC_STATE_DIR"
+#define STATE_DIR_DEFAULT "/var/tmp/ttcc"
+
+#ifdef PLATFORM_WINDOWS
+#define PATH_SEPARATOR '\\'
+#else
+#define PATH_SEPARATOR '/'
+#endif
+
+struct platform_lock
+{
+#ifdef PLATFORM_WINDOWS
+	HANDLE handle;
+#else
+	int fd;
+#endif
+};
+
+struct platform_map
+{
+#ifdef PLATFORM_WINDOWS
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int fd;
+#endif
+	void *data;
+	size_t size;
+};
+
+void platform_sleep_ms(int ms)
+{
+#ifdef PLATFORM_WINDOWS
+	Sleep((DWORD)ms);
+#else
+	struct timespec ts;
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000;
+	nanosleep(&ts, NULL);
+#endif
+}
+
+uint64_t platform_monotonic_ns(void)
+{
+#ifdef PLATFORM_WINDOWS
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+	if (freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (uint64_t)(now.QuadPart / freq.QuadPart) * 1000000000u +
+		   (uint64_t)(now.QuadPart % freq.QuadPart) * 1000000000u / (uint64_t)freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+uint64_t platform_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#elif defined(__aarch64__)
+	uint64_t ticks;
+	__asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+	return ticks;
+#else
+	return platform_monotonic_ns();
+#endif
+}
+
+int platform_process_id(void)
+{
+#ifdef PLATFORM_WINDOWS
+	return _getpid();
+#else
+	return (int)getpid();
+#endif
+}
+
+bool platform_process_alive(int pid)
+{
+	if (pid <= 0)
+		return false;
+#ifdef PLATFORM_WINDOWS
+	HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, (DWORD)pid);
+	if (!process)
+		return GetLastError() == ERROR_ACCESS_DENIED;
+	bool alive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+	CloseHandle(process);
+	return alive;
+#else
+	return kill((pid_t)pid, 0) == 0 || errno == EPERM;
+#endif
+}
+
+uint64_t platform_uptime_ms(void)
+{
+#ifdef PLATFORM_WINDOWS
+	return (uint64_t)GetTickCount64();
+#else
+	struct timespec ts;
+#ifdef PLATFORM_LINUX
+	clock_gettime(CLOCK_BOOTTIME, &ts);
+#else
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+	return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+#endif
+}
+
+static bool make_dir(const char *path)
+{
+#ifdef PLATFORM_WINDOWS
+	return CreateDirectoryA(path, NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+	return mkdir(path, 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+bool platform_cache_path(const char *file_name, char *path_out, size_t size)
+{
+	char base[LOCK_PATH_MAX];
+	char dir[LOCK_PATH_MAX];
+	int len;
+#ifdef PLATFORM_WINDOWS
+	const char *local = getenv("LOCALAPPDATA");
+	if (!local || !*local)
+		return false;
+	len = snprintf(base, sizeof(base), "%s", local);
+#else
+	const char *xdg = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+	if (xdg && *xdg)
+		len = snprintf(base, sizeof(base), "%s", xdg);
+	else if (home && *home)
+		len = snprintf(base, sizeof(base), "%s/.cache", home);
+	else
+		return false;
+#endif
+	if (len < 0 || (size_t)len >= sizeof(base) || !make_dir(base))
+		return false;
+
+	len = snprintf(dir, sizeof(dir), "%s%c" CACHE_DIR_NAME, base, PATH_SEPARATOR);
+	if (len < 0 || (size_t)len >= sizeof(dir) || !make_dir(dir))
+		return false;
+
+	len = snprintf(path_out, size, "%s%c%s", dir, PATH_SEPARATOR, file_name);
+	return len > 0 && (size_t)len < size;
+}
+
+// Diretório compartilhado: qualquer usuário da estação cria arquivos nele (sticky, como /tmp).
+static bool make_shared_dir(const char *path)
+{
+#ifdef PLATFORM_WINDOWS
+	return make_dir(path);
+#else
+	if (mkdir(path, 01777) == 0)
+		return chmod(path, 01777) == 0;
+	return errno == EEXIST;
+#endif
+}
+
+bool platform_state_path(const char *file_name, char *path_out, size_t size)
+{
+	char dir[LOCK_PATH_MAX];
+	int len;
+	const char *custom = getenv(STATE_DIR_ENV);
+	if (custom && *custom)
+	{
+		len = snprintf(dir, sizeof(dir), "%s", custom);
+	}
+	else
+	{
+#ifdef PLATFORM_WINDOWS
+		const char *data = getenv("PROGRAMDATA");
+		if (!data || !*data)
+			return false;
+		len = snprintf(dir, sizeof(dir), "%s%c" CACHE_DIR_NAME, data, PATH_SEPARATOR);
+#else
+		len = snprintf(dir, sizeof(dir), "%s", STATE_DIR_DEFAULT);
+#endif
+	}
+	if (len < 0 || (size_t)len >= sizeof(dir) || !make_shared_dir(dir))
+		return false;
+
+	len = snprintf(path_out, size, "%s%c%s", dir, PATH_SEPARATOR, file_name);
+	return len > 0 && (size_t)len < size;
+}
+
+bool platform_replace_file(const char *from, const char *to)
+{
+#ifdef PLATFORM_WINDOWS
+	return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return rename(from, to) == 0;
+#endif
+}
+
+static bool lock_build_path(const char *key, char *path, size_t size)
+{
+#ifdef PLATFORM_WINDOWS
+	char dir[MAX_PATH];
+	DWORD len = GetTempPathA((DWORD)sizeof(dir), dir);
+	if (len == 0 || len >= sizeof(dir))
+		return false;
+#else
+	const char *dir = "/tmp/";
+#endif
+	int len_path = snprintf(path, size, "%s" LOCK_PREFIX, dir);
+	if (len_path < 0 || (size_t)len_path >= size)
+		return false;
+
+	size_t pos = (size_t)len_path;
+	for (const char *c = key; *c && pos + sizeof(LOCK_SUFFIX) < size; c++)
+	{
+		path[pos++] = isalnum((unsigned char)*c) ? *c : '_';
+	}
+	snprintf(path + pos, size - pos, "%s", LOCK_SUFFIX);
+	return true;
+}
+
+bool platform_lock_try(const char *key, platform_lock_t **lock_out)
+{
+	char path[LOCK_PATH_MAX];
+	*lock_out = NULL;
+	if (!key || !lock_build_path(key, path, sizeof(path)))
+		return true;
+
+#ifdef PLATFORM_WINDOWS
+	HANDLE handle = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_ALWAYS,
+								FILE_ATTRIBUTE_NORMAL | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+	if (handle == INVALID_HANDLE_VALUE)
+	{
+		return GetLastError() != ERROR_SHARING_VIOLATION;
+	}
+#else
+	int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+	if (fd < 0)
+	{
+		fd = open(path, O_RDONLY | O_CLOEXEC);
+	}
+	if (fd < 0)
+	{
+		return true;
+	}
+	if (flock(fd, LOCK_EX | LOCK_NB) != 0)
+	{
+		bool busy = (errno == EWOULDBLOCK);
+		close(fd);
+		return !busy;
+	}
+#endif
+
+	platform_lock_t *lock = malloc(sizeof(platform_lock_t));
+	if (!lock)
+	{
+#ifdef PLATFORM_WINDOWS
+		CloseHandle(handle);
+#else
+		close(fd);
+#endif
+		return true;
+	}
+#ifdef PLATFORM_WINDOWS
+	lock->handle = handle;
+#else
+	lock->fd = fd;
+#endif
+	*lock_out = lock;
+	return true;
+}
+
+void platform_lock_release(platform_lock_t *lock)
+{
+	if (!lock)
+		return;
+#ifdef PLATFORM_WINDOWS
+	CloseHandle(lock->handle);
+#else
+	flock(lock->fd, LOCK_UN);
+	close(lock->fd);
+#endif
+	free(lock);
+}
+
+#ifdef PLATFORM_WINDOWS
+static bool map_view(platform_map_t *map, size_t size)
+{
+	LARGE_INTEGER current;
+	if (!GetFileSizeEx(map->file, &current))
+		return false;
+	if ((uint64_t)current.QuadPart > size)
+		size = (size_t)current.QuadPart;
+
+	map->mapping = CreateFileMappingA(map->file, NULL, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32),
+									  (DWORD)(size & 0xFFFFFFFFu), NULL);
+	if (!map->mapping)
+		return false;
+	map->data = MapViewOfFile(map->mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+	if (!map->data)
+	{
+		CloseHandle(map->mapping);
+		return false;
+	}
+	map->size = size;
+	return true;
+}
+
+static void map_unview(platform_map_t *map)
+{
+	UnmapViewOfFile(map->data);
+	CloseHandle(map->mapping);
+	map->data = NULL;
+}
+#else
+static bool map_view(platform_map_t *map, size_t size)
+{
+	struct stat st;
+	if (fstat(map->fd, &st) != 0)
+		return false;
+	if ((uint64_t)st.st_size > size)
+		size = (size_t)st.st_size;
+	else if ((uint64_t)st.st_size < size && ftruncate(map->fd, (off_t)size) != 0)
+		return false;
+
+	void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, map->fd, 0);
+	if (data == MAP_FAILED)
+		return false;
+	map->data = data;
+	map->size = size;
+	return true;
+}
+
+static void map_unview(platform_map_t *map)
+{
+	munmap(map->data, map->size);
+	map->data = NULL;
+}
+#endif
+
+// O arquivo cresce até min_size (com zeros) se for menor; nunca é encolhido.
+platform_map_t *platform_map_open(const char *path, size_t min_size)
+{
+	platform_map_t *map = calloc(1, sizeof(platform_map_t));
+	if (!map || !path || min_size == 0)
+	{
+		free(map);
+		return NULL;
+	}
+
+#ifdef PLATFORM_WINDOWS
+	map->file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+							OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (map->file == INVALID_HANDLE_VALUE)
+	{
+		free(map);
+		return NULL;
+	}
+	if (!map_view(map, min_size))
+	{
+		CloseHandle(map->file);
+		free(map);
+		return NULL;
+	}
+#else
+	// Quem cria deixa o arquivo gravável por todos: root (sudo ttds4) e o usuário do ttcc mapeiam o mesmo.
+	map->fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+	if (map->fd >= 0)
+		fchmod(map->fd, 0666);
+	else if (errno == EEXIST)
+		map->fd = open(path, O_RDWR | O_CLOEXEC);
+	if (map->fd < 0)
+	{
+		free(map);
+		return NULL;
+	}
+	if (!map_view(map, min_size))
+	{
+		close(map->fd);
+		free(map);
+		return NULL;
+	}
+#endif
+	return map;
+}
+
+// Também absorve o crescimento feito por outro processo no mesmo arquivo.
+bool platform_map_grow(platform_map_t *map, size_t min_size)
+{
+	if (!map)
+		return false;
+	map_unview(map);
+	return map_view(map, min_size);
+}
+
+void *platform_map_data(const platform_map_t *map)
+{
+	return map ? map->data : NULL;
+}
+
+size_t platform_map_size(const platform_map_t *map)
+{
+	return map ? map->size : 0;
+}
+
+void platform_map_close(platform_map_t *map)
+{
+	if (!map)
+		return;
+	if (map->data)
+		map_unview(map);
+#ifdef PLATFORM_WINDOWS
+	CloseHandle(map->file);
+#else
+	close(map->fd);
+#endif
+	free(map);
+}
@@ -2,6 +2,8 @@
 #define PLATFORM_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #if defined(_WIN32) || defined(__CYGWIN__)
 #define PLATFORM_WINDOWS
@@ -55,4 +57,36 @@
 #define IS_BSD false
 #endif
 
+typedef struct platform_lock platform_lock_t;
+typedef struct platform_map platform_map_t;
+
+void platform_sleep_ms(int ms);
+uint64_t platform_monotonic_ns(void);
+// Contador barato (TSC/CNTVCT) para carimbar eventos; a escala em ns é calibrada por quem usa.
+uint64_t platform_ticks(void);
+int platform_process_id(void);
+// Processo ainda existe (mesmo que de outro usuário).
+bool platform_process_alive(int pid);
+// Tempo desde o boot, contando suspensão onde o sistema permite.
+uint64_t platform_uptime_ms(void);
+
+// Caminho de um arquivo no diretório de cache do usuário (cria o diretório se preciso).
+bool platform_cache_path(const char *file_name, char *path_out, size_t size);
+// Caminho de um arquivo de estado da estação, o mesmo para todos os usuários (sudo inclusive).
+// TTCC_STATE_DIR troca o diretório; o padrão é /var/tmp/ttcc (%PROGRAMDATA%\ttcc no Windows).
+bool platform_state_path(const char *file_name, char *path_out, size_t size);
+bool platform_replace_file(const char *from, const char *to);
+
+// Trava consultiva entre processos. Retorna false só se outro processo já detém a trava;
+// se o arquivo de trava não puder ser criado, segue sem trava (*lock_out == NULL).
+bool platform_lock_try(const char *key, platform_lock_t **lock_out);
+void platform_lock_release(platform_lock_t *lock);
+
+// Arquivo mapeado em memória (leitura e escrita, compartilhado entre processos).
+platform_map_t *platform_map_open(const char *path, size_t min_size);
+bool platform_map_grow(platform_map_t *map, size_t min_size);
+void *platform_map_data(const platform_map_t *map);
+size_t platform_map_size(const platform_map_t *map);
+void platform_map_close(platform_map_t *map);
+
 #endif
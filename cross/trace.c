@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "platform.h"
+#include "trace.h"
+
+#define TRACE_BUFFER_SIZE (64 * 1024)
+#define TRACE_NAME_MAX 64
+
+typedef struct
+{
+	uint64_t time_ns;
+	uint16_t channel;
+	uint8_t kind;
+	int32_t result;
+	uint32_t len;
+	const uint8_t *data;
+} TraceRecord;
+
+struct trace_replay
+{
+	uint8_t *file;
+	size_t file_size;
+	size_t *offsets;
+	size_t count;
+	size_t cursor;
+	uint64_t last_ns;
+	bool realtime;
+	char name[TRACE_NAME_MAX];
+};
+
+static FILE *trace_out = NULL;
+static atomic_bool trace_on = false;
+// Mutex e não spinlock: o fwrite pode esvaziar o buffer de 64 KiB no disco com a trava tomada.
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_size_t divergences = 0;
+static uint64_t trace_origin_ns = 0;
+static uint16_t trace_channels = 0;
+
+static void trace_acquire(void)
+{
+	pthread_mutex_lock(&trace_lock);
+}
+
+static void trace_release(void)
+{
+	pthread_mutex_unlock(&trace_lock);
+}
+
+static void put_le(uint8_t *dst, uint64_t value, int bytes)
+{
+	for (int i = 0; i < bytes; i++)
+		dst[i] = (uint8_t)(value >> (8 * i));
+}
+
+static uint64_t get_le(const uint8_t *src, int bytes)
+{
+	uint64_t value = 0;
+	for (int i = 0; i < bytes; i++)
+		value |= (uint64_t)src[i] << (8 * i);
+	return value;
+}
+
+bool trace_start(const char *path)
+{
+	if (!path || atomic_load(&trace_on))
+		return false;
+
+	FILE *out = fopen(path, "wb");
+	if (!out)
+		return false;
+	setvbuf(out, NULL, _IOFBF, TRACE_BUFFER_SIZE);
+
+	uint8_t header[TRACE_FILE_HEADER_SIZE] = {0};
+	memcpy(header, TRACE_MAGIC, 4);
+	put_le(header + 4, TRACE_VERSION, 2);
+	put_le(header + 8, (uint64_t)time(NULL), 8);
+	if (fwrite(header, 1, sizeof(header), out) != sizeof(header))
+	{
+		fclose(out);
+		return false;
+	}
+
+	trace_acquire();
+	trace_out = out;
+	trace_origin_ns = platform_monotonic_ns();
+	trace_channels = 0;
+	trace_release();
+	atomic_store(&trace_on, true);
+	return true;
+}
+
+void trace_stop(void)
+{
+	atomic_store(&trace_on, false);
+	trace_acquire();
+	if (trace_out)
+	{
+		fclose(trace_out);
+		trace_out = NULL;
+	}
+	trace_release();
+}
+
+bool trace_enabled(void)
+{
+	return atomic_load_explicit(&trace_on, memory_order_relaxed);
+}
+
+uint16_t trace_channel(trace_device_t device, const char *name)
+{
+	if (!trace_enabled() || !name)
+		return 0;
+
+	trace_acquire();
+	uint16_t channel = ++trace_channels;
+	trace_release();
+	trace_record(channel, TRACE_OPEN, (int32_t)device, NULL, 0, (const uint8_t *)name, strlen(name));
+	return channel;
+}
+
+// O cabeçalho é montado fora da trava; dentro dela só há cópias para o buffer do FILE.
+void trace_record(uint16_t channel, trace_kind_t kind, int32_t result,
+				  const uint8_t *head, size_t head_len, const uint8_t *data, size_t len)
+{
+	if (!trace_enabled() || channel == 0)
+		return;
+
+	uint8_t header[TRACE_RECORD_HEADER_SIZE] = {0};
+	put_le(header + 8, channel, 2);
+	header[10] = (uint8_t)kind;
+	put_le(header + 12, (uint32_t)result, 4);
+	put_le(header + 16, head_len + len, 4);
+
+	trace_acquire();
+	if (trace_out)
+	{
+		put_le(header, platform_monotonic_ns() - trace_origin_ns, 8);
+		fwrite(header, 1, sizeof(header), trace_out);
+		if (head_len)
+			fwrite(head, 1, head_len, trace_out);
+		if (len)
+			fwrite(data, 1, len, trace_out);
+	}
+	trace_release();
+}
+
+static bool parse_record(const trace_replay_t *replay, size_t offset, TraceRecord *record)
+{
+	if (replay->file_size - offset < TRACE_RECORD_HEADER_SIZE)
+		return false;
+
+	const uint8_t *raw = replay->file + offset;
+	record->time_ns = get_le(raw, 8);
+	record->channel = (uint16_t)get_le(raw + 8, 2);
+	record->kind = raw[10];
+	record->result = (int32_t)(uint32_t)get_le(raw + 12, 4);
+	record->len = (uint32_t)get_le(raw + 16, 4);
+	record->data = raw + TRACE_RECORD_HEADER_SIZE;
+	return record->len <= replay->file_size - offset - TRACE_RECORD_HEADER_SIZE;
+}
+
+static bool load_file(const char *path, trace_replay_t *replay)
+{
+	FILE *in = fopen(path, "rb");
+	if (!in)
+		return false;
+
+	bool ok = false;
+	long size = -1;
+	if (fseek(in, 0, SEEK_END) == 0 && (size = ftell(in)) >= TRACE_FILE_HEADER_SIZE && fseek(in, 0, SEEK_SET) == 0)
+	{
+		replay->file_size = (size_t)size;
+		replay->file = malloc(replay->file_size);
+		ok = replay->file && fread(replay->file, 1, replay->file_size, in) == replay->file_size &&
+			 memcmp(replay->file, TRACE_MAGIC, 4) == 0 && get_le(replay->file + 4, 2) == TRACE_VERSION;
+	}
+	fclose(in);
+	return ok;
+}
+
+// Sem nome, o primeiro canal do tipo pedido é usado.
+trace_replay_t *trace_replay_open(const char *path, trace_device_t device, const char *name, bool realtime)
+{
+	trace_replay_t *replay = calloc(1, sizeof(trace_replay_t));
+	if (!replay)
+		return NULL;
+	if (!path || !load_file(path, replay))
+	{
+		trace_replay_close(replay);
+		return NULL;
+	}
+
+	uint16_t channel = 0;
+	size_t offset = TRACE_FILE_HEADER_SIZE;
+	size_t capacity = 0;
+	TraceRecord record;
+	while (parse_record(replay, offset, &record))
+	{
+		offset += TRACE_RECORD_HEADER_SIZE + record.len;
+		if (record.kind == TRACE_OPEN)
+		{
+			if (channel == 0 && record.result == (int32_t)device && record.len < TRACE_NAME_MAX &&
+				(!name || (strlen(name) == record.len && memcmp(name, record.data, record.len) == 0)))
+			{
+				channel = record.channel;
+				memcpy(replay->name, record.data, record.len);
+				replay->name[record.len] = '\0';
+			}
+			continue;
+		}
+		if (channel == 0 || record.channel != channel)
+			continue;
+
+		if (replay->count == capacity)
+		{
+			size_t next = capacity ? capacity * 2 : 256;
+			size_t *grown = realloc(replay->offsets, next * sizeof(size_t));
+			if (!grown)
+			{
+				trace_replay_close(replay);
+				return NULL;
+			}
+			replay->offsets = grown;
+			capacity = next;
+		}
+		replay->offsets[replay->count++] = offset - TRACE_RECORD_HEADER_SIZE - record.len;
+	}
+
+	if (channel == 0)
+	{
+		trace_replay_close(replay);
+		return NULL;
+	}
+	replay->realtime = realtime;
+	return replay;
+}
+
+void trace_replay_close(trace_replay_t *replay)
+{
+	if (!replay)
+		return;
+	free(replay->offsets);
+	free(replay->file);
+	free(replay);
+}
+
+const char *trace_replay_name(const trace_replay_t *replay)
+{
+	return replay ? replay->name : NULL;
+}
+
+// Registros de outro tipo no caminho indicam que o protocolo mudou desde a captura.
+bool trace_replay_next(trace_replay_t *replay, trace_kind_t kind, trace_event_t *event)
+{
+	if (!replay || !event)
+		return false;
+
+	TraceRecord record;
+	while (replay->cursor < replay->count)
+	{
+		if (!parse_record(replay, replay->offsets[replay->cursor++], &record))
+			break;
+		if (record.kind != kind)
+		{
+			if (record.kind != TRACE_BAUD)
+				trace_replay_diverged(replay);
+			continue;
+		}
+
+		if (replay->realtime && replay->last_ns && record.time_ns > replay->last_ns)
+			platform_sleep_ms((int)((record.time_ns - replay->last_ns) / 1000000));
+		replay->last_ns = record.time_ns;
+
+		*event = (trace_event_t){record.time_ns, record.result, record.data, record.len};
+		return true;
+	}
+	return false;
+}
+
+void trace_replay_diverged(trace_replay_t *replay)
+{
+	(void)replay;
+	atomic_fetch_add(&divergences, 1);
+}
+
+size_t trace_divergences(void)
+{
+	return atomic_load(&divergences);
+}
@@ -0,0 +1,56 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Formato (little-endian): cabeçalho "TTTR" + versão (u16) + reservado (u16) + início em
+// segundos Unix (u64), seguido de registros com tempo em ns desde o início (u64), canal (u16),
+// tipo (u8), reservado (u8), resultado (i32), tamanho (u32) e o payload.
+#define TRACE_MAGIC "TTTR"
+#define TRACE_VERSION 1
+#define TRACE_FILE_HEADER_SIZE 16
+#define TRACE_RECORD_HEADER_SIZE 20
+#define TRACE_SETUP_SIZE 8
+
+typedef enum
+{
+	TRACE_OPEN = 1,
+	TRACE_WRITE,
+	TRACE_READ,
+	TRACE_CONTROL,
+	TRACE_BAUD,
+} trace_kind_t;
+
+typedef enum
+{
+	TRACE_DEVICE_ESP32 = 1,
+	TRACE_DEVICE_DS4,
+} trace_device_t;
+
+typedef struct
+{
+	uint64_t time_ns;
+	int32_t result;
+	const uint8_t *data;
+	uint32_t len;
+} trace_event_t;
+
+typedef struct trace_replay trace_replay_t;
+
+bool trace_start(const char *path);
+void trace_stop(void);
+bool trace_enabled(void);
+uint16_t trace_channel(trace_device_t device, const char *name);
+void trace_record(uint16_t channel, trace_kind_t kind, int32_t result,
+				  const uint8_t *head, size_t head_len, const uint8_t *data, size_t len);
+
+trace_replay_t *trace_replay_open(const char *path, trace_device_t device, const char *name, bool realtime);
+void trace_replay_close(trace_replay_t *replay);
+const char *trace_replay_name(const trace_replay_t *replay);
+bool trace_replay_next(trace_replay_t *replay, trace_kind_t kind, trace_event_t *event);
+void trace_replay_diverged(trace_replay_t *replay);
+size_t trace_divergences(void);
+
+#endif
@@ -1,9 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include <libusb.h>
 #include "libds4.h"
 #include "platform.h"
+#include "instrument.h"
+#include "trace.h"
+#include "eventring.h"
+#include "metrics.h"
+#include "mac.h"
 
 #define DS4_VENDOR_ID 0x054C
 #define DS4_PRODUCT_ID_GEN1 0x05C4
@@ -29,9 +35,87 @@ struct ds4_context
 {
 	libusb_context *usb_ctx;
 	libusb_device_handle *handle;
-	bool debug_enabled;
+	platform_lock_t *lock;
+	char path[DS4_PATH_MAX];
+	bool detached;
+	trace_replay_t *replay;
+	uint16_t trace;
+	uint16_t ring;
+	metrics_series_t *metrics;
+#ifdef TTCC_INSTRUMENT
+	instr_stats_t *stats;
+#endif
 };
 
+// Contexto libusb de quem mantém controles abertos por muito tempo (pool do ttcc/ttccd): enumerar e
+// abrir reaproveitam o mesmo contexto em vez de um libusb_init/libusb_exit a cada chamada.
+static pthread_mutex_t shared_usb_lock = PTHREAD_MUTEX_INITIALIZER;
+static libusb_context *shared_usb = NULL;
+static int shared_usb_refs = 0;
+
+static libusb_context *internal_usb_open(void)
+{
+	libusb_context *usb_ctx = NULL;
+	pthread_mutex_lock(&shared_usb_lock);
+	if (shared_usb_refs > 0)
+	{
+		shared_usb_refs++;
+		usb_ctx = shared_usb;
+	}
+	pthread_mutex_unlock(&shared_usb_lock);
+
+	if (!usb_ctx && libusb_init(&usb_ctx) < 0)
+	{
+		return NULL;
+	}
+	return usb_ctx;
+}
+
+static void internal_usb_close(libusb_context *usb_ctx)
+{
+	if (!usb_ctx)
+	{
+		return;
+	}
+	pthread_mutex_lock(&shared_usb_lock);
+	if (shared_usb_refs > 0 && usb_ctx == shared_usb)
+	{
+		bool last = --shared_usb_refs == 0;
+		if (last)
+		{
+			shared_usb = NULL;
+		}
+		pthread_mutex_unlock(&shared_usb_lock);
+		if (last)
+		{
+			libusb_exit(usb_ctx);
+		}
+		return;
+	}
+	pthread_mutex_unlock(&shared_usb_lock);
+	libusb_exit(usb_ctx);
+}
+
+bool ds4_usb_acquire(void)
+{
+	pthread_mutex_lock(&shared_usb_lock);
+	bool ok = shared_usb_refs > 0 || libusb_init(&shared_usb) >= 0;
+	if (ok)
+	{
+		shared_usb_refs++;
+	}
+	pthread_mutex_unlock(&shared_usb_lock);
+	return ok;
+}
+
+void ds4_usb_release(void)
+{
+	pthread_mutex_lock(&shared_usb_lock);
+	libusb_context *usb_ctx = shared_usb_refs > 0 ? shared_usb : NULL;
+	pthread_mutex_unlock(&shared_usb_lock);
+	internal_usb_close(usb_ctx);
+}
+
 static void internal_reverse_array(const uint8_t *src, uint8_t *dest, int len)
 {
 	for (int i = 0; i < len; i++)
@@ -40,7 +124,63 @@ static void internal_reverse_array(const uint8_t *src, uint8_t *dest, int len)
 	}
 }
 
-ds4_context_t *ds4_create_context(void)
+static bool internal_is_ds4(libusb_device *dev)
+{
+	struct libusb_device_descriptor desc;
+	if (libusb_get_device_descriptor(dev, &desc) != LIBUSB_SUCCESS)
+	{
+		return false;
+	}
+	return desc.idVendor == DS4_VENDOR_ID &&
+		   (desc.idProduct == DS4_PRODUCT_ID_GEN1 || desc.idProduct == DS4_PRODUCT_ID_GEN2);
+}
+
+static void internal_usb_path(libusb_device *dev, char *path_out, size_t size)
+{
+	uint8_t ports[8];
+	int depth = libusb_get_port_numbers(dev, ports, (int)sizeof(ports));
+	int len = snprintf(path_out, size, "%u", (unsigned)libusb_get_bus_number(dev));
+
+	for (int i = 0; i < depth && len > 0 && (size_t)len < size; i++)
+	{
+		len += snprintf(path_out + len, size - (size_t)len, "%c%u", i == 0 ? '-' : '.', (unsigned)ports[i]);
+	}
+}
+
+int ds4_list_devices(char (*paths)[DS4_PATH_MAX], int max_devices)
+{
+	if (!paths || max_devices <= 0)
+	{
+		return -1;
+	}
+
+	libusb_context *usb_ctx = internal_usb_open();
+	if (!usb_ctx)
+	{
+		return -1;
+	}
+
+	libusb_device **list;
+	ssize_t total = libusb_get_device_list(usb_ctx, &list);
+	int count = 0;
+
+	for (ssize_t i = 0; i < total && count < max_devices; i++)
+	{
+		if (internal_is_ds4(list[i]))
+		{
+			internal_usb_path(list[i], paths[count++], DS4_PATH_MAX);
+		}
+	}
+
+	if (total >= 0)
+	{
+		libusb_free_device_list(list, 1);
+	}
+	internal_usb_close(usb_ctx);
+	return count;
+}
+
+ds4_context_t *ds4_create_context_at(const char *path)
 {
 	ds4_context_t *ctx = calloc(1, sizeof(ds4_context_t));
 	if (!ctx)
@@ -48,36 +188,123 @@ ds4_context_t *ds4_create_context(void)
 		return NULL;
 	}
 
-	if (libusb_init(&ctx->usb_ctx) < 0)
+	INSTR_BEGIN(t_init);
+	ctx->usb_ctx = internal_usb_open();
+	if (!ctx->usb_ctx)
 	{
 		free(ctx);
 		return NULL;
 	}
+#ifdef TTCC_INSTRUMENT
+	uint64_t init_ns = platform_monotonic_ns() - t_init;
+#endif
 
-	ctx->handle = libusb_open_device_with_vid_pid(ctx->usb_ctx, DS4_VENDOR_ID, DS4_PRODUCT_ID_GEN1);
-	if (!ctx->handle)
+	INSTR_BEGIN(t_open);
+	libusb_device **list;
+	ssize_t total = libusb_get_device_list(ctx->usb_ctx, &list);
+
+	for (ssize_t i = 0; i < total && !ctx->handle; i++)
 	{
-		ctx->handle = libusb_open_device_with_vid_pid(ctx->usb_ctx, DS4_VENDOR_ID, DS4_PRODUCT_ID_GEN2);
+		if (!internal_is_ds4(list[i]))
+		{
+			continue;
+		}
+
+		internal_usb_path(list[i], ctx->path, sizeof(ctx->path));
+		if (path && strcmp(path, ctx->path) != 0)
+		{
+			continue;
+		}
+
+		// Controle já usado por outro processo: passa para o próximo.
+		char key[DS4_PATH_MAX + 8];
+		snprintf(key, sizeof(key), "ds4-%s", ctx->path);
+		if (!platform_lock_try(key, &ctx->lock))
+		{
+			continue;
+		}
+
+		if (libusb_open(list[i], &ctx->handle) != LIBUSB_SUCCESS)
+		{
+			ctx->handle = NULL;
+			platform_lock_release(ctx->lock);
+			ctx->lock = NULL;
+		}
+	}
+
+	if (total >= 0)
+	{
+		libusb_free_device_list(list, 1);
 	}
 
 	if (!ctx->handle)
 	{
-		libusb_exit(ctx->usb_ctx);
+		internal_usb_close(ctx->usb_ctx);
 		free(ctx);
 		return NULL;
 	}
 
+	// O caminho só é conhecido depois da enumeração; o init é contabilizado aqui.
+#ifdef TTCC_INSTRUMENT
+	ctx->stats = instr_device(ctx->path);
+	if (ctx->stats)
+	{
+		ctx->stats->phase_ns[PHASE_DS4_USB_INIT] += init_ns;
+		ctx->stats->phase_calls[PHASE_DS4_USB_INIT]++;
+	}
+#endif
+	INSTR_END(ctx->stats, PHASE_DS4_OPEN, t_open);
+	ctx->trace = trace_channel(TRACE_DEVICE_DS4, ctx->path);
+	ctx->ring = ring_device(ctx->path);
+	ctx->metrics = metrics_series(ctx->path);
+	ring_event(ctx->ring, RING_DS4_OPEN, 0);
+
+	INSTR_BEGIN(t_detach);
 #ifdef PLATFORM_LINUX
 	if (libusb_kernel_driver_active(ctx->handle, 0) == 1)
 	{
-		libusb_detach_kernel_driver(ctx->handle, 0);
+		ctx->detached = libusb_detach_kernel_driver(ctx->handle, 0) == LIBUSB_SUCCESS;
 	}
 #endif
 	libusb_claim_interface(ctx->handle, 0);
+	INSTR_END(ctx->stats, PHASE_DS4_DETACH, t_detach);
 
 	return ctx;
 }
 
+ds4_context_t *ds4_create_context(void)
+{
+	return ds4_create_context_at(NULL);
+}
+
+// Contexto sem libusb: as transferências de controle são respondidas pela captura.
+ds4_context_t *ds4_replay_context(const char *trace_path, const char *path, bool realtime)
+{
+	ds4_context_t *ctx = calloc(1, sizeof(ds4_context_t));
+	if (!ctx)
+	{
+		return NULL;
+	}
+
+	ctx->replay = trace_replay_open(trace_path, TRACE_DEVICE_DS4, path, realtime);
+	if (!ctx->replay)
+	{
+		free(ctx);
+		return NULL;
+	}
+	snprintf(ctx->path, sizeof(ctx->path), "%s", trace_replay_name(ctx->replay));
+	ctx->ring = ring_device(ctx->path);
+#ifdef TTCC_INSTRUMENT
+	ctx->stats = instr_device(ctx->path);
+#endif
+	return ctx;
+}
+
+const char *ds4_get_path(const ds4_context_t *ctx)
+{
+	return ctx ? ctx->path : NULL;
+}
+
 void ds4_destroy_context(ds4_context_t *ctx)
 {
 	if (!ctx)
@@ -87,18 +314,58 @@ void ds4_destroy_context(ds4_context_t *ctx)
 	if (ctx->handle)
 	{
 		libusb_release_interface(ctx->handle, 0);
+#ifdef PLATFORM_LINUX
+		// Devolve o controle ao hid-sony; sem isso ele só volta a ser gamepad quando replugado.
+		if (ctx->detached)
+		{
+			libusb_attach_kernel_driver(ctx->handle, 0);
+		}
+#endif
 		libusb_close(ctx->handle);
 	}
-	if (ctx->usb_ctx)
+	internal_usb_close(ctx->usb_ctx);
+	trace_replay_close(ctx->replay);
+	platform_lock_release(ctx->lock);
+	free(ctx);
+}
+
+// Grava o setup do USB junto com os dados; em replay, devolve o resultado capturado.
+static int control_transfer(ds4_context_t *ctx, uint8_t request_type, uint8_t request, uint16_t value,
+							unsigned char *buf, uint16_t len)
+{
+	uint8_t setup[TRACE_SETUP_SIZE] = {request_type, request, (uint8_t)(value & 0xFF), (uint8_t)(value >> 8),
+									   0, 0, (uint8_t)(len & 0xFF), (uint8_t)(len >> 8)};
+	bool in = (request_type & DS4_DIR_IN) != 0;
+
+	if (ctx->replay)
 	{
-		libusb_exit(ctx->usb_ctx);
+		trace_event_t event;
+		if (!trace_replay_next(ctx->replay, TRACE_CONTROL, &event) || event.len < TRACE_SETUP_SIZE)
+		{
+			return LIBUSB_ERROR_NO_DEVICE;
+		}
+		uint32_t data_len = event.len - TRACE_SETUP_SIZE;
+		if (memcmp(event.data, setup, TRACE_SETUP_SIZE) != 0 ||
+			(!in && (data_len != len || memcmp(event.data + TRACE_SETUP_SIZE, buf, len) != 0)))
+		{
+			trace_replay_diverged(ctx->replay);
+		}
+		if (in)
+		{
+			memcpy(buf, event.data + TRACE_SETUP_SIZE, data_len < len ? data_len : len);
+		}
+		return event.result;
 	}
-	free(ctx);
+
+	int res = libusb_control_transfer(ctx->handle, request_type, request, value, 0, buf, len, DS4_USB_TIMEOUT_MS);
+	size_t logged = in ? (res > 0 ? (size_t)res : 0) : len;
+	trace_record(ctx->trace, TRACE_CONTROL, res, setup, sizeof(setup), buf, logged);
+	return res;
 }
 
 bool ds4_get_mac(ds4_context_t *ctx, uint8_t *mac_out)
 {
-	if (!ctx || !ctx->handle || !mac_out)
+	if (!ctx || (!ctx->handle && !ctx->replay) || !mac_out)
 	{
 		return false;
 	}
@@ -107,34 +374,72 @@ bool ds4_get_mac(ds4_context_t *ctx, uint8_t *mac_out)
 	int transferred;
 	uint16_t wValue;
 
+	uint64_t start_ns = platform_monotonic_ns();
+	INSTR_BEGIN(t_get);
 	memset(buf, 0, sizeof(buf));
 	wValue = (DS4_REP_TYPE_FEAT << 8) | DS4_REP_ID_PAIRING;
-	transferred = libusb_control_transfer(ctx->handle, DS4_HID_GET, DS4_REQ_GET_REP,
-										  wValue, 0, buf, sizeof(buf), DS4_USB_TIMEOUT_MS);
+	transferred = control_transfer(ctx, DS4_HID_GET, DS4_REQ_GET_REP, wValue, buf, sizeof(buf));
+	INSTR_END(ctx->stats, PHASE_DS4_GET_MAC, t_get);
+	ring_event(ctx->ring, RING_DS4_GET_MAC, transferred);
+	INSTR_COUNT(ctx->stats, COUNTER_BYTES_READ, transferred > 0 ? transferred : 0);
+	INSTR_COUNT(ctx->stats, COUNTER_TIMEOUTS, transferred == LIBUSB_ERROR_TIMEOUT);
+	metrics_count(ctx->metrics, METRIC_TIMEOUTS, transferred == LIBUSB_ERROR_TIMEOUT);
 
 	if (transferred > 15)
 	{
 		internal_reverse_array(&buf[10], mac_out, DS4_MAC_ADDR_LEN);
+		metrics_observe(ctx->metrics, METRIC_DS4_READ, platform_monotonic_ns() - start_ns);
 		return true;
 	}
 
+	INSTR_COUNT(ctx->stats, COUNTER_RETRIES, 1);
+	metrics_count(ctx->metrics, METRIC_RETRIES, 1);
+	INSTR_BEGIN(t_fallback);
 	memset(buf, 0, sizeof(buf));
 	wValue = (DS4_REP_TYPE_FEAT << 8) | DS4_REP_ID_STD;
-	transferred = libusb_control_transfer(ctx->handle, DS4_HID_GET, DS4_REQ_GET_REP,
-										  wValue, 0, buf, sizeof(buf), DS4_USB_TIMEOUT_MS);
+	transferred = control_transfer(ctx, DS4_HID_GET, DS4_REQ_GET_REP, wValue, buf, sizeof(buf));
+	INSTR_END(ctx->stats, PHASE_DS4_FALLBACK, t_fallback);
+	ring_event(ctx->ring, RING_DS4_FALLBACK, transferred);
+	INSTR_COUNT(ctx->stats, COUNTER_BYTES_READ, transferred > 0 ? transferred : 0);
+	INSTR_COUNT(ctx->stats, COUNTER_TIMEOUTS, transferred == LIBUSB_ERROR_TIMEOUT);
+	metrics_count(ctx->metrics, METRIC_TIMEOUTS, transferred == LIBUSB_ERROR_TIMEOUT);
 
 	if (transferred > 6)
 	{
 		memcpy(mac_out, &buf[1], DS4_MAC_ADDR_LEN);
+		metrics_observe(ctx->metrics, METRIC_DS4_READ, platform_monotonic_ns() - start_ns);
 		return true;
 	}
 
+	metrics_count(ctx->metrics, METRIC_FAILURES, 1);
+	return false;
+}
+
+// MAC Bluetooth do próprio controle, nos bytes 1..6 do mesmo relatório de pareamento.
+bool ds4_get_device_mac(ds4_context_t *ctx, uint8_t *mac_out)
+{
+	if (!ctx || (!ctx->handle && !ctx->replay) || !mac_out)
+	{
+		return false;
+	}
+
+	unsigned char buf[65];
+	memset(buf, 0, sizeof(buf));
+	uint16_t wValue = (DS4_REP_TYPE_FEAT << 8) | DS4_REP_ID_PAIRING;
+	int transferred = control_transfer(ctx, DS4_HID_GET, DS4_REQ_GET_REP, wValue, buf, sizeof(buf));
+	ring_event(ctx->ring, RING_DS4_GET_MAC, transferred);
+
+	if (transferred > DS4_MAC_ADDR_LEN)
+	{
+		internal_reverse_array(&buf[1], mac_out, DS4_MAC_ADDR_LEN);
+		return true;
+	}
 	return false;
 }
 
 bool ds4_set_mac(ds4_context_t *ctx, const uint8_t *mac_in)
 {
-	if (!ctx || !ctx->handle || !mac_in)
+	if (!ctx || (!ctx->handle && !ctx->replay) || !mac_in)
 		return false;
 
 	unsigned char buf[32];
@@ -143,16 +448,22 @@ bool ds4_set_mac(ds4_context_t *ctx, const uint8_t *mac_in)
 	buf[0] = DS4_REP_ID_WRITE;
 	internal_reverse_array(mac_in, &buf[1], DS4_MAC_ADDR_LEN);
 
+	uint64_t start_ns = platform_monotonic_ns();
+	INSTR_BEGIN(t_set);
 	uint16_t wValue = (DS4_REP_TYPE_FEAT << 8) | DS4_REP_ID_WRITE;
-	int res = libusb_control_transfer(ctx->handle, DS4_HID_SET, DS4_REQ_SET_REP,
-									  wValue, 0, buf, sizeof(buf), DS4_USB_TIMEOUT_MS);
-
-	if (res < 0 && ctx->debug_enabled)
+	int res = control_transfer(ctx, DS4_HID_SET, DS4_REQ_SET_REP, wValue, buf, sizeof(buf));
+	INSTR_END(ctx->stats, PHASE_DS4_SET_MAC, t_set);
+	INSTR_COUNT(ctx->stats, COUNTER_BYTES_WRITTEN, res > 0 ? res : 0);
+	INSTR_COUNT(ctx->stats, COUNTER_TIMEOUTS, res == LIBUSB_ERROR_TIMEOUT);
+	ring_event(ctx->ring, RING_DS4_SET_MAC, res);
+	metrics_count(ctx->metrics, METRIC_TIMEOUTS, res == LIBUSB_ERROR_TIMEOUT);
+	if (res < 0)
 	{
-		fprintf(stderr, "[DEBUG USB] Falha na gravacao (Write): %s (Codigo: %d)\n", libusb_error_name(res), res);
+		metrics_count(ctx->metrics, METRIC_FAILURES, 1);
+		return false;
 	}
-
-	return (res >= 0);
+	metrics_observe(ctx->metrics, METRIC_DS4_WRITE, platform_monotonic_ns() - start_ns);
+	return true;
 }
 
 void ds4_mac_to_string(const uint8_t *mac_raw, char *str_out)
@@ -161,9 +472,7 @@ void ds4_mac_to_string(const uint8_t *mac_raw, char *str_out)
 	{
 		return;
 	}
-	sprintf(str_out, "%02X:%02X:%02X:%02X:%02X:%02X",
-			mac_raw[0], mac_raw[1], mac_raw[2],
-			mac_raw[3], mac_raw[4], mac_raw[5]);
+	mac_format(mac_raw, ':', str_out);
 }
 
 bool ds4_string_to_mac(const char *str_in, uint8_t *mac_out)
@@ -172,10 +481,7 @@ bool ds4_string_to_mac(const char *str_in, uint8_t *mac_out)
 	{
 		return false;
 	}
-	int parsed = sscanf(str_in, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx",
-						&mac_out[0], &mac_out[1], &mac_out[2],
-						&mac_out[3], &mac_out[4], &mac_out[5]);
-	return (parsed == DS4_MAC_ADDR_LEN);
+	return mac_parse(str_in, mac_out);
 }
 
 void ds4_print_mac(const uint8_t *mac_raw)
@@ -200,6 +506,5 @@ void ds4_enable_debug(ds4_context_t *ctx)
 	if (ctx && ctx->usb_ctx)
 	{
 		libusb_set_option(ctx->usb_ctx, LIBUSB_OPTION_LOG_LEVEL, LIBUSB_LOG_LEVEL_INFO);
-		ctx->debug_enabled = true;
 	}
 }
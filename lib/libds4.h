@@ -5,13 +5,25 @@
 #include <stdint.h>
 
 #define DS4_MAC_ADDR_LEN 6
+#define DS4_PATH_MAX 32
+#define DS4_MAX_DEVICES 16
 
 typedef struct ds4_context ds4_context_t;
 
 ds4_context_t *ds4_create_context(void);
+ds4_context_t *ds4_create_context_at(const char *path);
+ds4_context_t *ds4_replay_context(const char *trace_path, const char *path, bool realtime);
 void ds4_destroy_context(ds4_context_t *ctx);
 
+// Mantém um contexto libusb vivo para enumerações e aberturas seguintes (processos de longa duração).
+bool ds4_usb_acquire(void);
+void ds4_usb_release(void);
+
+int ds4_list_devices(char (*paths)[DS4_PATH_MAX], int max_devices);
+const char *ds4_get_path(const ds4_context_t *ctx);
+
 bool ds4_get_mac(ds4_context_t *ctx, uint8_t *mac_out);
+bool ds4_get_device_mac(ds4_context_t *ctx, uint8_t *mac_out);
 bool ds4_set_mac(ds4_context_t *ctx, const uint8_t *mac_in);
 
 void ds4_mac_to_string(const uint8_t *mac_raw, char *str_out);
@@ -4,50 +4,155 @@
 #include <ctype.h>
 #include <stdbool.h>
 #include <stdint.h>
-#include <time.h>
+#include <stdatomic.h>
 #include <libserialport.h>
 #include "platform.h"
+#include "instrument.h"
 #include "libesp32.h"
-
-#ifdef PLATFORM_WINDOWS
-#include <windows.h>
-#endif
-
-#define SLIP_BYTE_END 0xC0
-#define SLIP_BYTE_ESC 0xDB
-#define SLIP_BYTE_ESC_END 0xDC
-#define SLIP_BYTE_ESC_ESC 0xDD
+#include "libslip.h"
+#include "md5.h"
+#include "trace.h"
+#include "eventring.h"
+#include "metrics.h"
+#include "mac.h"
 
 #define CMD_SYNC 0x08
 #define CMD_READ_REG 0x0A
+#define CMD_SPI_SET_PARAMS 0x0B
+#define CMD_SPI_ATTACH 0x0D
+#define CMD_READ_FLASH_SLOW 0x0E
+#define CMD_CHANGE_BAUDRATE 0x0F
+#define CMD_SPI_FLASH_MD5 0x13
+#define CMD_FLASH_DEFL_BEGIN 0x10
+#define CMD_FLASH_DEFL_DATA 0x11
 
-#define REG_EFUSE_BASE 0x3FF5A000
-#define REG_MAC_ADDR_LOW (REG_EFUSE_BASE + 0x04)
-#define REG_MAC_ADDR_HIGH (REG_EFUSE_BASE + 0x08)
+#define RESPONSE_DIRECTION 0x01
+#define RESPONSE_BODY_MAX 128
+#define ATTEMPTS_RESPONSE 8
+
+#define REG_CHIP_MAGIC 0x40001000
+#define CHIP_MAGIC_MAX 4
+#define ROM_STATUS_LEN 4
+#define EFUSE_BLOCKS_MAX 4
+#define EFUSE_ROW_WORDS 8
+
+#define FLASH_BLOCK_SLOW 64
+#define FLASH_WINDOW 4
+#define FLASH_VERIFY_CHUNK 4096
+#define FLASH_BLOCK_SIZE 0x10000
+#define FLASH_SECTOR_SIZE 0x1000
+#define FLASH_PAGE_SIZE 0x100
+#define FLASH_STATUS_MASK 0xFFFF
+#define FLASH_WRITE_SIZE 0x400
+#define FLASH_DATA_HEADER 16
+#define FLASH_CHECKSUM_SEED 0xEF
+#define ATTEMPTS_FLASH_CHUNK 3
 
 #define SERIAL_BAUDRATE 115200
 #define TIMEOUT_READ_MS 10
+#define TIMEOUT_FRAME_MS 2000
+#define TIMEOUT_FLASH_DATA_MS 10000
+#define TIMEOUT_ERASE_MS_PER_MB 30000
+#define TIMEOUT_MD5_MS_PER_MB 8000
+#define RX_CHUNK_SIZE 256
 #define TIMEOUT_WRITE_MS 100
 
 #define PACKET_SYNC_SIZE 36
-#define ATTEMPTS_SYNC_FAST 5
-#define ATTEMPTS_SYNC_FULL 20
-#define ATTEMPTS_READ_REG 3
+#define DEADLINE_SYNC_FAST_MS 500
+#define DEADLINE_SYNC_FULL_MS 5000
+#define DEADLINE_READ_REG_MS 3000
+
+#define RTT_INITIAL_MS 100
+#define RTT_MIN_MS 20
+#define RTT_MAX_MS 2000
+#define RTT_BACKOFF_SHIFT_MAX 8
 
 #define DELAY_SIGNAL_MS 5
 #define DELAY_POST_RESET_MS 50
+#define DELAY_BAUD_SWITCH_MS 50
+#define DELAY_HARD_RESET_MS 100
 
-static void platform_sleep_ms(int ms)
+#define CACHE_FILE_NAME "esp32-mac.cache"
+#define CACHE_PATH_MAX 512
+#define CACHE_LINE_MAX 256
+#define CACHE_KEY_MAX 192
+#define CACHE_SERIAL_MIN_LEN 6
+#define USB_VID_ESPRESSIF 0x303A
+
+static bool cache_enabled = true;
+
+typedef struct
 {
-#ifdef PLATFORM_WINDOWS
-	Sleep((DWORD)ms);
-#else
-	struct timespec ts;
-	ts.tv_sec = ms / 1000;
-	ts.tv_nsec = (ms % 1000) * 1000000;
-	nanosleep(&ts, NULL);
+	uint32_t srtt_us;
+	uint32_t rttvar_us;
+	uint32_t seed;
+} LinkPacing;
+
+typedef struct
+{
+	uint64_t start_ns;
+	uint64_t limit_ns;
+	uint64_t sent_ns;
+	int attempt;
+} PacedRetry;
+
+typedef struct
+{
+	const char *name;
+	uint32_t offset;
+	int words;
+} EfuseBlock;
+
+typedef struct
+{
+	const char *name;
+	uint32_t magic[CHIP_MAGIC_MAX];
+	uint32_t efuse_base;
+	uint32_t mac_offset;
+	bool begin_has_encrypted;
+	uint8_t status_len;
+	EfuseBlock efuse[EFUSE_BLOCKS_MAX];
+} ChipFamily;
+
+// Valor do registrador mágico (0x40001000) por família. O MAC ocupa duas palavras a partir
+// de efuse_base + mac_offset: a baixa guarda os 4 últimos bytes, a alta os 2 primeiros.
+// Magic desconhecido não cai em nenhum layout: melhor falhar do que gravar um MAC errado.
+static const ChipFamily chip_families[] = {
+	{"ESP32", {0x00F01D83}, 0x3FF5A000, 0x004, false, 4, {{"BLK0", 0x000, 7}, {"BLK1", 0x038, 8}, {"BLK2", 0x058, 8}, {"BLK3", 0x078, 8}}},
+	{"ESP32-S2", {0x000007C6}, 0x3F41A000, 0x044, true, 4, {{"RD", 0x02C, 96}}},
+	{"ESP32-S3", {0x00000009}, 0x60007000, 0x044, true, 4, {{"RD", 0x02C, 96}}},
+	{"ESP32-C3", {0x6921506F, 0x1B31506F, 0x4881606F, 0x4361606F}, 0x60008800, 0x044, true, 4, {{"RD", 0x02C, 96}}},
+	{"ESP32-C2", {0x6F51306F, 0x7C41A06F}, 0x60008800, 0x040, true, 4, {{"RD", 0x02C, 56}}},
+	{"ESP32-C6", {0x2CE0806F}, 0x600B0800, 0x044, true, 4, {{"RD", 0x02C, 96}}},
+	{"ESP32-H2", {0xD7B73E80}, 0x600B0800, 0x044, true, 4, {{"RD", 0x02C, 96}}},
+};
+
+struct esp32_session
+{
+	struct sp_port *port;
+	platform_lock_t *lock;
+	char name[ESP32_PORT_NAME_MAX];
+	bool synced;
+	slip_buffer_t tx;
+	slip_decoder_t decoder;
+	const ChipFamily *chip;
+	trace_replay_t *replay;
+	uint64_t replay_ns;
+	bool replay_end;
+	LinkPacing pacing;
+	int baudrate;
+	uint16_t trace;
+	uint16_t ring;
+	metrics_series_t *metrics;
+	uint64_t opened_ns;
+	bool probed;
+	uint8_t rx[RX_CHUNK_SIZE];
+	size_t rx_pos;
+	size_t rx_len;
+#ifdef TTCC_INSTRUMENT
+	instr_stats_t *stats;
 #endif
-}
+};
 
 static void reset_strategy_usb_native(struct sp_port *port)
 {
@@ -85,139 +190,309 @@ static void reset_strategy_classic(struct sp_port *port)
 	sp_set_rts(port, SP_RTS_OFF);
 }
 
-// Abordagem moderna: Função static inline substituindo a macro
-static inline void slip_encode_byte(uint8_t byte, uint8_t *buffer, int *index)
+// Descarta também o que já foi lido da porta mas ainda não decodificado.
+static void session_flush(esp32_session_t *session, enum sp_buffer buffers)
 {
-	if (byte == SLIP_BYTE_END)
+	if (session->port)
+		sp_flush(session->port, buffers);
+	if (buffers & SP_BUF_INPUT)
 	{
-		buffer[(*index)++] = SLIP_BYTE_ESC;
-		buffer[(*index)++] = SLIP_BYTE_ESC_END;
+		session->rx_pos = 0;
+		session->rx_len = 0;
+		slip_decoder_reset(&session->decoder);
 	}
-	else if (byte == SLIP_BYTE_ESC)
+}
+
+// 10 bits por byte no fio, com folga de 2x para o conversor: um DEFL_DATA de 1 KiB a 115200 passa de 100 ms.
+static int write_timeout_ms(const esp32_session_t *session, size_t len)
+{
+	uint64_t baudrate = (uint64_t)(session->baudrate > 0 ? session->baudrate : SERIAL_BAUDRATE);
+	return TIMEOUT_WRITE_MS + (int)((uint64_t)len * 10u * 1000u * 2u / baudrate);
+}
+
+// Em replay, a escrita consome o próximo registro gravado e confere os bytes enviados.
+static int port_write(esp32_session_t *session, const uint8_t *data, size_t len)
+{
+	if (session->replay)
 	{
-		buffer[(*index)++] = SLIP_BYTE_ESC;
-		buffer[(*index)++] = SLIP_BYTE_ESC_ESC;
+		trace_event_t event;
+		if (!trace_replay_next(session->replay, TRACE_WRITE, &event))
+		{
+			session->replay_end = true;
+			return -1;
+		}
+		session->replay_ns = event.time_ns;
+		if (event.len != len || memcmp(event.data, data, len) != 0)
+			trace_replay_diverged(session->replay);
+		return event.result;
 	}
-	else
+
+	int written = sp_blocking_write(session->port, data, len, (unsigned int)write_timeout_ms(session, len));
+	trace_record(session->trace, TRACE_WRITE, written, NULL, 0, data, len);
+	return written;
+}
+
+// Leituras vazias também são gravadas: o replay percorre o mesmo caminho de timeouts.
+static int port_read(esp32_session_t *session)
+{
+	if (session->replay)
 	{
-		buffer[(*index)++] = byte;
+		trace_event_t event;
+		if (!trace_replay_next(session->replay, TRACE_READ, &event))
+		{
+			session->replay_end = true;
+			return -1;
+		}
+		session->replay_ns = event.time_ns;
+		size_t count = event.len < sizeof(session->rx) ? event.len : sizeof(session->rx);
+		memcpy(session->rx, event.data, count);
+		return event.result > 0 ? (int)count : event.result;
 	}
+
+	int got = sp_blocking_read_next(session->port, session->rx, sizeof(session->rx), TIMEOUT_READ_MS);
+	trace_record(session->trace, TRACE_READ, got, NULL, 0, session->rx, got > 0 ? (size_t)got : 0);
+	return got;
 }
 
-static bool slip_write_frame(struct sp_port *port, uint8_t op, const uint8_t *data, uint16_t len, uint32_t checksum)
+static bool slip_write_frame(esp32_session_t *session, uint8_t op, const uint8_t *data, uint16_t len, uint32_t checksum)
 {
-	uint8_t buffer[1024];
-	int index = 0;
+	session->tx.len = 0;
+	if (!slip_encode_append(&session->tx, op, data, len, checksum))
+		return false;
 
-	uint8_t header[8] = {
-		0x00, op, (uint8_t)(len & 0xFF), (uint8_t)(len >> 8),
-		(uint8_t)(checksum & 0xFF), (uint8_t)(checksum >> 8),
-		(uint8_t)(checksum >> 16), (uint8_t)(checksum >> 24)};
+	int written = port_write(session, session->tx.data, session->tx.len);
+	INSTR_COUNT(session->stats, COUNTER_BYTES_WRITTEN, written > 0 ? written : 0);
+	return written >= 0 && (size_t)written == session->tx.len;
+}
 
-	buffer[index++] = SLIP_BYTE_END;
+// Lê em blocos: bytes que sobram depois do END ficam em session->rx para o próximo quadro.
+static int slip_read_frame(esp32_session_t *session, uint8_t *out_buf, int max_len, int timeout_ms)
+{
+	slip_decoder_reset(&session->decoder);
 
-	for (int i = 0; i < 8; i++)
+	// Cada leitura sem dados espera até TIMEOUT_READ_MS.
+	int attempts = timeout_ms / TIMEOUT_READ_MS;
+	for (int i = 0; i < attempts; i++)
 	{
-		slip_encode_byte(header[i], buffer, &index);
+		if (session->rx_pos == session->rx_len)
+		{
+			session->rx_pos = 0;
+			session->rx_len = 0;
+			int got = port_read(session);
+			if (got <= 0)
+				continue;
+			session->rx_len = (size_t)got;
+			INSTR_COUNT(session->stats, COUNTER_BYTES_READ, got);
+		}
+
+		size_t consumed = 0;
+		bool done = slip_decode(&session->decoder, session->rx + session->rx_pos,
+								session->rx_len - session->rx_pos, &consumed);
+		session->rx_pos += consumed;
+		if (done)
+		{
+			size_t count = session->decoder.frame.len;
+			if (count > (size_t)max_len)
+				count = (size_t)max_len;
+			memcpy(out_buf, session->decoder.frame.data, count);
+			return (int)count;
+		}
+	}
+	INSTR_COUNT(session->stats, COUNTER_TIMEOUTS, 1);
+	metrics_count(session->metrics, METRIC_TIMEOUTS, 1);
+	ring_event(session->ring, RING_ESP32_TIMEOUT, timeout_ms);
+	return -1;
+}
+
+// Em replay o relógio é o instante gravado do último evento, para o ritmo se repetir igual ao da captura.
+static uint64_t session_clock_ns(const esp32_session_t *session)
+{
+	return session->replay ? session->replay_ns : platform_monotonic_ns();
+}
+
+// SRTT/RTTVAR como no RFC 6298, em µs.
+static void pacing_sample(LinkPacing *pacing, uint64_t rtt_ns)
+{
+	uint64_t rtt_us = rtt_ns / 1000u;
+	uint32_t rtt = rtt_us > RTT_MAX_MS * 1000u ? RTT_MAX_MS * 1000u : (uint32_t)rtt_us;
+	if (pacing->srtt_us == 0)
+	{
+		pacing->srtt_us = rtt ? rtt : 1;
+		pacing->rttvar_us = rtt / 2;
+		return;
 	}
-	for (int i = 0; i < len; i++)
+	uint32_t delta = pacing->srtt_us > rtt ? pacing->srtt_us - rtt : rtt - pacing->srtt_us;
+	pacing->rttvar_us = (3 * pacing->rttvar_us + delta) / 4;
+	pacing->srtt_us = (7 * pacing->srtt_us + rtt) / 8;
+}
+
+// RTO dobrado a cada tentativa sem resposta, arredondado para leituras inteiras de TIMEOUT_READ_MS.
+static int pacing_timeout_ms(const LinkPacing *pacing, int attempt, uint64_t remaining_ms)
+{
+	uint64_t rto_ms = RTT_INITIAL_MS;
+	if (pacing->srtt_us)
 	{
-		slip_encode_byte(data[i], buffer, &index);
+		uint32_t spread = 4 * pacing->rttvar_us > TIMEOUT_READ_MS * 1000u ? 4 * pacing->rttvar_us : TIMEOUT_READ_MS * 1000u;
+		rto_ms = (pacing->srtt_us + spread + 999u) / 1000u;
 	}
+	if (rto_ms < RTT_MIN_MS)
+		rto_ms = RTT_MIN_MS;
 
-	buffer[index++] = SLIP_BYTE_END;
+	rto_ms <<= attempt < RTT_BACKOFF_SHIFT_MAX ? attempt : RTT_BACKOFF_SHIFT_MAX;
+	if (rto_ms > RTT_MAX_MS)
+		rto_ms = RTT_MAX_MS;
+	if (rto_ms > remaining_ms)
+		rto_ms = remaining_ms;
+	rto_ms = (rto_ms + TIMEOUT_READ_MS - 1) / TIMEOUT_READ_MS * TIMEOUT_READ_MS;
+	return rto_ms < TIMEOUT_READ_MS ? TIMEOUT_READ_MS : (int)rto_ms;
+}
 
-	// Cast explícito para size_t para evitar avisos de sinal com sp_blocking_write
-	return sp_blocking_write(port, buffer, (size_t)index, TIMEOUT_WRITE_MS) == index;
+static PacedRetry paced_begin(const esp32_session_t *session, int deadline_ms)
+{
+	return (PacedRetry){session_clock_ns(session), (uint64_t)deadline_ms * 1000000u, 0, 0};
 }
 
-static int slip_read_frame(struct sp_port *port, uint8_t *out_buf, int max_len)
+// Antes de cada reenvio espera um jitter de até 1/4 da janela, para não cair em fase com respostas atrasadas.
+static bool paced_next(esp32_session_t *session, PacedRetry *retry, int *timeout_ms)
 {
-	uint8_t byte;
-	int count = 0;
-	bool in_frame = false;
-	bool is_escaped = false;
+	uint64_t elapsed = session_clock_ns(session) - retry->start_ns;
+	if (session->replay_end || elapsed >= retry->limit_ns)
+		return false;
 
-	for (int i = 0; i < 200; i++)
+	*timeout_ms = pacing_timeout_ms(&session->pacing, retry->attempt, (retry->limit_ns - elapsed) / 1000000u);
+	if (retry->attempt > 0 && session->port)
 	{
-		// Cast do tamanho (1) para size_t exigido pela API
-		if (sp_blocking_read(port, &byte, (size_t)1, TIMEOUT_READ_MS) <= 0)
-			continue;
+		uint32_t seed = session->pacing.seed;
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		session->pacing.seed = seed;
+		platform_sleep_ms((int)(seed % (uint32_t)(*timeout_ms / 4 + 1)));
+	}
+	retry->attempt++;
+	return true;
+}
 
-		if (byte == SLIP_BYTE_END)
-		{
-			if (in_frame)
-				return count;
-			in_frame = true;
-			count = 0;
-			continue;
-		}
-		if (!in_frame)
-			continue;
+static void paced_sent(const esp32_session_t *session, PacedRetry *retry)
+{
+	retry->sent_ns = session_clock_ns(session);
+}
 
-		if (byte == SLIP_BYTE_ESC)
-		{
-			is_escaped = true;
-			continue;
-		}
-		if (is_escaped)
-		{
-			if (byte == SLIP_BYTE_ESC_END)
-				byte = SLIP_BYTE_END;
-			else if (byte == SLIP_BYTE_ESC_ESC)
-				byte = SLIP_BYTE_ESC;
-			is_escaped = false;
-		}
-		if (count < max_len)
-			out_buf[count++] = byte;
-	}
-	return -1;
+// Só a resposta à primeira tentativa mede o RTT: depois de um reenvio não dá para saber a qual pedido ela pertence.
+static void paced_success(esp32_session_t *session, const PacedRetry *retry)
+{
+	if (retry->attempt == 1)
+		pacing_sample(&session->pacing, session_clock_ns(session) - retry->sent_ns);
 }
 
-static bool perform_chip_sync(struct sp_port *port, int attempts)
+static bool perform_chip_sync(esp32_session_t *session, int deadline_ms)
 {
 	uint8_t sync_pattern[PACKET_SYNC_SIZE] = {
 		0x07, 0x07, 0x12, 0x20, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
 		0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55,
 		0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55};
 	uint8_t response[128];
+	PacedRetry retry = paced_begin(session, deadline_ms);
+	int timeout_ms;
 
-	for (int i = 0; i < attempts; i++)
+	while (paced_next(session, &retry, &timeout_ms))
 	{
-		slip_write_frame(port, CMD_SYNC, sync_pattern, PACKET_SYNC_SIZE, 0);
+		INSTR_COUNT(session->stats, COUNTER_SYNC_ATTEMPTS, 1);
+		metrics_count(session->metrics, METRIC_RETRIES, retry.attempt > 1);
+		slip_write_frame(session, CMD_SYNC, sync_pattern, PACKET_SYNC_SIZE, 0);
+		paced_sent(session, &retry);
 		// Cast explícito do sizeof para int para bater com a assinatura de slip_read_frame
-		if (slip_read_frame(port, response, (int)sizeof(response)) > 1)
+		if (slip_read_frame(session, response, (int)sizeof(response), timeout_ms) > 1)
 		{
+			paced_success(session, &retry);
+			ring_event(session->ring, RING_ESP32_SYNC, retry.attempt - 1);
 			return true;
 		}
 	}
+	ring_event(session->ring, RING_ESP32_SYNC, -1);
 	return false;
 }
 
-static uint32_t read_efuse_register(struct sp_port *port, uint32_t address)
+static bool read_efuse_register(esp32_session_t *session, uint32_t address, uint32_t *value)
 {
 	uint8_t payload[4] = {
 		(uint8_t)(address & 0xFF), (uint8_t)((address >> 8) & 0xFF),
 		(uint8_t)((address >> 16) & 0xFF), (uint8_t)((address >> 24) & 0xFF)};
 	uint8_t response[128];
+	PacedRetry retry = paced_begin(session, DEADLINE_READ_REG_MS);
+	int timeout_ms;
 
-	for (int i = 0; i < ATTEMPTS_READ_REG; i++)
+	while (paced_next(session, &retry, &timeout_ms))
 	{
-		slip_write_frame(port, CMD_READ_REG, payload, 4, 0);
+		if (retry.attempt > 1)
+		{
+			INSTR_COUNT(session->stats, COUNTER_RETRIES, 1);
+			metrics_count(session->metrics, METRIC_RETRIES, 1);
+		}
+		slip_write_frame(session, CMD_READ_REG, payload, 4, 0);
+		paced_sent(session, &retry);
 		// Cast explícito do sizeof para int
-		int len = slip_read_frame(port, response, (int)sizeof(response));
+		int len = slip_read_frame(session, response, (int)sizeof(response), timeout_ms);
 
 		if (len >= 8 && response[1] == CMD_READ_REG)
 		{
-			return (uint32_t)response[4] | ((uint32_t)response[5] << 8) |
-				   ((uint32_t)response[6] << 16) | ((uint32_t)response[7] << 24);
+			paced_success(session, &retry);
+			*value = (uint32_t)response[4] | ((uint32_t)response[5] << 8) |
+					 ((uint32_t)response[6] << 16) | ((uint32_t)response[7] << 24);
+			return true;
+		}
+		ring_event(session->ring, RING_ESP32_READ_REG, len);
+		session_flush(session, SP_BUF_INPUT);
+	}
+	return false;
+}
+
+static void put_le32(uint8_t *dst, uint32_t value)
+{
+	dst[0] = (uint8_t)(value & 0xFF);
+	dst[1] = (uint8_t)((value >> 8) & 0xFF);
+	dst[2] = (uint8_t)((value >> 16) & 0xFF);
+	dst[3] = (uint8_t)((value >> 24) & 0xFF);
+}
+
+// Lê quadros até a resposta de op. O corpo traz ao menos data_len bytes de dados (READ_FLASH_SLOW
+// sempre manda 64) e termina nos bytes de status do ROM (2 ou 4, conforme o chip): o status vem
+// do fim do quadro e só os data_len primeiros bytes são copiados.
+static bool command_response(esp32_session_t *session, uint8_t op, uint8_t *data_out, size_t data_len, int timeout_ms)
+{
+	uint8_t frame[SLIP_HEADER_SIZE + RESPONSE_BODY_MAX];
+	size_t status_len = session->chip ? session->chip->status_len : ROM_STATUS_LEN;
+
+	for (int i = 0; i < ATTEMPTS_RESPONSE; i++)
+	{
+		int len = slip_read_frame(session, frame, (int)sizeof(frame), timeout_ms);
+		if (len < 0)
+			return false;
+		if (len < SLIP_HEADER_SIZE || frame[0] != RESPONSE_DIRECTION || frame[1] != op)
+			continue;
+
+		size_t body_len = (size_t)len - SLIP_HEADER_SIZE;
+		const uint8_t *body = frame + SLIP_HEADER_SIZE;
+		if (body_len < data_len + status_len || body[body_len - status_len] != 0)
+		{
+			// Sem o par status/erro completo, registra -1.
+			ring_event(session->ring, RING_ESP32_STATUS,
+					   body_len >= status_len ? (int32_t)body[body_len - status_len + 1] : -1);
+			return false;
 		}
-		sp_flush(port, SP_BUF_INPUT);
+		if (data_out)
+			memcpy(data_out, body, data_len);
+		return true;
 	}
-	return 0;
+	return false;
+}
+
+static bool command_execute(esp32_session_t *session, uint8_t op, const uint8_t *data, uint16_t len)
+{
+	return slip_write_frame(session, op, data, len, 0) && command_response(session, op, NULL, 0, TIMEOUT_FRAME_MS);
 }
 
-static void format_mac_address(uint32_t low, uint32_t high, char *buffer, size_t size)
+void esp32_format_mac(uint32_t low, uint32_t high, char *buffer, size_t size)
 {
 	uint8_t mac[6];
 	mac[0] = (uint8_t)((high >> 8) & 0xFF);
@@ -227,8 +502,17 @@ static void format_mac_address(uint32_t low, uint32_t high, char *buffer, size_t
 	mac[4] = (uint8_t)((low >> 8) & 0xFF);
 	mac[5] = (uint8_t)(low & 0xFF);
 
-	snprintf(buffer, size, "%02X:%02X:%02X:%02X:%02X:%02X",
-			 mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+	if (size >= MAC_STRING_LEN)
+	{
+		mac_format(mac, ':', buffer);
+		return;
+	}
+	if (size == 0)
+		return;
+	char text[MAC_STRING_LEN];
+	mac_format(mac, ':', text);
+	memcpy(buffer, text, size - 1);
+	buffer[size - 1] = '\0';
 }
 
 bool esp32_check_port_format(const char *port)
@@ -242,78 +526,654 @@ void esp32_print_mac(const char *mac_str)
 		printf("%s\n", mac_str);
 }
 
-bool esp32_get_mac_from_port(const char *port_name, char *mac_buf, size_t buf_size)
+static bool is_mac_string(const char *text)
+{
+	if (strlen(text) != 17)
+		return false;
+	for (int i = 0; i < 17; i++)
+	{
+		bool ok = (i % 3 == 2) ? (text[i] == ':') : (isxdigit((unsigned char)text[i]) != 0);
+		if (!ok)
+			return false;
+	}
+	return true;
+}
+
+static void copy_mac_upper(const char *src, char *mac_buf, size_t buf_size)
+{
+	size_t i = 0;
+	for (; src[i] && i + 1 < buf_size; i++)
+	{
+		mac_buf[i] = (char)toupper((unsigned char)src[i]);
+	}
+	if (buf_size > 0)
+		mac_buf[i] = '\0';
+}
+
+// Chave do cache a partir do descritor USB, sem abrir a porta. Portas sem número de série
+// (CH340) ou com série genérica (CP210x de fábrica usa "0001") não são cacheadas.
+static bool cache_port_key(const char *port_name, char *key, size_t size, char *native_mac, size_t mac_size)
 {
 	struct sp_port *port;
 	if (sp_get_port_by_name(port_name, &port) != SP_OK)
 		return false;
-	if (sp_open(port, SP_MODE_READ_WRITE) != SP_OK)
+
+	bool ok = false;
+	int vid = 0;
+	int pid = 0;
+	if (sp_get_port_transport(port) == SP_TRANSPORT_USB &&
+		sp_get_port_usb_vid_pid(port, &vid, &pid) == SP_OK)
 	{
-		sp_free_port(port);
+		const char *serial = sp_get_port_usb_serial(port);
+		const char *product = sp_get_port_usb_product(port);
+
+		if (serial && strlen(serial) >= CACHE_SERIAL_MIN_LEN)
+		{
+			snprintf(key, size, "%04X:%04X:%s:%s", (unsigned)vid, (unsigned)pid, serial, product ? product : "");
+			for (char *c = key; *c; c++)
+			{
+				if (*c == '\t' || *c == '\n' || *c == '\r')
+					*c = '_';
+			}
+			ok = true;
+
+			// USB-JTAG nativo (C3/S3/C6) já publica o MAC como número de série.
+			if (native_mac && vid == USB_VID_ESPRESSIF && is_mac_string(serial))
+			{
+				copy_mac_upper(serial, native_mac, mac_size);
+			}
+		}
+	}
+	sp_free_port(port);
+	return ok;
+}
+
+void esp32_cache_enable(bool enabled)
+{
+	cache_enabled = enabled;
+}
+
+bool esp32_cache_lookup(const char *port_name, char *mac_buf, size_t buf_size, bool *native_out)
+{
+	char key[CACHE_KEY_MAX];
+	char native_mac[18] = {0};
+	char path[CACHE_PATH_MAX];
+
+	if (native_out)
+		*native_out = false;
+	if (!esp32_check_port_format(port_name) || !mac_buf ||
+		!cache_port_key(port_name, key, sizeof(key), native_mac, sizeof(native_mac)))
+		return false;
+
+	if (native_mac[0] != '\0')
+	{
+		snprintf(mac_buf, buf_size, "%s", native_mac);
+		if (native_out)
+			*native_out = true;
+		return true;
+	}
+
+	if (!platform_cache_path(CACHE_FILE_NAME, path, sizeof(path)))
 		return false;
+
+	FILE *file = fopen(path, "r");
+	if (!file)
+		return false;
+
+	char line[CACHE_LINE_MAX];
+	bool found = false;
+	while (!found && fgets(line, sizeof(line), file))
+	{
+		char *sep = strrchr(line, '\t');
+		if (!sep)
+			continue;
+		*sep = '\0';
+		char *mac = sep + 1;
+		mac[strcspn(mac, "\r\n")] = '\0';
+
+		if (strcmp(line, key) == 0 && is_mac_string(mac))
+		{
+			snprintf(mac_buf, buf_size, "%s", mac);
+			found = true;
+		}
 	}
+	fclose(file);
+	return found;
+}
+
+static void cache_store(const char *port_name, const char *mac)
+{
+	static atomic_uint counter = 0;
+	char key[CACHE_KEY_MAX];
+	char native_mac[18] = {0};
+	char path[CACHE_PATH_MAX];
+	char tmp_path[CACHE_PATH_MAX + 32];
 
-	sp_set_baudrate(port, SERIAL_BAUDRATE);
-	sp_set_flowcontrol(port, SP_FLOWCONTROL_NONE);
-	sp_set_bits(port, 8);
-	sp_set_parity(port, SP_PARITY_NONE);
-	sp_set_stopbits(port, 1);
+	if (!is_mac_string(mac) ||
+		!cache_port_key(port_name, key, sizeof(key), native_mac, sizeof(native_mac)) ||
+		native_mac[0] != '\0' || !platform_cache_path(CACHE_FILE_NAME, path, sizeof(path)))
+		return;
 
-	sp_flush(port, SP_BUF_BOTH);
+	snprintf(tmp_path, sizeof(tmp_path), "%s.%d.%u.tmp", path, platform_process_id(), atomic_fetch_add(&counter, 1u));
+	FILE *out = fopen(tmp_path, "w");
+	if (!out)
+		return;
 
-	bool sync_success = perform_chip_sync(port, ATTEMPTS_SYNC_FAST);
+	// Mesmo adaptador (VID:PID:série) com descritor diferente invalida a entrada antiga.
+	size_t id_len = strcspn(key, ":") + 1;
+	id_len += strcspn(key + id_len, ":") + 1;
+	id_len += strcspn(key + id_len, ":") + 1;
 
-	if (!sync_success)
+	FILE *in = fopen(path, "r");
+	if (in)
 	{
-		if (strstr(port_name, "ACM"))
+		char line[CACHE_LINE_MAX];
+		while (fgets(line, sizeof(line), in))
 		{
-			reset_strategy_usb_native(port);
+			if (strncmp(line, key, id_len) != 0)
+				fputs(line, out);
 		}
-		else
+		fclose(in);
+	}
+	fprintf(out, "%s\t%s\n", key, mac);
+
+	if (fclose(out) != 0 || !platform_replace_file(tmp_path, path))
+	{
+		remove(tmp_path);
+	}
+}
+
+esp32_session_t *esp32_session_open(const char *port_name)
+{
+	if (!esp32_check_port_format(port_name) || strlen(port_name) >= ESP32_PORT_NAME_MAX)
+		return NULL;
+
+	esp32_session_t *session = calloc(1, sizeof(esp32_session_t));
+	if (!session)
+		return NULL;
+
+	// Porta ocupada por outro processo: desiste na hora em vez de disputar DTR/RTS.
+	if (!platform_lock_try(port_name, &session->lock))
+	{
+		free(session);
+		return NULL;
+	}
+	INSTR_BEGIN(t_open);
+	session->opened_ns = platform_monotonic_ns();
+	session->ring = ring_device(port_name);
+	enum sp_return opened = sp_get_port_by_name(port_name, &session->port);
+	if (opened == SP_OK && (opened = sp_open(session->port, SP_MODE_READ_WRITE)) != SP_OK)
+	{
+		sp_free_port(session->port);
+	}
+	ring_event(session->ring, RING_ESP32_OPEN, opened);
+	if (opened != SP_OK)
+	{
+		platform_lock_release(session->lock);
+		free(session);
+		return NULL;
+	}
+	snprintf(session->name, sizeof(session->name), "%s", port_name);
+	session->trace = trace_channel(TRACE_DEVICE_ESP32, port_name);
+
+	sp_set_baudrate(session->port, SERIAL_BAUDRATE);
+	session->baudrate = SERIAL_BAUDRATE;
+	sp_set_flowcontrol(session->port, SP_FLOWCONTROL_NONE);
+	sp_set_bits(session->port, 8);
+	sp_set_parity(session->port, SP_PARITY_NONE);
+	sp_set_stopbits(session->port, 1);
+
+	slip_decoder_init(&session->decoder);
+	session_flush(session, SP_BUF_BOTH);
+	session->pacing.seed = (uint32_t)platform_monotonic_ns() | 1u;
+	session->metrics = metrics_series(port_name);
+#ifdef TTCC_INSTRUMENT
+	session->stats = instr_device(port_name);
+#endif
+	INSTR_END(session->stats, PHASE_ESP32_OPEN, t_open);
+	return session;
+}
+
+// Sessão sem porta: toda a E/S vem da captura, nenhuma linha de controle é acionada.
+esp32_session_t *esp32_session_replay(const char *trace_path, const char *port_name, bool realtime)
+{
+	esp32_session_t *session = calloc(1, sizeof(esp32_session_t));
+	if (!session)
+		return NULL;
+
+	session->replay = trace_replay_open(trace_path, TRACE_DEVICE_ESP32, port_name, realtime);
+	if (!session->replay)
+	{
+		free(session);
+		return NULL;
+	}
+	snprintf(session->name, sizeof(session->name), "%s", trace_replay_name(session->replay));
+	session->ring = ring_device(session->name);
+	slip_decoder_init(&session->decoder);
+#ifdef TTCC_INSTRUMENT
+	session->stats = instr_device(session->name);
+#endif
+	return session;
+}
+
+void esp32_session_close(esp32_session_t *session)
+{
+	if (!session)
+		return;
+	if (session->port)
+	{
+		sp_close(session->port);
+		sp_free_port(session->port);
+	}
+	trace_replay_close(session->replay);
+	platform_lock_release(session->lock);
+	slip_buffer_free(&session->tx);
+	slip_decoder_free(&session->decoder);
+	free(session);
+}
+
+const char *esp32_session_port_name(const esp32_session_t *session)
+{
+	return session ? session->name : NULL;
+}
+
+bool esp32_session_sync(esp32_session_t *session)
+{
+	if (!session)
+		return false;
+
+	INSTR_BEGIN(t_fast);
+	session->synced = perform_chip_sync(session, DEADLINE_SYNC_FAST_MS);
+	INSTR_END(session->stats, PHASE_ESP32_SYNC_FAST, t_fast);
+
+	if (!session->synced)
+	{
+		INSTR_BEGIN(t_reset);
+		ring_event(session->ring, RING_ESP32_RESET, strstr(session->name, "ACM") != NULL);
+		metrics_count(session->metrics, METRIC_RESETS, 1);
+		if (session->port && strstr(session->name, "ACM"))
+		{
+			reset_strategy_usb_native(session->port);
+		}
+		else if (session->port)
+		{
+			reset_strategy_classic(session->port);
+		}
+		session_flush(session, SP_BUF_BOTH);
+		INSTR_END(session->stats, PHASE_ESP32_RESET, t_reset);
+
+		INSTR_BEGIN(t_full);
+		session->synced = perform_chip_sync(session, DEADLINE_SYNC_FULL_MS);
+		INSTR_END(session->stats, PHASE_ESP32_SYNC_FULL, t_full);
+	}
+	metrics_count(session->metrics, METRIC_FAILURES, !session->synced);
+	return session->synced;
+}
+
+static const ChipFamily *chip_from_magic(uint32_t magic)
+{
+	for (size_t i = 0; i < sizeof(chip_families) / sizeof(chip_families[0]); i++)
+	{
+		for (int m = 0; m < CHIP_MAGIC_MAX && chip_families[i].magic[m] != 0; m++)
 		{
-			reset_strategy_classic(port);
+			if (chip_families[i].magic[m] == magic)
+				return &chip_families[i];
 		}
-		sp_flush(port, SP_BUF_BOTH);
-		sync_success = perform_chip_sync(port, ATTEMPTS_SYNC_FULL);
 	}
+	return NULL;
+}
 
-	if (sync_success)
+// Uma única leitura de registrador identifica a família; o resultado fica na sessão.
+static const ChipFamily *session_chip(esp32_session_t *session)
+{
+	uint32_t magic = 0;
+	if (!session->chip)
 	{
-		sp_flush(port, SP_BUF_INPUT);
-		uint32_t mac_low = read_efuse_register(port, REG_MAC_ADDR_LOW);
-		uint32_t mac_high = read_efuse_register(port, REG_MAC_ADDR_HIGH);
-		format_mac_address(mac_low, mac_high, mac_buf, buf_size);
+		session_flush(session, SP_BUF_INPUT);
+		if (read_efuse_register(session, REG_CHIP_MAGIC, &magic))
+			session->chip = chip_from_magic(magic);
 	}
+	return session->chip;
+}
 
-	sp_close(port);
-	sp_free_port(port);
-	return sync_success;
+uint32_t esp32_session_rtt_us(const esp32_session_t *session)
+{
+	return session ? session->pacing.srtt_us : 0;
 }
 
-bool esp32_find_any_mac(char *mac_buf, size_t buf_size)
+const char *esp32_session_chip_name(esp32_session_t *session)
 {
-	struct sp_port **ports;
-	if (sp_list_ports(&ports) != SP_OK)
+	if (!session || !session->synced)
+		return NULL;
+	const ChipFamily *chip = session_chip(session);
+	return chip ? chip->name : "desconhecido";
+}
+
+bool esp32_session_read_mac(esp32_session_t *session, char *mac_buf, size_t buf_size)
+{
+	if (!session || !session->synced || !mac_buf)
 		return false;
 
-	bool found = false;
-	for (int i = 0; ports[i]; i++)
+	uint32_t mac_low = 0;
+	uint32_t mac_high = 0;
+
+	INSTR_BEGIN(t_efuse);
+	const ChipFamily *chip = session_chip(session);
+	session_flush(session, SP_BUF_INPUT);
+	bool ok = chip &&
+			  read_efuse_register(session, chip->efuse_base + chip->mac_offset, &mac_low) &&
+			  read_efuse_register(session, chip->efuse_base + chip->mac_offset + 4, &mac_high);
+	INSTR_END(session->stats, PHASE_ESP32_EFUSE, t_efuse);
+	if (!ok)
+	{
+		metrics_count(session->metrics, METRIC_FAILURES, 1);
+		session->synced = false;
+		return false;
+	}
+	// A sondagem vai da abertura da porta ao primeiro MAC lido na sessão.
+	if (!session->probed)
+	{
+		metrics_observe(session->metrics, METRIC_ESP32_PROBE, platform_monotonic_ns() - session->opened_ns);
+		session->probed = true;
+	}
+	esp32_format_mac(mac_low, mac_high, mac_buf, buf_size);
+	if (cache_enabled && !session->replay)
+	{
+		cache_store(session->name, mac_buf);
+	}
+	return true;
+}
+
+bool esp32_session_read_reg(esp32_session_t *session, uint32_t address, uint32_t *value)
+{
+	if (!session || !session->synced || !value)
+		return false;
+	return read_efuse_register(session, address, value);
+}
+
+// O ROM responde na taxa antiga; a porta só muda depois da confirmação.
+bool esp32_session_set_baudrate(esp32_session_t *session, int baudrate)
+{
+	if (!session || !session->synced || baudrate <= 0)
+		return false;
+
+	uint8_t payload[8] = {0};
+	put_le32(payload, (uint32_t)baudrate);
+	if (!command_execute(session, CMD_CHANGE_BAUDRATE, payload, sizeof(payload)))
+		return false;
+
+	trace_record(session->trace, TRACE_BAUD, baudrate, NULL, 0, NULL, 0);
+	ring_event(session->ring, RING_ESP32_BAUD, baudrate);
+	if (session->port)
 	{
-		char *name = sp_get_port_name(ports[i]);
-		bool candidate = (strstr(name, "USB") || strstr(name, "usb") ||
-						  strstr(name, "ACM") || strstr(name, "acm") ||
-						  strstr(name, "COM") || strstr(name, "slab") ||
-						  strstr(name, "wch"));
+		sp_set_baudrate(session->port, baudrate);
+		session->baudrate = baudrate;
+		platform_sleep_ms(DELAY_BAUD_SWITCH_MS);
+	}
+	session_flush(session, SP_BUF_BOTH);
+	return true;
+}
+
+bool esp32_session_flash_attach(esp32_session_t *session, uint32_t flash_size)
+{
+	if (!session || !session->synced)
+		return false;
+
+	uint8_t attach[8] = {0};
+	uint8_t params[24] = {0};
+	put_le32(params + 4, flash_size);
+	put_le32(params + 8, FLASH_BLOCK_SIZE);
+	put_le32(params + 12, FLASH_SECTOR_SIZE);
+	put_le32(params + 16, FLASH_PAGE_SIZE);
+	put_le32(params + 20, FLASH_STATUS_MASK);
+
+	return command_execute(session, CMD_SPI_ATTACH, attach, sizeof(attach)) &&
+		   command_execute(session, CMD_SPI_SET_PARAMS, params, sizeof(params));
+}
+
+static bool flash_request(esp32_session_t *session, uint32_t address, uint32_t length)
+{
+	uint8_t payload[8];
+	put_le32(payload, address);
+	put_le32(payload + 4, length);
+	return slip_write_frame(session, CMD_READ_FLASH_SLOW, payload, sizeof(payload), 0);
+}
+
+static int timeout_per_mb(int ms_per_mb, uint32_t size)
+{
+	uint64_t timeout = (uint64_t)ms_per_mb * size / (1024u * 1024u);
+	return timeout < TIMEOUT_FRAME_MS ? TIMEOUT_FRAME_MS : (int)timeout;
+}
 
-		if (candidate)
+static bool flash_md5(esp32_session_t *session, uint32_t address, uint32_t length, char hex_out[MD5_HEX_LEN])
+{
+	uint8_t payload[16] = {0};
+	uint8_t digest[MD5_HEX_LEN - 1];
+	put_le32(payload, address);
+	put_le32(payload + 4, length);
+
+	if (!slip_write_frame(session, CMD_SPI_FLASH_MD5, payload, sizeof(payload), 0) ||
+		!command_response(session, CMD_SPI_FLASH_MD5, digest, sizeof(digest), timeout_per_mb(TIMEOUT_MD5_MS_PER_MB, length)))
+		return false;
+
+	// O ROM devolve o MD5 em hexadecimal (ASCII minúsculo).
+	memcpy(hex_out, digest, sizeof(digest));
+	hex_out[MD5_HEX_LEN - 1] = '\0';
+	return true;
+}
+
+// READ_FLASH_SLOW devolve só 64 bytes por comando; mantemos FLASH_WINDOW pedidos em voo
+// para esconder a latência. As respostas não trazem o endereço, então cada janela de
+// FLASH_VERIFY_CHUNK é conferida pelo MD5 calculado na placa antes de ir para out.
+static bool flash_read_chunk(esp32_session_t *session, uint32_t address, uint32_t length, uint8_t *chunk)
+{
+	uint32_t received = 0;
+	uint32_t requested = 0;
+
+	while (received < length)
+	{
+		while (requested < length && requested - received < FLASH_WINDOW * FLASH_BLOCK_SLOW)
+		{
+			uint32_t block = length - requested < FLASH_BLOCK_SLOW ? length - requested : FLASH_BLOCK_SLOW;
+			if (!flash_request(session, address + requested, block))
+				return false;
+			requested += block;
+		}
+
+		uint32_t block = length - received < FLASH_BLOCK_SLOW ? length - received : FLASH_BLOCK_SLOW;
+		if (!command_response(session, CMD_READ_FLASH_SLOW, chunk + received, block, TIMEOUT_FRAME_MS))
+			return false;
+		received += block;
+	}
+
+	uint8_t digest[MD5_DIGEST_LEN];
+	char local_hex[MD5_HEX_LEN];
+	char remote_hex[MD5_HEX_LEN];
+	md5_context_t md5;
+
+	md5_init(&md5);
+	md5_update(&md5, chunk, length);
+	md5_final(&md5, digest);
+	md5_to_hex(digest, local_hex);
+
+	return flash_md5(session, address, length, remote_hex) && strcmp(local_hex, remote_hex) == 0;
+}
+
+bool esp32_session_dump_flash(esp32_session_t *session, uint32_t offset, uint32_t size, FILE *out,
+							  esp32_progress_fn progress, void *user)
+{
+	if (!session || !session->synced || !out)
+		return false;
+
+	uint8_t chunk[FLASH_VERIFY_CHUNK];
+	uint32_t done = 0;
+	int failures = 0;
+
+	while (done < size)
+	{
+		uint32_t length = size - done < FLASH_VERIFY_CHUNK ? size - done : FLASH_VERIFY_CHUNK;
+		if (!flash_read_chunk(session, offset + done, length, chunk))
+		{
+			// Janela perdida ou corrompida: descarta o que está em voo e relê a mesma janela.
+			INSTR_COUNT(session->stats, COUNTER_RETRIES, 1);
+			metrics_count(session->metrics, METRIC_RETRIES, 1);
+			ring_event(session->ring, RING_ESP32_FLASH_RETRY, (int32_t)(offset + done));
+			if (++failures > ATTEMPTS_FLASH_CHUNK)
+				return false;
+			platform_sleep_ms(DELAY_POST_RESET_MS);
+			session_flush(session, SP_BUF_INPUT);
+			continue;
+		}
+
+		if (fwrite(chunk, 1, length, out) != length)
+			return false;
+		done += length;
+		failures = 0;
+		if (progress)
+			progress(done, size, user);
+	}
+	return fflush(out) == 0;
+}
+
+static uint32_t flash_checksum(const uint8_t *data, size_t len)
+{
+	uint8_t checksum = FLASH_CHECKSUM_SEED;
+	for (size_t i = 0; i < len; i++)
+	{
+		checksum ^= data[i];
+	}
+	return checksum;
+}
+
+// Grava uma imagem já comprimida (deflate/zlib) e confere o MD5 da região gravada.
+// O FLASH_DEFL_END não é enviado: no ROM ele sai do bootloader antes da verificação.
+bool esp32_session_flash_deflated(esp32_session_t *session, uint32_t offset, const esp32_flash_image_t *image,
+								  esp32_progress_fn progress, void *user)
+{
+	if (!session || !session->synced || !image || !image->deflated || image->deflated_size == 0)
+		return false;
+
+	uint32_t blocks = (uint32_t)((image->deflated_size + FLASH_WRITE_SIZE - 1) / FLASH_WRITE_SIZE);
+	uint32_t erase_size = (image->raw_size + FLASH_WRITE_SIZE - 1) / FLASH_WRITE_SIZE * FLASH_WRITE_SIZE;
+	const ChipFamily *chip = session_chip(session);
+	if (!chip)
+		return false;
+
+	// ROMs depois do ESP32 clássico esperam um quinto campo (criptografia, sempre 0 aqui).
+	uint8_t begin[20] = {0};
+	uint16_t begin_len = chip->begin_has_encrypted ? 20 : 16;
+	put_le32(begin, erase_size);
+	put_le32(begin + 4, blocks);
+	put_le32(begin + 8, FLASH_WRITE_SIZE);
+	put_le32(begin + 12, offset);
+
+	// O ROM apaga a região inteira antes de responder ao BEGIN.
+	if (!slip_write_frame(session, CMD_FLASH_DEFL_BEGIN, begin, begin_len, 0) ||
+		!command_response(session, CMD_FLASH_DEFL_BEGIN, NULL, 0, timeout_per_mb(TIMEOUT_ERASE_MS_PER_MB, erase_size)))
+		return false;
+
+	uint8_t packet[FLASH_DATA_HEADER + FLASH_WRITE_SIZE] = {0};
+	for (uint32_t seq = 0; seq < blocks; seq++)
+	{
+		size_t start = (size_t)seq * FLASH_WRITE_SIZE;
+		size_t length = image->deflated_size - start < FLASH_WRITE_SIZE ? image->deflated_size - start : FLASH_WRITE_SIZE;
+
+		put_le32(packet, (uint32_t)length);
+		put_le32(packet + 4, seq);
+		memcpy(packet + FLASH_DATA_HEADER, image->deflated + start, length);
+
+		if (!slip_write_frame(session, CMD_FLASH_DEFL_DATA, packet, (uint16_t)(FLASH_DATA_HEADER + length),
+							  flash_checksum(image->deflated + start, length)) ||
+			!command_response(session, CMD_FLASH_DEFL_DATA, NULL, 0, TIMEOUT_FLASH_DATA_MS))
+			return false;
+
+		if (progress)
+			progress(start + length, image->deflated_size, user);
+	}
+
+	char remote_md5[MD5_HEX_LEN];
+	return flash_md5(session, offset, image->raw_size, remote_md5) &&
+		   strcmp(remote_md5, image->md5) == 0;
+}
+
+// Pulso em EN (via RTS) para sair do bootloader e executar o firmware.
+void esp32_session_hard_reset(esp32_session_t *session)
+{
+	if (!session)
+		return;
+	if (session->port)
+	{
+		sp_set_dtr(session->port, SP_DTR_OFF);
+		sp_set_rts(session->port, SP_RTS_ON);
+		platform_sleep_ms(DELAY_HARD_RESET_MS);
+		sp_set_rts(session->port, SP_RTS_OFF);
+	}
+	session->synced = false;
+}
+
+bool esp32_session_dump_efuse(esp32_session_t *session, FILE *out)
+{
+	if (!session || !session->synced || !out)
+		return false;
+
+	const ChipFamily *chip = session_chip(session);
+	if (!chip)
+		return false;
+
+	fprintf(out, "# %s\n", chip->name);
+	for (int b = 0; b < EFUSE_BLOCKS_MAX && chip->efuse[b].name; b++)
+	{
+		const EfuseBlock *block = &chip->efuse[b];
+		for (int w = 0; w < block->words; w++)
 		{
-			if (esp32_get_mac_from_port(name, mac_buf, buf_size))
+			if (w % EFUSE_ROW_WORDS == 0)
 			{
-				found = true;
-				break;
+				if (w > 0)
+					fprintf(out, "\n");
+				if (block->words > EFUSE_ROW_WORDS)
+					fprintf(out, "%s+%03X", block->name, (unsigned)(w * 4));
+				else
+					fprintf(out, "%s", block->name);
 			}
+
+			uint32_t value = 0;
+			if (!read_efuse_register(session, chip->efuse_base + block->offset + (uint32_t)w * 4, &value))
+				return false;
+			fprintf(out, " %08X", (unsigned)value);
 		}
+		fprintf(out, "\n");
 	}
-	sp_free_port_list(ports);
-	return found;
+	return fflush(out) == 0;
+}
+
+// Só o MAC do USB-JTAG nativo dispensa a placa: o mesmo adaptador FTDI/CP210x pode estar em outra.
+bool esp32_get_mac_from_port(const char *port_name, char *mac_buf, size_t buf_size)
+{
+	bool native = false;
+	if (cache_enabled && esp32_cache_lookup(port_name, mac_buf, buf_size, &native) && native)
+		return true;
+
+	esp32_session_t *session = esp32_session_open(port_name);
+	if (!session)
+		return false;
+
+	bool success = esp32_session_sync(session) && esp32_session_read_mac(session, mac_buf, buf_size);
+
+	esp32_session_close(session);
+	return success;
+}
+
+bool esp32_find_any_mac(char *mac_buf, size_t buf_size)
+{
+	char names[ESP32_MAX_PORTS][ESP32_PORT_NAME_MAX];
+	int count = esp32_list_ports(names, ESP32_MAX_PORTS);
+
+	for (int i = 0; i < count; i++)
+	{
+		if (esp32_get_mac_from_port(names[i], mac_buf, buf_size))
+		{
+			return true;
+		}
+	}
+	return false;
 }
@@ -3,10 +3,62 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define ESP32_PORT_NAME_MAX 64
+#define ESP32_MAX_PORTS 32
+
+typedef struct esp32_session esp32_session_t;
+typedef void (*esp32_progress_fn)(size_t done, size_t total, void *user);
+
+typedef struct
+{
+	const uint8_t *deflated;
+	size_t deflated_size;
+	uint32_t raw_size;
+	char md5[33];
+} esp32_flash_image_t;
+
+typedef struct
+{
+	char name[ESP32_PORT_NAME_MAX];
+	uint32_t generation;
+	bool added;
+} esp32_port_change_t;
 
 bool esp32_check_port_format(const char *port);
 bool esp32_get_mac_from_port(const char *port, char *mac_buf, size_t buf_size);
 bool esp32_find_any_mac(char *mac_buf, size_t buf_size);
 void esp32_print_mac(const char *mac_str);
+void esp32_format_mac(uint32_t low, uint32_t high, char *buffer, size_t size);
+
+int esp32_list_ports(char (*names)[ESP32_PORT_NAME_MAX], int max_ports);
+uint32_t esp32_ports_generation(void);
+int esp32_ports_changed_since(uint32_t generation, esp32_port_change_t *changes_out, int max_changes);
+
+void esp32_cache_enable(bool enabled);
+// native_out: MAC publicado pelo próprio chip (USB-JTAG). Fora isso a chave é do adaptador
+// USB-serial, que pode ter trocado de placa: o valor precisa ser conferido antes de gravar.
+bool esp32_cache_lookup(const char *port_name, char *mac_buf, size_t buf_size, bool *native_out);
+
+esp32_session_t *esp32_session_open(const char *port_name);
+esp32_session_t *esp32_session_replay(const char *trace_path, const char *port_name, bool realtime);
+void esp32_session_close(esp32_session_t *session);
+const char *esp32_session_port_name(const esp32_session_t *session);
+bool esp32_session_sync(esp32_session_t *session);
+bool esp32_session_read_mac(esp32_session_t *session, char *mac_buf, size_t buf_size);
+const char *esp32_session_chip_name(esp32_session_t *session);
+uint32_t esp32_session_rtt_us(const esp32_session_t *session);
+bool esp32_session_read_reg(esp32_session_t *session, uint32_t address, uint32_t *value);
+bool esp32_session_set_baudrate(esp32_session_t *session, int baudrate);
+
+bool esp32_session_flash_attach(esp32_session_t *session, uint32_t flash_size);
+bool esp32_session_dump_flash(esp32_session_t *session, uint32_t offset, uint32_t size, FILE *out,
+							  esp32_progress_fn progress, void *user);
+bool esp32_session_dump_efuse(esp32_session_t *session, FILE *out);
+bool esp32_session_flash_deflated(esp32_session_t *session, uint32_t offset, const esp32_flash_image_t *image,
+								  esp32_progress_fn progress, void *user);
+void esp32_session_hard_reset(esp32_session_t *session);
 
 #endif
@@ -0,0 +1,407 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "platform.h"
+#include "libledger.h"
+
+#define LEDGER_MAGIC "TTLG"
+#define LEDGER_INDEX_MAGIC "TTLI"
+#define LEDGER_VERSION 1
+#define LEDGER_HEADER_SIZE 64
+#define LEDGER_RECORD_SIZE 64
+#define LEDGER_GROW_RECORDS 4096
+#define LEDGER_INDEX_SLOTS_MIN 1024
+#define LEDGER_LOCK_WAIT_MS 2000
+#define LEDGER_FILE_PATH_MAX 512
+#define LEDGER_LOCK_PREFIX "ledger-"
+
+#define TABLE_ESP 0
+#define TABLE_DS4 1
+#define TABLE_COUNT 2
+
+// Arquivos na ordem de bytes do host; cabeçalho e registros têm 64 bytes.
+typedef struct
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t reserved;
+	uint64_t count;
+	uint8_t pad[40];
+} LedgerHeader;
+
+typedef struct
+{
+	int64_t time;
+	int32_t result;
+	uint32_t check;
+	uint8_t esp_mac[LEDGER_MAC_LEN];
+	uint8_t ds4_mac[LEDGER_MAC_LEN];
+	char ds4_path[LEDGER_PATH_MAX];
+	uint8_t reserved[4];
+} LedgerEntry;
+
+// Índice: duas tabelas de endereçamento aberto (MAC do ESP32 e MAC do controle) com
+// o número do registro + 1; cada chave aponta para o pareamento bem-sucedido mais recente.
+typedef struct
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t slots;
+	uint32_t reserved;
+	uint64_t indexed;
+	uint64_t used[TABLE_COUNT];
+	uint8_t pad[24];
+} IndexHeader;
+
+_Static_assert(sizeof(LedgerHeader) == LEDGER_HEADER_SIZE, "cabeçalho do ledger");
+_Static_assert(sizeof(LedgerEntry) == LEDGER_RECORD_SIZE, "registro do ledger");
+_Static_assert(sizeof(IndexHeader) == LEDGER_HEADER_SIZE, "cabeçalho do índice");
+
+struct ledger
+{
+	platform_map_t *data;
+	platform_map_t *index;
+	char lock_key[sizeof(LEDGER_LOCK_PREFIX) + LEDGER_FILE_PATH_MAX];
+};
+
+static uint64_t mac_hash(const uint8_t *mac)
+{
+	uint64_t hash = 0xCBF29CE484222325ull;
+	for (int i = 0; i < LEDGER_MAC_LEN; i++)
+	{
+		hash ^= mac[i];
+		hash *= 0x100000001B3ull;
+	}
+	return hash ^ (hash >> 29);
+}
+
+static uint32_t entry_check(const LedgerEntry *entry)
+{
+	LedgerEntry copy = *entry;
+	copy.check = 0;
+	const uint8_t *bytes = (const uint8_t *)&copy;
+	uint32_t hash = 0x811C9DC5u;
+	for (size_t i = 0; i < sizeof(copy); i++)
+	{
+		hash ^= bytes[i];
+		hash *= 0x01000193u;
+	}
+	return hash ? hash : 1;
+}
+
+static bool mac_is_zero(const uint8_t *mac)
+{
+	static const uint8_t zero[LEDGER_MAC_LEN] = {0};
+	return memcmp(mac, zero, LEDGER_MAC_LEN) == 0;
+}
+
+static LedgerHeader *data_header(const ledger_t *ledger)
+{
+	return platform_map_data(ledger->data);
+}
+
+static LedgerEntry *data_entries(const ledger_t *ledger)
+{
+	return (LedgerEntry *)((uint8_t *)platform_map_data(ledger->data) + LEDGER_HEADER_SIZE);
+}
+
+static uint64_t data_capacity(const ledger_t *ledger)
+{
+	return (platform_map_size(ledger->data) - LEDGER_HEADER_SIZE) / LEDGER_RECORD_SIZE;
+}
+
+static IndexHeader *index_header(const ledger_t *ledger)
+{
+	return platform_map_data(ledger->index);
+}
+
+static uint32_t *index_table(const ledger_t *ledger, int table)
+{
+	uint8_t *base = (uint8_t *)platform_map_data(ledger->index) + LEDGER_HEADER_SIZE;
+	return (uint32_t *)base + (size_t)table * index_header(ledger)->slots;
+}
+
+static size_t index_bytes(uint32_t slots)
+{
+	return LEDGER_HEADER_SIZE + (size_t)TABLE_COUNT * slots * sizeof(uint32_t);
+}
+
+// A trava entre processos é só tentativa; espera aqui até LEDGER_LOCK_WAIT_MS.
+static bool ledger_lock(const ledger_t *ledger, platform_lock_t **lock)
+{
+	for (int waited = 0; waited <= LEDGER_LOCK_WAIT_MS; waited++)
+	{
+		if (platform_lock_try(ledger->lock_key, lock))
+			return true;
+		platform_sleep_ms(1);
+	}
+	return false;
+}
+
+// Outro processo pode ter crescido os arquivos depois do nosso mapeamento.
+static bool ledger_sync(ledger_t *ledger)
+{
+	uint64_t count = data_header(ledger)->count;
+	if (count > data_capacity(ledger) &&
+		!platform_map_grow(ledger->data, LEDGER_HEADER_SIZE + count * LEDGER_RECORD_SIZE))
+		return false;
+
+	size_t needed = index_bytes(index_header(ledger)->slots);
+	if (needed > platform_map_size(ledger->index) && !platform_map_grow(ledger->index, needed))
+		return false;
+	return true;
+}
+
+static void index_insert(ledger_t *ledger, int table, const uint8_t *mac, uint64_t record)
+{
+	IndexHeader *header = index_header(ledger);
+	uint32_t *slots = index_table(ledger, table);
+	const LedgerEntry *entries = data_entries(ledger);
+	uint64_t mask = header->slots - 1;
+
+	for (uint64_t i = mac_hash(mac) & mask;; i = (i + 1) & mask)
+	{
+		if (slots[i] == 0)
+		{
+			slots[i] = (uint32_t)(record + 1);
+			header->used[table]++;
+			return;
+		}
+		const LedgerEntry *entry = &entries[slots[i] - 1];
+		if (memcmp(table == TABLE_ESP ? entry->esp_mac : entry->ds4_mac, mac, LEDGER_MAC_LEN) == 0)
+		{
+			slots[i] = (uint32_t)(record + 1);
+			return;
+		}
+	}
+}
+
+static void index_entry(ledger_t *ledger, uint64_t record)
+{
+	const LedgerEntry *entry = &data_entries(ledger)[record];
+	if (entry->check != entry_check(entry) || entry->result != 0)
+		return;
+	index_insert(ledger, TABLE_ESP, entry->esp_mac, record);
+	if (!mac_is_zero(entry->ds4_mac))
+		index_insert(ledger, TABLE_DS4, entry->ds4_mac, record);
+}
+
+static bool index_rebuild(ledger_t *ledger, uint32_t slots)
+{
+	if (!platform_map_grow(ledger->index, index_bytes(slots)))
+		return false;
+
+	IndexHeader *header = index_header(ledger);
+	memcpy(header->magic, LEDGER_INDEX_MAGIC, 4);
+	header->version = LEDGER_VERSION;
+	header->slots = slots;
+	memset(header->used, 0, sizeof(header->used));
+	memset(index_table(ledger, 0), 0, index_bytes(slots) - LEDGER_HEADER_SIZE);
+
+	uint64_t indexed = header->indexed < data_header(ledger)->count ? header->indexed : data_header(ledger)->count;
+	for (uint64_t i = 0; i < indexed; i++)
+		index_entry(ledger, i);
+	header->indexed = indexed;
+	return true;
+}
+
+// Indexa o que foi anexado sem índice (queda entre as duas escritas, ou índice recriado).
+static bool index_catch_up(ledger_t *ledger)
+{
+	while (index_header(ledger)->indexed < data_header(ledger)->count)
+	{
+		IndexHeader *header = index_header(ledger);
+		if ((header->used[TABLE_ESP] + 1) * 2 > header->slots || (header->used[TABLE_DS4] + 1) * 2 > header->slots)
+		{
+			if (!index_rebuild(ledger, header->slots * 2))
+				return false;
+			continue;
+		}
+		index_entry(ledger, header->indexed);
+		index_header(ledger)->indexed++;
+	}
+	return true;
+}
+
+static bool ledger_init(ledger_t *ledger)
+{
+	LedgerHeader *data = data_header(ledger);
+	if (data->magic[0] == '\0')
+	{
+		memcpy(data->magic, LEDGER_MAGIC, 4);
+		data->version = LEDGER_VERSION;
+		data->record_size = LEDGER_RECORD_SIZE;
+		data->count = 0;
+	}
+	if (memcmp(data->magic, LEDGER_MAGIC, 4) != 0 || data->version != LEDGER_VERSION ||
+		data->record_size != LEDGER_RECORD_SIZE)
+		return false;
+
+	IndexHeader *index = index_header(ledger);
+	uint32_t slots = index->slots;
+	if (memcmp(index->magic, LEDGER_INDEX_MAGIC, 4) != 0 || index->version != LEDGER_VERSION ||
+		slots < LEDGER_INDEX_SLOTS_MIN || (slots & (slots - 1)) != 0 || index->indexed > data->count)
+	{
+		index->indexed = 0;
+		if (!index_rebuild(ledger, LEDGER_INDEX_SLOTS_MIN))
+			return false;
+	}
+	return ledger_sync(ledger) && index_catch_up(ledger);
+}
+
+ledger_t *ledger_open(const char *path)
+{
+	char default_path[LEDGER_FILE_PATH_MAX];
+	char index_path[LEDGER_FILE_PATH_MAX + sizeof(".idx")];
+	if (!path)
+	{
+		if (!platform_state_path(LEDGER_FILE_NAME, default_path, sizeof(default_path)))
+			return NULL;
+		path = default_path;
+	}
+
+	ledger_t *ledger = calloc(1, sizeof(ledger_t));
+	if (!ledger)
+		return NULL;
+	// Caminho truncado apontaria para outro arquivo (e outra trava): recusa em vez de cortar.
+	int key_len = snprintf(ledger->lock_key, sizeof(ledger->lock_key), LEDGER_LOCK_PREFIX "%s", path);
+	int index_len = snprintf(index_path, sizeof(index_path), "%s.idx", path);
+	if (strlen(path) >= LEDGER_FILE_PATH_MAX || key_len < 0 || (size_t)key_len >= sizeof(ledger->lock_key) ||
+		index_len < 0 || (size_t)index_len >= sizeof(index_path))
+	{
+		free(ledger);
+		return NULL;
+	}
+
+	platform_lock_t *lock = NULL;
+	bool ok = ledger_lock(ledger, &lock);
+	if (ok)
+	{
+		ledger->data = platform_map_open(path, LEDGER_HEADER_SIZE + LEDGER_GROW_RECORDS * LEDGER_RECORD_SIZE);
+		ledger->index = platform_map_open(index_path, index_bytes(LEDGER_INDEX_SLOTS_MIN));
+		ok = ledger->data && ledger->index && ledger_init(ledger);
+		platform_lock_release(lock);
+	}
+	if (!ok)
+	{
+		ledger_close(ledger);
+		return NULL;
+	}
+	return ledger;
+}
+
+void ledger_close(ledger_t *ledger)
+{
+	if (!ledger)
+		return;
+	platform_map_close(ledger->data);
+	platform_map_close(ledger->index);
+	free(ledger);
+}
+
+static void entry_to_record(const LedgerEntry *entry, ledger_record_t *record)
+{
+	memcpy(record->esp_mac, entry->esp_mac, LEDGER_MAC_LEN);
+	memcpy(record->ds4_mac, entry->ds4_mac, LEDGER_MAC_LEN);
+	memcpy(record->ds4_path, entry->ds4_path, LEDGER_PATH_MAX);
+	record->ds4_path[LEDGER_PATH_MAX - 1] = '\0';
+	record->time = entry->time;
+	record->result = entry->result;
+}
+
+uint64_t ledger_count(ledger_t *ledger)
+{
+	platform_lock_t *lock = NULL;
+	if (!ledger || !ledger_lock(ledger, &lock))
+		return 0;
+	uint64_t count = ledger_sync(ledger) ? data_header(ledger)->count : 0;
+	platform_lock_release(lock);
+	return count;
+}
+
+// O contador só avança depois do registro completo: uma queda no meio não deixa lixo visível.
+bool ledger_append(ledger_t *ledger, const ledger_record_t *record)
+{
+	platform_lock_t *lock = NULL;
+	if (!ledger || !record || !ledger_lock(ledger, &lock))
+		return false;
+
+	bool ok = ledger_sync(ledger);
+	uint64_t count = ok ? data_header(ledger)->count : 0;
+	if (ok && count >= data_capacity(ledger))
+	{
+		ok = platform_map_grow(ledger->data, LEDGER_HEADER_SIZE + (count + LEDGER_GROW_RECORDS) * LEDGER_RECORD_SIZE);
+	}
+	if (ok)
+	{
+		LedgerEntry *entry = &data_entries(ledger)[count];
+		memset(entry, 0, sizeof(LedgerEntry));
+		entry->time = record->time ? record->time : (int64_t)time(NULL);
+		entry->result = record->result;
+		memcpy(entry->esp_mac, record->esp_mac, LEDGER_MAC_LEN);
+		memcpy(entry->ds4_mac, record->ds4_mac, LEDGER_MAC_LEN);
+		snprintf(entry->ds4_path, sizeof(entry->ds4_path), "%s", record->ds4_path);
+		entry->check = entry_check(entry);
+		data_header(ledger)->count = count + 1;
+		ok = index_catch_up(ledger);
+	}
+	platform_lock_release(lock);
+	return ok;
+}
+
+bool ledger_get(ledger_t *ledger, uint64_t index, ledger_record_t *record_out)
+{
+	platform_lock_t *lock = NULL;
+	if (!ledger || !record_out || !ledger_lock(ledger, &lock))
+		return false;
+
+	bool ok = ledger_sync(ledger) && index < data_header(ledger)->count;
+	if (ok)
+	{
+		const LedgerEntry *entry = &data_entries(ledger)[index];
+		ok = entry->check == entry_check(entry);
+		if (ok)
+			entry_to_record(entry, record_out);
+	}
+	platform_lock_release(lock);
+	return ok;
+}
+
+static bool ledger_find(ledger_t *ledger, int table, const uint8_t *mac, ledger_record_t *record_out)
+{
+	platform_lock_t *lock = NULL;
+	if (!ledger || !mac || !ledger_lock(ledger, &lock))
+		return false;
+
+	bool found = false;
+	if (ledger_sync(ledger) && index_catch_up(ledger))
+	{
+		const uint32_t *slots = index_table(ledger, table);
+		const LedgerEntry *entries = data_entries(ledger);
+		uint64_t mask = index_header(ledger)->slots - 1;
+		for (uint64_t i = mac_hash(mac) & mask; slots[i] != 0 && !found; i = (i + 1) & mask)
+		{
+			const LedgerEntry *entry = &entries[slots[i] - 1];
+			if (memcmp(table == TABLE_ESP ? entry->esp_mac : entry->ds4_mac, mac, LEDGER_MAC_LEN) == 0)
+			{
+				found = true;
+				if (record_out)
+					entry_to_record(entry, record_out);
+			}
+		}
+	}
+	platform_lock_release(lock);
+	return found;
+}
+
+bool ledger_find_esp(ledger_t *ledger, const uint8_t *esp_mac, ledger_record_t *record_out)
+{
+	return ledger_find(ledger, TABLE_ESP, esp_mac, record_out);
+}
+
+bool ledger_find_ds4(ledger_t *ledger, const uint8_t *ds4_mac, ledger_record_t *record_out)
+{
+	return ledger_find(ledger, TABLE_DS4, ds4_mac, record_out);
+}
@@ -0,0 +1,32 @@
+#ifndef LIBLEDGER_H
+#define LIBLEDGER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LEDGER_MAC_LEN 6
+#define LEDGER_PATH_MAX 32
+#define LEDGER_FILE_NAME "pairing.ledger"
+
+typedef struct ledger ledger_t;
+
+typedef struct
+{
+	uint8_t esp_mac[LEDGER_MAC_LEN];
+	uint8_t ds4_mac[LEDGER_MAC_LEN];
+	char ds4_path[LEDGER_PATH_MAX];
+	int64_t time;
+	int32_t result;
+} ledger_record_t;
+
+ledger_t *ledger_open(const char *path);
+void ledger_close(ledger_t *ledger);
+
+uint64_t ledger_count(ledger_t *ledger);
+bool ledger_append(ledger_t *ledger, const ledger_record_t *record);
+bool ledger_get(ledger_t *ledger, uint64_t index, ledger_record_t *record_out);
+
+bool ledger_find_esp(ledger_t *ledger, const uint8_t *esp_mac, ledger_record_t *record_out);
+bool ledger_find_ds4(ledger_t *ledger, const uint8_t *ds4_mac, ledger_record_t *record_out);
+
+#endif
@@ -0,0 +1,487 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <pthread.h>
+#include "platform.h"
+#include "libmacpool.h"
+
+#define MACPOOL_MAGIC "TTMP"
+#define MACPOOL_VERSION 2
+#define MACPOOL_HEADER_SIZE 64
+#define MACPOOL_RANGE_SIZE 32
+#define MACPOOL_LEASE_SIZE 16
+#define MACPOOL_LEASES_OFFSET (MACPOOL_HEADER_SIZE + MACPOOL_RANGES_MAX * MACPOOL_RANGE_SIZE)
+#define MACPOOL_BITMAP_OFFSET (MACPOOL_LEASES_OFFSET + MACPOOL_LEASES_MAX * MACPOOL_LEASE_SIZE)
+#define MACPOOL_LEASE_SET (1ull << 63)
+#define MACPOOL_LEASE_CLOCK_SLACK_S 60
+#define MACPOOL_LOCK_WAIT_MS 2000
+#define MACPOOL_FILE_PATH_MAX 512
+#define MACPOOL_LOCK_PREFIX "macpool-"
+#define MACPOOL_MULTICAST_BIT (1ull << 40)
+
+// Arquivo na ordem de bytes do host: cabeçalho, tabela de faixas, reservas em aberto e o bitmap.
+typedef struct
+{
+	char magic[4];
+	uint32_t version;
+	_Atomic uint32_t range_count;
+	uint32_t reserved;
+	uint64_t words;
+	uint8_t pad[40];
+} PoolHeader;
+
+// Faixas só são acrescentadas (sob trava); depois de publicadas, só o cursor muda.
+typedef struct
+{
+	uint64_t first;
+	uint64_t count;
+	uint64_t word;
+	_Atomic uint64_t cursor;
+} PoolRange;
+
+// MAC reservado e ainda não gravado: dono (PID) e hora, para recuperar reservas de processos mortos.
+// O dono e a hora ficam na mesma palavra para serem tomados num único CAS.
+typedef struct
+{
+	_Atomic uint64_t holder;
+	_Atomic uint64_t value;
+} PoolLease;
+
+_Static_assert(sizeof(PoolHeader) == MACPOOL_HEADER_SIZE, "cabeçalho do pool de MACs");
+_Static_assert(sizeof(PoolRange) == MACPOOL_RANGE_SIZE, "faixa do pool de MACs");
+_Static_assert(sizeof(PoolLease) == MACPOOL_LEASE_SIZE, "reserva do pool de MACs");
+
+// O remapeamento troca o endereço do mapa: quem está lendo segura a trava em modo leitura.
+struct macpool
+{
+	platform_map_t *map;
+	pthread_rwlock_t remap_lock;
+	char lock_key[sizeof(MACPOOL_LOCK_PREFIX) + MACPOOL_FILE_PATH_MAX];
+};
+
+static uint64_t mac_to_value(const uint8_t *mac)
+{
+	uint64_t value = 0;
+	for (int i = 0; i < MACPOOL_MAC_LEN; i++)
+		value = value << 8 | mac[i];
+	return value;
+}
+
+static void value_to_mac(uint64_t value, uint8_t *mac)
+{
+	for (int i = MACPOOL_MAC_LEN - 1; i >= 0; i--)
+	{
+		mac[i] = (uint8_t)value;
+		value >>= 8;
+	}
+}
+
+static uint64_t range_words(const PoolRange *range)
+{
+	return (range->count + 63) / 64;
+}
+
+static PoolHeader *pool_header(const macpool_t *pool)
+{
+	return platform_map_data(pool->map);
+}
+
+static PoolRange *pool_ranges(const macpool_t *pool)
+{
+	return (PoolRange *)((uint8_t *)platform_map_data(pool->map) + MACPOOL_HEADER_SIZE);
+}
+
+static PoolLease *pool_leases(const macpool_t *pool)
+{
+	return (PoolLease *)((uint8_t *)platform_map_data(pool->map) + MACPOOL_LEASES_OFFSET);
+}
+
+static _Atomic uint64_t *pool_bitmap(const macpool_t *pool)
+{
+	return (_Atomic uint64_t *)((uint8_t *)platform_map_data(pool->map) + MACPOOL_BITMAP_OFFSET);
+}
+
+static bool pool_lock(const macpool_t *pool, platform_lock_t **lock)
+{
+	for (int waited = 0; waited <= MACPOOL_LOCK_WAIT_MS; waited++)
+	{
+		if (platform_lock_try(pool->lock_key, lock))
+			return true;
+		platform_sleep_ms(1);
+	}
+	return false;
+}
+
+static int pool_range_count(const macpool_t *pool)
+{
+	int count = (int)atomic_load_explicit(&pool_header(pool)->range_count, memory_order_acquire);
+	return count > MACPOOL_RANGES_MAX ? 0 : count;
+}
+
+static size_t pool_needed(const macpool_t *pool, int count)
+{
+	if (count == 0)
+		return 0;
+	const PoolRange *last = &pool_ranges(pool)[count - 1];
+	return MACPOOL_BITMAP_OFFSET + (size_t)(last->word + range_words(last)) * sizeof(uint64_t);
+}
+
+// Outro processo pode ter acrescentado uma faixa (e crescido o arquivo) depois do nosso mapeamento.
+// Devolve com remap_lock em modo leitura; quem chama libera com pool_leave.
+static int pool_enter(macpool_t *pool)
+{
+	pthread_rwlock_rdlock(&pool->remap_lock);
+	int count = pool_range_count(pool);
+	if (pool_needed(pool, count) <= platform_map_size(pool->map))
+		return count;
+
+	pthread_rwlock_unlock(&pool->remap_lock);
+	pthread_rwlock_wrlock(&pool->remap_lock);
+	count = pool_range_count(pool);
+	size_t needed = pool_needed(pool, count);
+	bool ok = needed <= platform_map_size(pool->map) || platform_map_grow(pool->map, needed);
+	pthread_rwlock_unlock(&pool->remap_lock);
+
+	pthread_rwlock_rdlock(&pool->remap_lock);
+	return ok ? pool_range_count(pool) : 0;
+}
+
+static void pool_leave(macpool_t *pool)
+{
+	pthread_rwlock_unlock(&pool->remap_lock);
+}
+
+static bool pool_init(macpool_t *pool)
+{
+	PoolHeader *header = pool_header(pool);
+	if (header->magic[0] == '\0')
+	{
+		memcpy(header->magic, MACPOOL_MAGIC, 4);
+		header->version = MACPOOL_VERSION;
+		header->words = 0;
+		atomic_store_explicit(&header->range_count, 0, memory_order_release);
+	}
+	return memcmp(header->magic, MACPOOL_MAGIC, 4) == 0 && header->version == MACPOOL_VERSION;
+}
+
+static bool bit_clear(macpool_t *pool, int count, uint64_t value)
+{
+	for (int i = 0; i < count; i++)
+	{
+		const PoolRange *range = &pool_ranges(pool)[i];
+		if (value < range->first || value - range->first >= range->count)
+			continue;
+		uint64_t offset = value - range->first;
+		uint64_t bit = 1ull << (offset % 64);
+		uint64_t old = atomic_fetch_and_explicit(&pool_bitmap(pool)[range->word + offset / 64], ~bit,
+												 memory_order_acq_rel);
+		return (old & bit) != 0;
+	}
+	return false;
+}
+
+static uint64_t lease_holder(void)
+{
+	return (uint64_t)(uint32_t)time(NULL) << 32 | (uint32_t)platform_process_id();
+}
+
+// Dono morto, ou reserva anterior ao boot atual (o PID pode ter sido reaproveitado).
+static bool lease_abandoned(uint64_t holder)
+{
+	int64_t age = (int64_t)(uint32_t)time(NULL) - (int64_t)(holder >> 32);
+	int64_t uptime = (int64_t)(platform_uptime_ms() / 1000u);
+	return !platform_process_alive((int)(uint32_t)holder) || age > uptime + MACPOOL_LEASE_CLOCK_SLACK_S;
+}
+
+// Só sob a trava de arquivo: devolve ao pool os MACs reservados por processos que já morreram.
+static int pool_reclaim(macpool_t *pool, int count)
+{
+	int reclaimed = 0;
+	for (int i = 0; i < MACPOOL_LEASES_MAX; i++)
+	{
+		PoolLease *lease = &pool_leases(pool)[i];
+		uint64_t holder = atomic_load_explicit(&lease->holder, memory_order_acquire);
+		if (holder == 0 || !lease_abandoned(holder))
+			continue;
+		uint64_t value = atomic_exchange_explicit(&lease->value, 0, memory_order_acq_rel);
+		if (value & MACPOOL_LEASE_SET)
+			bit_clear(pool, count, value & ~MACPOOL_LEASE_SET);
+		atomic_store_explicit(&lease->holder, 0, memory_order_release);
+		reclaimed++;
+	}
+	return reclaimed;
+}
+
+static int pool_reclaim_locked(macpool_t *pool)
+{
+	platform_lock_t *lock = NULL;
+	if (!pool_lock(pool, &lock))
+		return 0;
+	int reclaimed = pool_reclaim(pool, pool_enter(pool));
+	pool_leave(pool);
+	platform_lock_release(lock);
+	return reclaimed;
+}
+
+macpool_t *macpool_open(const char *path)
+{
+	char default_path[MACPOOL_FILE_PATH_MAX];
+	if (!path)
+	{
+		if (!platform_state_path(MACPOOL_FILE_NAME, default_path, sizeof(default_path)))
+			return NULL;
+		path = default_path;
+	}
+
+	macpool_t *pool = calloc(1, sizeof(macpool_t));
+	if (!pool)
+		return NULL;
+	// Caminho truncado apontaria para outra trava: recusa em vez de cortar.
+	int key_len = snprintf(pool->lock_key, sizeof(pool->lock_key), MACPOOL_LOCK_PREFIX "%s", path);
+	if (strlen(path) >= MACPOOL_FILE_PATH_MAX || key_len < 0 || (size_t)key_len >= sizeof(pool->lock_key) ||
+		pthread_rwlock_init(&pool->remap_lock, NULL) != 0)
+	{
+		free(pool);
+		return NULL;
+	}
+
+	platform_lock_t *lock = NULL;
+	bool ok = pool_lock(pool, &lock);
+	if (ok)
+	{
+		pool->map = platform_map_open(path, MACPOOL_BITMAP_OFFSET);
+		ok = pool->map && pool_init(pool);
+		if (ok)
+		{
+			pool_reclaim(pool, pool_enter(pool));
+			pool_leave(pool);
+		}
+		platform_lock_release(lock);
+	}
+	if (!ok)
+	{
+		macpool_close(pool);
+		return NULL;
+	}
+	return pool;
+}
+
+void macpool_close(macpool_t *pool)
+{
+	if (!pool)
+		return;
+	platform_map_close(pool->map);
+	pthread_rwlock_destroy(&pool->remap_lock);
+	free(pool);
+}
+
+// O bitmap cresce antes de a faixa ser publicada: quem vê a faixa já enxerga as palavras zeradas.
+bool macpool_add_range(macpool_t *pool, const uint8_t *first, const uint8_t *last)
+{
+	if (!pool || !first || !last)
+		return false;
+	uint64_t start = mac_to_value(first);
+	uint64_t end = mac_to_value(last);
+	// A faixa é menor que 2^40, então basta olhar as pontas para o bit I/G (multicast).
+	if (end < start || end - start >= MACPOOL_RANGE_ADDRESSES_MAX || (start & MACPOOL_MULTICAST_BIT) ||
+		(end & MACPOOL_MULTICAST_BIT))
+		return false;
+
+	platform_lock_t *lock = NULL;
+	if (!pool_lock(pool, &lock))
+		return false;
+
+	pthread_rwlock_wrlock(&pool->remap_lock);
+	int count = pool_range_count(pool);
+	size_t needed = pool_needed(pool, count);
+	bool ok = count < MACPOOL_RANGES_MAX &&
+			  (needed <= platform_map_size(pool->map) || platform_map_grow(pool->map, needed));
+	for (int i = 0; i < count && ok; i++)
+	{
+		const PoolRange *range = &pool_ranges(pool)[i];
+		ok = end < range->first || start >= range->first + range->count;
+	}
+
+	PoolHeader *header = pool_header(pool);
+	PoolRange added = {.first = start, .count = end - start + 1, .word = header->words};
+	if (ok)
+	{
+		ok = platform_map_grow(pool->map, MACPOOL_BITMAP_OFFSET +
+											  (size_t)(added.word + range_words(&added)) * sizeof(uint64_t));
+	}
+	if (ok)
+	{
+		header = pool_header(pool);
+		PoolRange *range = &pool_ranges(pool)[count];
+		range->first = added.first;
+		range->count = added.count;
+		range->word = added.word;
+		atomic_store_explicit(&range->cursor, 0, memory_order_relaxed);
+		header->words = added.word + range_words(&added);
+		atomic_store_explicit(&header->range_count, (uint32_t)count + 1, memory_order_release);
+	}
+	pthread_rwlock_unlock(&pool->remap_lock);
+	platform_lock_release(lock);
+	return ok;
+}
+
+int macpool_range_count(macpool_t *pool)
+{
+	if (!pool)
+		return 0;
+	int count = pool_enter(pool);
+	pool_leave(pool);
+	return count;
+}
+
+bool macpool_get_range(macpool_t *pool, int index, macpool_range_t *range_out)
+{
+	if (!pool || !range_out || index < 0)
+		return false;
+	if (index >= pool_enter(pool))
+	{
+		pool_leave(pool);
+		return false;
+	}
+
+	const PoolRange *range = &pool_ranges(pool)[index];
+	const _Atomic uint64_t *bitmap = pool_bitmap(pool) + range->word;
+	range_out->used = 0;
+	for (uint64_t w = 0; w < range_words(range); w++)
+		range_out->used += (uint64_t)__builtin_popcountll(atomic_load_explicit(&bitmap[w], memory_order_relaxed));
+	range_out->total = range->count;
+	value_to_mac(range->first, range_out->first);
+	value_to_mac(range->first + range->count - 1, range_out->last);
+	pool_leave(pool);
+	return true;
+}
+
+static uint64_t word_mask(const PoolRange *range, uint64_t word)
+{
+	uint64_t tail = range->count % 64;
+	return word == range_words(range) - 1 && tail ? (1ull << tail) - 1 : ~0ull;
+}
+
+// Caminho quente: um CAS por bit, começando na palavra em que a última reserva parou.
+static bool range_allocate(macpool_t *pool, PoolRange *range, uint64_t *value_out)
+{
+	_Atomic uint64_t *bitmap = pool_bitmap(pool) + range->word;
+	uint64_t words = range_words(range);
+	uint64_t start = atomic_load_explicit(&range->cursor, memory_order_relaxed) % words;
+
+	for (uint64_t n = 0; n < words; n++)
+	{
+		uint64_t w = (start + n) % words;
+		uint64_t mask = word_mask(range, w);
+		uint64_t bits = atomic_load_explicit(&bitmap[w], memory_order_relaxed);
+		uint64_t free_bits;
+		while ((free_bits = ~bits & mask) != 0)
+		{
+			uint64_t bit = free_bits & -free_bits;
+			if (atomic_compare_exchange_weak_explicit(&bitmap[w], &bits, bits | bit, memory_order_acq_rel,
+													  memory_order_relaxed))
+			{
+				atomic_store_explicit(&range->cursor, w, memory_order_relaxed);
+				*value_out = range->first + w * 64 + (uint64_t)__builtin_ctzll(bit);
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+static PoolLease *lease_claim(macpool_t *pool)
+{
+	uint64_t holder = lease_holder();
+	for (int i = 0; i < MACPOOL_LEASES_MAX; i++)
+	{
+		PoolLease *lease = &pool_leases(pool)[i];
+		uint64_t expected = 0;
+		if (atomic_compare_exchange_strong_explicit(&lease->holder, &expected, holder, memory_order_acq_rel,
+													memory_order_relaxed))
+			return lease;
+	}
+	return NULL;
+}
+
+// Tira a reserva deste processo sobre o MAC; o bit fica como está.
+static void lease_drop(macpool_t *pool, uint64_t value)
+{
+	uint32_t owner = (uint32_t)platform_process_id();
+	for (int i = 0; i < MACPOOL_LEASES_MAX; i++)
+	{
+		PoolLease *lease = &pool_leases(pool)[i];
+		uint64_t expected = value | MACPOOL_LEASE_SET;
+		if ((uint32_t)atomic_load_explicit(&lease->holder, memory_order_acquire) == owner &&
+			atomic_compare_exchange_strong_explicit(&lease->value, &expected, 0, memory_order_acq_rel,
+													memory_order_relaxed))
+		{
+			atomic_store_explicit(&lease->holder, 0, memory_order_release);
+			return;
+		}
+	}
+}
+
+static bool pool_try_allocate(macpool_t *pool, ledger_t *ledger, uint8_t *mac_out)
+{
+	int count = pool_enter(pool);
+	PoolLease *lease = lease_claim(pool);
+	if (!lease)
+	{
+		pool_leave(pool);
+		return false;
+	}
+	for (int i = 0; i < count; i++)
+	{
+		uint64_t value;
+		while (range_allocate(pool, &pool_ranges(pool)[i], &value))
+		{
+			value_to_mac(value, mac_out);
+			if (!ledger || !ledger_find_esp(ledger, mac_out, NULL))
+			{
+				atomic_store_explicit(&lease->value, value | MACPOOL_LEASE_SET, memory_order_release);
+				pool_leave(pool);
+				return true;
+			}
+		}
+	}
+	atomic_store_explicit(&lease->holder, 0, memory_order_release);
+	pool_leave(pool);
+	return false;
+}
+
+// Sem endereço ou sem vaga de reserva: recupera o que processos mortos deixaram e tenta de novo.
+bool macpool_allocate(macpool_t *pool, ledger_t *ledger, uint8_t *mac_out)
+{
+	if (!pool || !mac_out)
+		return false;
+	if (pool_try_allocate(pool, ledger, mac_out))
+		return true;
+	return pool_reclaim_locked(pool) > 0 && pool_try_allocate(pool, ledger, mac_out);
+}
+
+bool macpool_commit(macpool_t *pool, const uint8_t *mac)
+{
+	if (!pool || !mac)
+		return false;
+	pool_enter(pool);
+	lease_drop(pool, mac_to_value(mac));
+	pool_leave(pool);
+	return true;
+}
+
+// Devolve um MAC que não chegou a ser gravado; false se estava livre ou fora das faixas.
+bool macpool_release(macpool_t *pool, const uint8_t *mac)
+{
+	if (!pool || !mac)
+		return false;
+
+	uint64_t value = mac_to_value(mac);
+	int count = pool_enter(pool);
+	lease_drop(pool, value);
+	bool released = bit_clear(pool, count, value);
+	pool_leave(pool);
+	return released;
+}
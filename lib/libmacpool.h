@@ -0,0 +1,38 @@
+#ifndef LIBMACPOOL_H
+#define LIBMACPOOL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "libledger.h"
+
+#define MACPOOL_MAC_LEN 6
+#define MACPOOL_RANGES_MAX 16
+#define MACPOOL_RANGE_ADDRESSES_MAX (1u << 24)
+#define MACPOOL_LEASES_MAX 64
+#define MACPOOL_FILE_NAME "macpool.bitmap"
+
+typedef struct macpool macpool_t;
+
+typedef struct
+{
+	uint8_t first[MACPOOL_MAC_LEN];
+	uint8_t last[MACPOOL_MAC_LEN];
+	uint64_t used;
+	uint64_t total;
+} macpool_range_t;
+
+macpool_t *macpool_open(const char *path);
+void macpool_close(macpool_t *pool);
+
+bool macpool_add_range(macpool_t *pool, const uint8_t *first, const uint8_t *last);
+int macpool_range_count(macpool_t *pool);
+bool macpool_get_range(macpool_t *pool, int index, macpool_range_t *range_out);
+
+// Reserva sem trava; MACs que já aparecem no ledger ficam marcados e são pulados.
+// A reserva fica em nome do processo até macpool_commit (gravado) ou macpool_release (devolvido);
+// reservas de processos que morreram voltam ao pool.
+bool macpool_allocate(macpool_t *pool, ledger_t *ledger, uint8_t *mac_out);
+bool macpool_commit(macpool_t *pool, const uint8_t *mac);
+bool macpool_release(macpool_t *pool, const uint8_t *mac);
+
+#endif
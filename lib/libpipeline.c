@@ -0,0 +1,638 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "platform.h"
+#include "mac.h"
+#include "metrics.h"
+#include "libpipeline.h"
+
+#define PIPELINE_WORKERS_MAX 16
+#define PIPELINE_CLAIM_MAX (ESP32_MAX_PORTS + DS4_MAX_DEVICES)
+
+typedef struct
+{
+	pipeline_unit_t *items;
+	int capacity;
+	int head;
+	int count;
+	bool closed;
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+} PipelineQueue;
+
+typedef struct
+{
+	pipeline_t *pipeline;
+	pipeline_stage_t stage;
+	pthread_t thread;
+	bool started;
+} PipelineWorker;
+
+struct pipeline
+{
+	pipeline_config_t config;
+	pipeline_ops_t ops;
+	// queues[i] alimenta o estágio i; a última guarda os resultados para pipeline_poll.
+	PipelineQueue queues[PIPELINE_STAGE_COUNT + 1];
+	PipelineWorker workers[PIPELINE_STAGE_COUNT][PIPELINE_WORKERS_MAX];
+	int alive[PIPELINE_STAGE_COUNT];
+	bool joined;
+
+	pthread_mutex_t lock;
+	char claims[PIPELINE_CLAIM_MAX][ESP32_PORT_NAME_MAX];
+	int claim_count;
+};
+
+static const char *stage_names[PIPELINE_STAGE_COUNT] = {
+	"discover",
+	"read",
+	"write",
+	"verify",
+	"record",
+};
+
+static const char *const error_reuse = "reuso";
+
+static const char *stage_errors[PIPELINE_STAGE_COUNT] = {
+	"ds4",
+	"esp32",
+	"gravacao",
+	"verificacao",
+	"ledger",
+};
+
+static bool queue_init(PipelineQueue *queue, int capacity)
+{
+	queue->items = calloc((size_t)capacity, sizeof(pipeline_unit_t));
+	if (!queue->items)
+	{
+		return false;
+	}
+	queue->capacity = capacity;
+	pthread_mutex_init(&queue->lock, NULL);
+	pthread_cond_init(&queue->not_empty, NULL);
+	pthread_cond_init(&queue->not_full, NULL);
+	return true;
+}
+
+static void queue_free(PipelineQueue *queue)
+{
+	if (!queue->items)
+	{
+		return;
+	}
+	pthread_cond_destroy(&queue->not_full);
+	pthread_cond_destroy(&queue->not_empty);
+	pthread_mutex_destroy(&queue->lock);
+	free(queue->items);
+	queue->items = NULL;
+}
+
+static void queue_close(PipelineQueue *queue)
+{
+	if (!queue->items)
+	{
+		return;
+	}
+	pthread_mutex_lock(&queue->lock);
+	queue->closed = true;
+	pthread_cond_broadcast(&queue->not_empty);
+	pthread_cond_broadcast(&queue->not_full);
+	pthread_mutex_unlock(&queue->lock);
+}
+
+// Fila cheia segura o estágio anterior; é o que limita as unidades em voo.
+static bool queue_push(PipelineQueue *queue, const pipeline_unit_t *unit, bool block)
+{
+	pthread_mutex_lock(&queue->lock);
+	while (block && !queue->closed && queue->count == queue->capacity)
+	{
+		pthread_cond_wait(&queue->not_full, &queue->lock);
+	}
+	bool ok = !queue->closed && queue->count < queue->capacity;
+	if (ok)
+	{
+		queue->items[(queue->head + queue->count) % queue->capacity] = *unit;
+		queue->count++;
+		pthread_cond_signal(&queue->not_empty);
+	}
+	pthread_mutex_unlock(&queue->lock);
+	return ok;
+}
+
+static bool queue_pop(PipelineQueue *queue, pipeline_unit_t *unit_out, bool block)
+{
+	pthread_mutex_lock(&queue->lock);
+	while (block && !queue->closed && queue->count == 0)
+	{
+		pthread_cond_wait(&queue->not_empty, &queue->lock);
+	}
+	bool ok = queue->count > 0;
+	if (ok)
+	{
+		*unit_out = queue->items[queue->head];
+		queue->head = (queue->head + 1) % queue->capacity;
+		queue->count--;
+		pthread_cond_signal(&queue->not_full);
+	}
+	pthread_mutex_unlock(&queue->lock);
+	return ok;
+}
+
+static double elapsed_ms(uint64_t start_ns)
+{
+	return (double)(platform_monotonic_ns() - start_ns) / 1e6;
+}
+
+static bool default_read_esp32(pipeline_unit_t *unit, void *user)
+{
+	(void)user;
+	return esp32_get_mac_from_port(unit->esp32, unit->mac, sizeof(unit->mac));
+}
+
+static bool default_identify_ds4(pipeline_unit_t *unit, void *user)
+{
+	(void)user;
+	ds4_context_t *ctx = ds4_create_context_at(unit->ds4);
+	if (!ctx)
+	{
+		unit->error = "ds4";
+		return false;
+	}
+	unit->device = ctx;
+	unit->device_known = ds4_get_device_mac(ctx, unit->device_mac);
+	return true;
+}
+
+static bool default_write_ds4(pipeline_unit_t *unit, void *user)
+{
+	(void)user;
+	return unit->device && ds4_set_mac(unit->device, unit->target);
+}
+
+static bool default_verify_ds4(pipeline_unit_t *unit, void *user)
+{
+	(void)user;
+	uint8_t readback[DS4_MAC_ADDR_LEN];
+	return unit->device && ds4_get_mac(unit->device, readback) &&
+		   memcmp(readback, unit->target, DS4_MAC_ADDR_LEN) == 0;
+}
+
+static void default_release(pipeline_unit_t *unit, void *user)
+{
+	(void)user;
+	ds4_destroy_context(unit->device);
+}
+
+static bool is_claimed(const pipeline_t *pipeline, const char *name)
+{
+	for (int i = 0; i < pipeline->claim_count; i++)
+	{
+		if (strcmp(pipeline->claims[i], name) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+static void unclaim(pipeline_t *pipeline, const char *name)
+{
+	for (int i = 0; i < pipeline->claim_count; i++)
+	{
+		if (strcmp(pipeline->claims[i], name) == 0)
+		{
+			pipeline->claim_count--;
+			memcpy(pipeline->claims[i], pipeline->claims[pipeline->claim_count], ESP32_PORT_NAME_MAX);
+			return;
+		}
+	}
+}
+
+static bool pick_ds4(pipeline_t *pipeline, pipeline_unit_t *unit)
+{
+	char paths[DS4_MAX_DEVICES][DS4_PATH_MAX];
+	int count = ds4_list_devices(paths, DS4_MAX_DEVICES);
+	for (int i = 0; i < count; i++)
+	{
+		if (!is_claimed(pipeline, paths[i]))
+		{
+			memcpy(unit->ds4, paths[i], sizeof(unit->ds4));
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool pick_esp32(pipeline_t *pipeline, pipeline_unit_t *unit)
+{
+	char ports[ESP32_MAX_PORTS][ESP32_PORT_NAME_MAX];
+	int count = esp32_list_ports(ports, ESP32_MAX_PORTS);
+	for (int i = 0; i < count; i++)
+	{
+		if (!is_claimed(pipeline, ports[i]))
+		{
+			memcpy(unit->esp32, ports[i], sizeof(unit->esp32));
+			return true;
+		}
+	}
+	return false;
+}
+
+// Resolve campos vazios para o próximo dispositivo livre e reserva porta e controle até o registro.
+static bool stage_discover(pipeline_t *pipeline, pipeline_unit_t *unit)
+{
+	bool literal = unit->esp32[0] && mac_parse(unit->esp32, unit->target);
+
+	pthread_mutex_lock(&pipeline->lock);
+	if (!unit->ds4[0] && !pick_ds4(pipeline, unit))
+	{
+		unit->error = "ds4";
+	}
+	else if (!unit->esp32[0] && !pick_esp32(pipeline, unit))
+	{
+		unit->error = "esp32";
+	}
+	else if (is_claimed(pipeline, unit->ds4) || (!literal && is_claimed(pipeline, unit->esp32)) ||
+			 pipeline->claim_count + 2 > PIPELINE_CLAIM_MAX)
+	{
+		unit->error = "ocupado";
+	}
+	else
+	{
+		snprintf(pipeline->claims[pipeline->claim_count++], ESP32_PORT_NAME_MAX, "%s", unit->ds4);
+		if (!literal)
+		{
+			snprintf(pipeline->claims[pipeline->claim_count++], ESP32_PORT_NAME_MAX, "%s", unit->esp32);
+		}
+	}
+	pthread_mutex_unlock(&pipeline->lock);
+
+	if (literal && !unit->error)
+	{
+		mac_format(unit->target, ':', unit->mac);
+	}
+	return !unit->error;
+}
+
+static bool stage_fetch(pipeline_t *pipeline, pipeline_unit_t *unit)
+{
+	if (unit->mac[0])
+	{
+		return true;
+	}
+	if (!pipeline->ops.read_esp32(unit, pipeline->ops.user))
+	{
+		unit->mac[0] = '\0';
+		return false;
+	}
+	if (!mac_parse(unit->mac, unit->target))
+	{
+		unit->error = "mac";
+		return false;
+	}
+	return true;
+}
+
+// Com o MAC alvo conhecido, procura o último pareamento dele; a gravação decide sobre o reuso.
+static bool stage_read(pipeline_t *pipeline, pipeline_unit_t *unit)
+{
+	if (!stage_fetch(pipeline, unit))
+	{
+		return false;
+	}
+	ledger_record_t previous;
+	if (pipeline->config.ledger && ledger_find_esp(pipeline->config.ledger, unit->target, &previous))
+	{
+		unit->reused = true;
+		memcpy(unit->previous_ds4, previous.ds4_mac, DS4_MAC_ADDR_LEN);
+	}
+	return true;
+}
+
+// Regravar o MAC no mesmo controle não é reuso; os demais passam por confirm_reuse antes de gravar.
+static bool stage_write(pipeline_t *pipeline, pipeline_unit_t *unit)
+{
+	void *user = pipeline->ops.user;
+	if (pipeline->ops.identify_ds4 && !pipeline->ops.identify_ds4(unit, user))
+	{
+		return false;
+	}
+	if (unit->reused && unit->device_known && memcmp(unit->previous_ds4, unit->device_mac, DS4_MAC_ADDR_LEN) == 0)
+	{
+		unit->reused = false;
+	}
+	if (unit->reused && pipeline->config.confirm_reuse && !pipeline->config.confirm_reuse(unit, pipeline->config.user))
+	{
+		unit->error = error_reuse;
+		return false;
+	}
+	return pipeline->ops.write_ds4(unit, user);
+}
+
+// Registra toda tentativa de gravação; uma recusa por reuso não tocou o controle e fica de fora.
+static bool stage_record(pipeline_t *pipeline, pipeline_unit_t *unit)
+{
+	ledger_t *ledger = pipeline->config.ledger;
+	if (!ledger || unit->failed_stage < PIPELINE_WRITE || unit->error == error_reuse)
+	{
+		return true;
+	}
+
+	ledger_record_t record = {0};
+	memcpy(record.esp_mac, unit->target, DS4_MAC_ADDR_LEN);
+	if (unit->device_known)
+	{
+		memcpy(record.ds4_mac, unit->device_mac, DS4_MAC_ADDR_LEN);
+	}
+	snprintf(record.ds4_path, sizeof(record.ds4_path), "%s", unit->ds4);
+	record.result = unit->ok ? 0 : (int32_t)unit->failed_stage;
+	return ledger_append(ledger, &record);
+}
+
+static bool run_stage(pipeline_t *pipeline, pipeline_stage_t stage, pipeline_unit_t *unit)
+{
+	switch (stage)
+	{
+	case PIPELINE_DISCOVER:
+		return stage_discover(pipeline, unit);
+	case PIPELINE_READ:
+		return stage_read(pipeline, unit);
+	case PIPELINE_WRITE:
+		return stage_write(pipeline, unit);
+	case PIPELINE_VERIFY:
+		return !pipeline->ops.verify_ds4 || pipeline->ops.verify_ds4(unit, pipeline->ops.user);
+	case PIPELINE_RECORD:
+		return stage_record(pipeline, unit);
+	default:
+		return false;
+	}
+}
+
+static void finish_unit(pipeline_t *pipeline, pipeline_unit_t *unit)
+{
+	if (unit->failed_stage > PIPELINE_DISCOVER)
+	{
+		pthread_mutex_lock(&pipeline->lock);
+		unclaim(pipeline, unit->ds4);
+		unclaim(pipeline, unit->esp32);
+		pthread_mutex_unlock(&pipeline->lock);
+	}
+	unit->ms_total = elapsed_ms(unit->start_ns);
+
+	// O ciclo é contado no caminho USB do DS4 (fixo por estação); o lado ESP32 pode ser um MAC
+	// literal, e cada MAC viraria uma série nova até esgotar METRICS_SERIES_MAX.
+	metrics_series_t *series = metrics_series(unit->ds4[0] ? unit->ds4 : "station");
+	if (unit->ok)
+		metrics_observe(series, METRIC_PAIR_CYCLE, platform_monotonic_ns() - unit->start_ns);
+	else
+		metrics_count(series, METRIC_PAIR_FAILURES, 1);
+
+	if (pipeline->config.done)
+	{
+		pipeline->config.done(unit, pipeline->config.user);
+	}
+	else
+	{
+		queue_push(&pipeline->queues[PIPELINE_STAGE_COUNT], unit, true);
+	}
+}
+
+// Unidades com erro atravessam os estágios restantes sem executá-los, para serem liberadas e registradas.
+static void *pipeline_worker(void *arg)
+{
+	PipelineWorker *worker = arg;
+	pipeline_t *pipeline = worker->pipeline;
+	pipeline_stage_t stage = worker->stage;
+	pipeline_unit_t unit;
+
+	while (queue_pop(&pipeline->queues[stage], &unit, true))
+	{
+		uint64_t start = platform_monotonic_ns();
+		if (!unit.error || stage == PIPELINE_RECORD)
+		{
+			bool ok = run_stage(pipeline, stage, &unit);
+			if (!ok && !unit.error)
+			{
+				unit.error = stage_errors[stage];
+			}
+			if (!ok && stage != PIPELINE_RECORD)
+			{
+				unit.failed_stage = stage;
+			}
+		}
+		unit.ms[stage] = elapsed_ms(start);
+
+		if (stage == PIPELINE_VERIFY)
+		{
+			unit.ok = !unit.error;
+			if (unit.device && pipeline->ops.release)
+			{
+				pipeline->ops.release(&unit, pipeline->ops.user);
+			}
+			unit.device = NULL;
+		}
+
+		if (stage == PIPELINE_RECORD)
+		{
+			finish_unit(pipeline, &unit);
+		}
+		else
+		{
+			queue_push(&pipeline->queues[stage + 1], &unit, true);
+		}
+	}
+
+	// O último worker do estágio fecha a fila seguinte, propagando o fim até pipeline_poll.
+	pthread_mutex_lock(&pipeline->lock);
+	bool last = --pipeline->alive[stage] == 0;
+	pthread_mutex_unlock(&pipeline->lock);
+	if (last)
+	{
+		queue_close(&pipeline->queues[stage + 1]);
+	}
+	return NULL;
+}
+
+void pipeline_config_default(pipeline_config_t *config)
+{
+	if (!config)
+	{
+		return;
+	}
+	memset(config, 0, sizeof(pipeline_config_t));
+	config->depth = PIPELINE_DEPTH_DEFAULT;
+	config->workers[PIPELINE_DISCOVER] = 1;
+	config->workers[PIPELINE_READ] = 4;
+	config->workers[PIPELINE_WRITE] = 2;
+	config->workers[PIPELINE_VERIFY] = 2;
+	config->workers[PIPELINE_RECORD] = 1;
+}
+
+static void pipeline_join(pipeline_t *pipeline)
+{
+	if (pipeline->joined)
+	{
+		return;
+	}
+	for (int stage = 0; stage < PIPELINE_STAGE_COUNT; stage++)
+	{
+		for (int i = 0; i < PIPELINE_WORKERS_MAX; i++)
+		{
+			if (pipeline->workers[stage][i].started)
+			{
+				pthread_join(pipeline->workers[stage][i].thread, NULL);
+			}
+		}
+	}
+	pipeline->joined = true;
+}
+
+pipeline_t *pipeline_create(const pipeline_config_t *config)
+{
+	pipeline_t *pipeline = calloc(1, sizeof(pipeline_t));
+	if (!pipeline)
+	{
+		return NULL;
+	}
+
+	if (config)
+	{
+		pipeline->config = *config;
+	}
+	else
+	{
+		pipeline_config_default(&pipeline->config);
+	}
+	if (pipeline->config.depth < 1)
+	{
+		pipeline->config.depth = PIPELINE_DEPTH_DEFAULT;
+	}
+
+	pipeline->ops = (pipeline_ops_t){default_read_esp32, default_identify_ds4, default_write_ds4,
+									 default_verify_ds4, default_release, NULL};
+	if (pipeline->config.ops)
+	{
+		pipeline->ops = *pipeline->config.ops;
+	}
+	pthread_mutex_init(&pipeline->lock, NULL);
+
+	bool ok = pipeline->ops.read_esp32 && pipeline->ops.write_ds4;
+	for (int i = 0; ok && i <= PIPELINE_STAGE_COUNT; i++)
+	{
+		ok = queue_init(&pipeline->queues[i], pipeline->config.depth);
+	}
+
+	for (int stage = 0; ok && stage < PIPELINE_STAGE_COUNT; stage++)
+	{
+		int count = pipeline->config.workers[stage];
+		count = count < 1 ? 1 : (count > PIPELINE_WORKERS_MAX ? PIPELINE_WORKERS_MAX : count);
+		for (int i = 0; i < count; i++)
+		{
+			PipelineWorker *worker = &pipeline->workers[stage][i];
+			worker->pipeline = pipeline;
+			worker->stage = (pipeline_stage_t)stage;
+			pthread_mutex_lock(&pipeline->lock);
+			worker->started = pthread_create(&worker->thread, NULL, pipeline_worker, worker) == 0;
+			if (worker->started)
+			{
+				pipeline->alive[stage]++;
+			}
+			pthread_mutex_unlock(&pipeline->lock);
+		}
+		ok = pipeline->alive[stage] > 0;
+	}
+
+	if (!ok)
+	{
+		pipeline_destroy(pipeline);
+		return NULL;
+	}
+	return pipeline;
+}
+
+// Fecha a entrada e espera as unidades em voo. Sem callback, outra thread precisa consumir pipeline_poll.
+void pipeline_finish(pipeline_t *pipeline)
+{
+	if (!pipeline)
+	{
+		return;
+	}
+	queue_close(&pipeline->queues[PIPELINE_DISCOVER]);
+	pipeline_join(pipeline);
+}
+
+void pipeline_destroy(pipeline_t *pipeline)
+{
+	if (!pipeline)
+	{
+		return;
+	}
+
+	// Sem ninguém para consumir, os resultados pendentes são descartados.
+	queue_close(&pipeline->queues[PIPELINE_DISCOVER]);
+	queue_close(&pipeline->queues[PIPELINE_STAGE_COUNT]);
+	for (int stage = 0; stage < PIPELINE_STAGE_COUNT; stage++)
+	{
+		if (pipeline->alive[stage] == 0)
+		{
+			queue_close(&pipeline->queues[stage + 1]);
+		}
+	}
+	pipeline_join(pipeline);
+
+	for (int i = 0; i <= PIPELINE_STAGE_COUNT; i++)
+	{
+		queue_free(&pipeline->queues[i]);
+	}
+	pthread_mutex_destroy(&pipeline->lock);
+	free(pipeline);
+}
+
+static bool submit_unit(pipeline_t *pipeline, const char *esp32, const char *ds4, void *tag, bool block)
+{
+	if (!pipeline)
+	{
+		return false;
+	}
+
+	pipeline_unit_t unit;
+	memset(&unit, 0, sizeof(unit));
+	if ((esp32 && strlen(esp32) >= sizeof(unit.esp32)) || (ds4 && strlen(ds4) >= sizeof(unit.ds4)))
+	{
+		return false;
+	}
+	snprintf(unit.esp32, sizeof(unit.esp32), "%s", esp32 ? esp32 : "");
+	snprintf(unit.ds4, sizeof(unit.ds4), "%s", ds4 ? ds4 : "");
+	unit.failed_stage = PIPELINE_STAGE_COUNT;
+	unit.start_ns = platform_monotonic_ns();
+	unit.tag = tag;
+	return queue_push(&pipeline->queues[PIPELINE_DISCOVER], &unit, block);
+}
+
+// Campos vazios (ou NULL) são preenchidos pelo estágio discover; esp32 também aceita um MAC literal.
+bool pipeline_submit(pipeline_t *pipeline, const char *esp32, const char *ds4, void *tag)
+{
+	return submit_unit(pipeline, esp32, ds4, tag, true);
+}
+
+bool pipeline_try_submit(pipeline_t *pipeline, const char *esp32, const char *ds4, void *tag)
+{
+	return submit_unit(pipeline, esp32, ds4, tag, false);
+}
+
+bool pipeline_poll(pipeline_t *pipeline, pipeline_unit_t *unit_out)
+{
+	if (!pipeline || !unit_out)
+	{
+		return false;
+	}
+	return queue_pop(&pipeline->queues[PIPELINE_STAGE_COUNT], unit_out, false);
+}
+
+const char *pipeline_stage_name(pipeline_stage_t stage)
+{
+	return stage < PIPELINE_STAGE_COUNT ? stage_names[stage] : "-";
+}
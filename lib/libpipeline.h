@@ -0,0 +1,80 @@
+#ifndef LIBPIPELINE_H
+#define LIBPIPELINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "libds4.h"
+#include "libesp32.h"
+#include "libledger.h"
+
+#define PIPELINE_DEPTH_DEFAULT 4
+#define PIPELINE_MAC_STR_LEN 18
+
+typedef struct pipeline pipeline_t;
+
+typedef enum
+{
+	PIPELINE_DISCOVER,
+	PIPELINE_READ,
+	PIPELINE_WRITE,
+	PIPELINE_VERIFY,
+	PIPELINE_RECORD,
+	PIPELINE_STAGE_COUNT
+} pipeline_stage_t;
+
+typedef struct
+{
+	char esp32[ESP32_PORT_NAME_MAX];
+	char ds4[DS4_PATH_MAX];
+	char mac[PIPELINE_MAC_STR_LEN];
+	uint8_t target[DS4_MAC_ADDR_LEN];
+	uint8_t device_mac[DS4_MAC_ADDR_LEN];
+	uint8_t previous_ds4[DS4_MAC_ADDR_LEN];
+	bool device_known;
+	bool reused;
+	bool ok;
+	const char *error;
+	pipeline_stage_t failed_stage;
+	double ms[PIPELINE_STAGE_COUNT];
+	double ms_total;
+	uint64_t start_ns;
+	void *tag;
+	void *device;
+} pipeline_unit_t;
+
+// identify_ds4 (opcional) preenche device_mac antes da gravação, para o reuso ser decidido antes dela.
+typedef struct
+{
+	bool (*read_esp32)(pipeline_unit_t *unit, void *user);
+	bool (*identify_ds4)(pipeline_unit_t *unit, void *user);
+	bool (*write_ds4)(pipeline_unit_t *unit, void *user);
+	bool (*verify_ds4)(pipeline_unit_t *unit, void *user);
+	void (*release)(pipeline_unit_t *unit, void *user);
+	void *user;
+} pipeline_ops_t;
+
+typedef struct
+{
+	int depth;
+	int workers[PIPELINE_STAGE_COUNT];
+	const pipeline_ops_t *ops;
+	ledger_t *ledger;
+	// MAC já pareado com outro controle: sem callback grava e só marca reused; false recusa ("reuso").
+	bool (*confirm_reuse)(const pipeline_unit_t *unit, void *user);
+	void (*done)(const pipeline_unit_t *unit, void *user);
+	void *user;
+} pipeline_config_t;
+
+void pipeline_config_default(pipeline_config_t *config);
+
+pipeline_t *pipeline_create(const pipeline_config_t *config);
+void pipeline_destroy(pipeline_t *pipeline);
+
+bool pipeline_submit(pipeline_t *pipeline, const char *esp32, const char *ds4, void *tag);
+bool pipeline_try_submit(pipeline_t *pipeline, const char *esp32, const char *ds4, void *tag);
+bool pipeline_poll(pipeline_t *pipeline, pipeline_unit_t *unit_out);
+void pipeline_finish(pipeline_t *pipeline);
+
+const char *pipeline_stage_name(pipeline_stage_t stage);
+
+#endif
@@ -0,0 +1,589 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "libpool.h"
+
+#define POOL_INTERVAL_MS 500
+#define POOL_RETRY_MS 5000
+#define POOL_RETRY_MAX_MS 60000
+#define POOL_PROBE_MAX_FAILURES 3
+#define POOL_DS4_READ_FAILURES 3
+
+typedef struct
+{
+	pool_entry_t info;
+	esp32_session_t *session;
+	bool resolved;
+	bool listed;
+	bool rejected;
+	int failures;
+	uint64_t retry_at_ms;
+} pool_slot_t;
+
+typedef struct
+{
+	pool_entry_t info;
+	ds4_context_t *ctx;
+	int failures;
+	uint64_t retry_at_ms;
+} pool_ds4_slot_t;
+
+struct device_pool
+{
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_mutex_t ds4_lock;
+	pthread_cond_t wake;
+	bool running;
+	bool refresh_requested;
+	uint32_t generation;
+
+	pool_ds4_slot_t ds4[DS4_MAX_DEVICES];
+	int ds4_count;
+
+	pool_slot_t esp32[ESP32_MAX_PORTS];
+	int esp32_count;
+	uint32_t ports_generation;
+};
+
+static uint64_t pool_now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+// A espera entre tentativas dobra a cada falha seguida, até POOL_RETRY_MAX_MS.
+static uint64_t pool_backoff_ms(uint64_t base_ms, int failures)
+{
+	int shift = failures > 1 ? failures - 1 : 0;
+	uint64_t wait = base_ms << (shift < 10 ? shift : 10);
+	return wait < POOL_RETRY_MAX_MS ? wait : POOL_RETRY_MAX_MS;
+}
+
+static void pool_snapshot(device_pool_t *pool, pool_entry_t *dest, const pool_entry_t *src)
+{
+	pthread_mutex_lock(&pool->lock);
+	*dest = *src;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static void pool_publish(device_pool_t *pool, pool_entry_t *dest, const pool_entry_t *src)
+{
+	pthread_mutex_lock(&pool->lock);
+	if (memcmp(dest, src, sizeof(pool_entry_t)) != 0)
+	{
+		*dest = *src;
+		pool->generation++;
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static pool_ds4_slot_t *pool_find_ds4(device_pool_t *pool, const char *path)
+{
+	for (int i = 0; i < pool->ds4_count; i++)
+	{
+		if (!path || strcmp(pool->ds4[i].info.name, path) == 0)
+		{
+			if (path || (pool->ds4[i].ctx && !pool->ds4[i].info.stale))
+			{
+				return &pool->ds4[i];
+			}
+		}
+	}
+	return NULL;
+}
+
+// Enumerar e abrir o controle (libusb_open, detach, claim) acontece fora do ds4_lock, que só
+// cobre a troca do contexto e a leitura; os pedidos dos clientes não esperam pelo USB.
+static void pool_refresh_ds4(device_pool_t *pool)
+{
+	char paths[DS4_MAX_DEVICES][DS4_PATH_MAX];
+	int count = ds4_list_devices(paths, DS4_MAX_DEVICES);
+	if (count < 0)
+		return;
+
+	pthread_mutex_lock(&pool->ds4_lock);
+	for (int i = 0; i < count; i++)
+	{
+		if (pool_find_ds4(pool, paths[i]) || pool->ds4_count >= DS4_MAX_DEVICES)
+			continue;
+
+		pthread_mutex_lock(&pool->lock);
+		pool_ds4_slot_t *slot = &pool->ds4[pool->ds4_count++];
+		memset(slot, 0, sizeof(pool_ds4_slot_t));
+		memcpy(slot->info.name, paths[i], sizeof(paths[i]));
+		pthread_mutex_unlock(&pool->lock);
+	}
+	int slots = pool->ds4_count;
+	pthread_mutex_unlock(&pool->ds4_lock);
+
+	// Só esta thread cria ou troca slot->ctx; ler o ponteiro fora da trava é seguro aqui.
+	for (int i = 0; i < slots; i++)
+	{
+		pool_ds4_slot_t *slot = &pool->ds4[i];
+		pool_entry_t next;
+		uint8_t raw[DS4_MAC_ADDR_LEN];
+		bool listed = false;
+
+		pool_snapshot(pool, &next, &slot->info);
+		for (int j = 0; j < count && !listed; j++)
+		{
+			listed = strcmp(paths[j], next.name) == 0;
+		}
+
+		if (!listed)
+		{
+			slot->failures = 0;
+			slot->retry_at_ms = 0;
+		}
+		if (listed && !slot->ctx && pool_now_ms() >= slot->retry_at_ms)
+		{
+			ds4_context_t *opened = ds4_create_context_at(next.name);
+			pthread_mutex_lock(&pool->ds4_lock);
+			slot->ctx = opened;
+			pthread_mutex_unlock(&pool->ds4_lock);
+		}
+
+		ds4_context_t *dead = NULL;
+		pthread_mutex_lock(&pool->ds4_lock);
+		if (listed && slot->ctx && ds4_get_mac(slot->ctx, raw))
+		{
+			ds4_mac_to_string(raw, next.mac);
+			next.valid = true;
+			next.stale = false;
+			slot->failures = 0;
+		}
+		else
+		{
+			bool attempted = listed && (slot->ctx || slot->retry_at_ms <= pool_now_ms());
+			if (attempted)
+			{
+				slot->failures++;
+			}
+			// Leitura falhando com o controle presente: o contexto fica aberto nas primeiras falhas,
+			// porque fechar devolve o controle ao hid-sony e reabrir o tira de novo. Reabrir, só
+			// depois da espera.
+			if (!listed || !slot->ctx || slot->failures >= POOL_DS4_READ_FAILURES)
+			{
+				if (attempted)
+				{
+					slot->retry_at_ms = pool_now_ms() + pool_backoff_ms(POOL_INTERVAL_MS, slot->failures);
+				}
+				dead = slot->ctx;
+				slot->ctx = NULL;
+			}
+			next.stale = next.valid;
+		}
+		pool_publish(pool, &slot->info, &next);
+		pthread_mutex_unlock(&pool->ds4_lock);
+		ds4_destroy_context(dead);
+	}
+}
+
+static pool_slot_t *pool_find_slot(device_pool_t *pool, const char *name)
+{
+	for (int i = 0; i < pool->esp32_count; i++)
+	{
+		if (strcmp(pool->esp32[i].info.name, name) == 0)
+		{
+			return &pool->esp32[i];
+		}
+	}
+	return NULL;
+}
+
+static void pool_probe_slot(device_pool_t *pool, pool_slot_t *slot)
+{
+	pool_entry_t next = slot->info;
+
+	// USB-JTAG nativo resolve sem abrir nem resetar a porta. Pelo adaptador, o cache só adianta o
+	// valor, marcado como antigo (a gravação recusa) até a placa confirmar abaixo.
+	bool native = false;
+	if (esp32_cache_lookup(next.name, next.mac, sizeof(next.mac), &native))
+	{
+		next.valid = true;
+		next.stale = !native;
+		pool_publish(pool, &slot->info, &next);
+		if (native)
+		{
+			slot->resolved = true;
+			return;
+		}
+	}
+
+	slot->session = esp32_session_open(next.name);
+	if (slot->session && esp32_session_sync(slot->session) &&
+		esp32_session_read_mac(slot->session, next.mac, sizeof(next.mac)))
+	{
+		slot->resolved = true;
+		slot->failures = 0;
+		next.valid = true;
+		next.stale = false;
+	}
+	else
+	{
+		// Cada sondagem reseta a placa (DTR/RTS): uma porta que abre mas nunca responde como ESP32
+		// (modem, outro projeto) é deixada em paz até sumir do registro de portas. Falha ao abrir
+		// (permissão ainda não aplicada, porta ocupada) só espera, sem descartar a porta.
+		bool opened = slot->session != NULL;
+		esp32_session_close(slot->session);
+		slot->session = NULL;
+		slot->failures++;
+		slot->rejected = opened && slot->failures >= POOL_PROBE_MAX_FAILURES;
+		slot->retry_at_ms = pool_now_ms() + pool_backoff_ms(POOL_RETRY_MS, slot->failures);
+		next.stale = next.valid;
+	}
+
+	pool_publish(pool, &slot->info, &next);
+}
+
+static void pool_refresh_esp32(device_pool_t *pool)
+{
+	// Sem mudança no registro de portas, só as sondagens pendentes são refeitas.
+	uint32_t generation = esp32_ports_generation();
+	if (generation == pool->ports_generation)
+	{
+		for (int i = 0; i < pool->esp32_count; i++)
+		{
+			pool_slot_t *slot = &pool->esp32[i];
+			if (slot->listed && !slot->resolved && !slot->rejected && pool_now_ms() >= slot->retry_at_ms)
+			{
+				pool_probe_slot(pool, slot);
+			}
+		}
+		return;
+	}
+	pool->ports_generation = generation;
+
+	char names[ESP32_MAX_PORTS][ESP32_PORT_NAME_MAX];
+	int count = esp32_list_ports(names, ESP32_MAX_PORTS);
+	if (count < 0)
+		return;
+
+	for (int i = 0; i < pool->esp32_count; i++)
+	{
+		pool->esp32[i].listed = false;
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		pool_slot_t *slot = pool_find_slot(pool, names[i]);
+		if (!slot)
+		{
+			if (pool->esp32_count >= ESP32_MAX_PORTS)
+				continue;
+
+			pthread_mutex_lock(&pool->lock);
+			slot = &pool->esp32[pool->esp32_count++];
+			memset(slot, 0, sizeof(pool_slot_t));
+			memcpy(slot->info.name, names[i], sizeof(slot->info.name));
+			pthread_mutex_unlock(&pool->lock);
+		}
+		slot->listed = true;
+
+		if (!slot->resolved && !slot->rejected && pool_now_ms() >= slot->retry_at_ms)
+		{
+			pool_probe_slot(pool, slot);
+		}
+	}
+
+	for (int i = 0; i < pool->esp32_count; i++)
+	{
+		pool_slot_t *slot = &pool->esp32[i];
+		if (slot->listed)
+			continue;
+
+		// Porta sumiu: o valor em cache continua visível, porém marcado como antigo.
+		esp32_session_close(slot->session);
+		slot->session = NULL;
+		slot->resolved = false;
+		slot->rejected = false;
+		slot->failures = 0;
+		slot->retry_at_ms = 0;
+
+		pool_entry_t next = slot->info;
+		next.stale = next.valid;
+		pool_publish(pool, &slot->info, &next);
+	}
+}
+
+static void *pool_worker(void *arg)
+{
+	device_pool_t *pool = arg;
+	bool usb_shared = ds4_usb_acquire();
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->running)
+	{
+		pool->refresh_requested = false;
+		pthread_mutex_unlock(&pool->lock);
+
+		pool_refresh_ds4(pool);
+		pool_refresh_esp32(pool);
+
+		pthread_mutex_lock(&pool->lock);
+		if (!pool->running || pool->refresh_requested)
+			continue;
+
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += (long)POOL_INTERVAL_MS * 1000000L;
+		deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+		deadline.tv_nsec %= 1000000000L;
+		pthread_cond_timedwait(&pool->wake, &pool->lock, &deadline);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	// Os controles fecham antes de soltar o contexto libusb compartilhado.
+	pthread_mutex_lock(&pool->ds4_lock);
+	for (int i = 0; i < pool->ds4_count; i++)
+	{
+		ds4_destroy_context(pool->ds4[i].ctx);
+		pool->ds4[i].ctx = NULL;
+	}
+	pthread_mutex_unlock(&pool->ds4_lock);
+	if (usb_shared)
+	{
+		ds4_usb_release();
+	}
+	return NULL;
+}
+
+device_pool_t *pool_create(void)
+{
+	device_pool_t *pool = calloc(1, sizeof(device_pool_t));
+	if (!pool)
+	{
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_mutex_init(&pool->ds4_lock, NULL);
+	pthread_cond_init(&pool->wake, NULL);
+	pool->running = true;
+
+	if (pthread_create(&pool->thread, NULL, pool_worker, pool) != 0)
+	{
+		pthread_cond_destroy(&pool->wake);
+		pthread_mutex_destroy(&pool->ds4_lock);
+		pthread_mutex_destroy(&pool->lock);
+		free(pool);
+		return NULL;
+	}
+	return pool;
+}
+
+void pool_destroy(device_pool_t *pool)
+{
+	if (!pool)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->running = false;
+	pthread_cond_signal(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+	pthread_join(pool->thread, NULL);
+
+	for (int i = 0; i < pool->esp32_count; i++)
+	{
+		esp32_session_close(pool->esp32[i].session);
+	}
+	pthread_cond_destroy(&pool->wake);
+	pthread_mutex_destroy(&pool->ds4_lock);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool);
+}
+
+void pool_refresh(device_pool_t *pool)
+{
+	if (!pool)
+	{
+		return;
+	}
+	pthread_mutex_lock(&pool->lock);
+	pool->refresh_requested = true;
+	pthread_cond_signal(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+uint32_t pool_generation(device_pool_t *pool)
+{
+	if (!pool)
+	{
+		return 0;
+	}
+	pthread_mutex_lock(&pool->lock);
+	uint32_t generation = pool->generation;
+	pthread_mutex_unlock(&pool->lock);
+	return generation;
+}
+
+static bool pool_pick_entry(const pool_entry_t *info, pool_entry_t *entry_out, bool found)
+{
+	if (info->valid && (!found || (entry_out->stale && !info->stale)))
+	{
+		*entry_out = *info;
+		return true;
+	}
+	return found;
+}
+
+bool pool_get_ds4(device_pool_t *pool, pool_entry_t *entry_out)
+{
+	if (!pool || !entry_out)
+	{
+		return false;
+	}
+
+	bool found = false;
+	pthread_mutex_lock(&pool->lock);
+	for (int i = 0; i < pool->ds4_count; i++)
+	{
+		found = pool_pick_entry(&pool->ds4[i].info, entry_out, found);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return found;
+}
+
+bool pool_get_esp32(device_pool_t *pool, pool_entry_t *entry_out)
+{
+	if (!pool || !entry_out)
+	{
+		return false;
+	}
+
+	bool found = false;
+	pthread_mutex_lock(&pool->lock);
+	for (int i = 0; i < pool->esp32_count; i++)
+	{
+		found = pool_pick_entry(&pool->esp32[i].info, entry_out, found);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return found;
+}
+
+int pool_list_esp32(device_pool_t *pool, pool_entry_t *entries_out, int max_entries)
+{
+	if (!pool || !entries_out)
+	{
+		return 0;
+	}
+
+	int count = 0;
+	pthread_mutex_lock(&pool->lock);
+	for (int i = 0; i < pool->esp32_count && count < max_entries; i++)
+	{
+		if (pool->esp32[i].info.valid)
+		{
+			entries_out[count++] = pool->esp32[i].info;
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return count;
+}
+
+int pool_list_ds4(device_pool_t *pool, pool_entry_t *entries_out, int max_entries)
+{
+	if (!pool || !entries_out)
+	{
+		return 0;
+	}
+
+	int count = 0;
+	pthread_mutex_lock(&pool->lock);
+	for (int i = 0; i < pool->ds4_count && count < max_entries; i++)
+	{
+		if (pool->ds4[i].info.valid)
+		{
+			entries_out[count++] = pool->ds4[i].info;
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return count;
+}
+
+bool pool_find(device_pool_t *pool, const char *name, pool_entry_t *entry_out)
+{
+	if (!pool || !name || !entry_out)
+	{
+		return false;
+	}
+
+	bool found = false;
+	pthread_mutex_lock(&pool->lock);
+	for (int i = 0; i < pool->ds4_count && !found; i++)
+	{
+		if (pool->ds4[i].info.valid && strcmp(pool->ds4[i].info.name, name) == 0)
+		{
+			*entry_out = pool->ds4[i].info;
+			found = true;
+		}
+	}
+	for (int i = 0; i < pool->esp32_count && !found; i++)
+	{
+		if (pool->esp32[i].info.valid && strcmp(pool->esp32[i].info.name, name) == 0)
+		{
+			*entry_out = pool->esp32[i].info;
+			found = true;
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return found;
+}
+
+bool pool_ds4_set_mac(device_pool_t *pool, const char *path, const uint8_t *mac_in)
+{
+	if (!pool || !mac_in)
+	{
+		return false;
+	}
+
+	pthread_mutex_lock(&pool->ds4_lock);
+	pool_ds4_slot_t *slot = pool_find_ds4(pool, path);
+	bool ok = slot && slot->ctx && ds4_set_mac(slot->ctx, mac_in);
+
+	if (ok)
+	{
+		pool_entry_t next;
+		pool_snapshot(pool, &next, &slot->info);
+		ds4_mac_to_string(mac_in, next.mac);
+		next.valid = true;
+		next.stale = false;
+		pool_publish(pool, &slot->info, &next);
+	}
+	pthread_mutex_unlock(&pool->ds4_lock);
+	return ok;
+}
+
+bool pool_ds4_device_mac(device_pool_t *pool, const char *path, uint8_t *mac_out)
+{
+	if (!pool || !mac_out)
+	{
+		return false;
+	}
+
+	pthread_mutex_lock(&pool->ds4_lock);
+	pool_ds4_slot_t *slot = pool_find_ds4(pool, path);
+	bool ok = slot && slot->ctx && ds4_get_device_mac(slot->ctx, mac_out);
+	pthread_mutex_unlock(&pool->ds4_lock);
+	return ok;
+}
+
+bool pool_ds4_read_mac(device_pool_t *pool, const char *path, uint8_t *mac_out)
+{
+	if (!pool || !mac_out)
+	{
+		return false;
+	}
+
+	pthread_mutex_lock(&pool->ds4_lock);
+	pool_ds4_slot_t *slot = pool_find_ds4(pool, path);
+	bool ok = slot && slot->ctx && ds4_get_mac(slot->ctx, mac_out);
+	pthread_mutex_unlock(&pool->ds4_lock);
+	return ok;
+}
@@ -0,0 +1,37 @@
+#ifndef LIBPOOL_H
+#define LIBPOOL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "libds4.h"
+#include "libesp32.h"
+
+#define POOL_MAC_STR_LEN 18
+
+typedef struct device_pool device_pool_t;
+
+typedef struct
+{
+	char name[ESP32_PORT_NAME_MAX];
+	char mac[POOL_MAC_STR_LEN];
+	bool valid;
+	bool stale;
+} pool_entry_t;
+
+device_pool_t *pool_create(void);
+void pool_destroy(device_pool_t *pool);
+
+void pool_refresh(device_pool_t *pool);
+uint32_t pool_generation(device_pool_t *pool);
+
+bool pool_get_ds4(device_pool_t *pool, pool_entry_t *entry_out);
+bool pool_get_esp32(device_pool_t *pool, pool_entry_t *entry_out);
+int pool_list_ds4(device_pool_t *pool, pool_entry_t *entries_out, int max_entries);
+int pool_list_esp32(device_pool_t *pool, pool_entry_t *entries_out, int max_entries);
+bool pool_find(device_pool_t *pool, const char *name, pool_entry_t *entry_out);
+
+bool pool_ds4_set_mac(device_pool_t *pool, const char *path, const uint8_t *mac_in);
+bool pool_ds4_device_mac(device_pool_t *pool, const char *path, uint8_t *mac_out);
+bool pool_ds4_read_mac(device_pool_t *pool, const char *path, uint8_t *mac_out);
+
+#endif
@@ -0,0 +1,297 @@
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <libserialport.h>
+#include "platform.h"
+#include "libesp32.h"
+
+#ifdef PLATFORM_LINUX
+#include <errno.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+#define PORTS_LOG_SIZE 64
+#define PORTS_DEV_DIR "/dev/"
+#define PORTS_EVENT_BUFFER 4096
+#define PORTS_SYSFS_TTY "/sys/class/tty/"
+#define PORTS_SETTLE_MS 2000
+
+typedef struct
+{
+	char name[ESP32_PORT_NAME_MAX];
+	uint64_t seen_ns;
+} PendingPort;
+
+typedef struct
+{
+	char names[ESP32_MAX_PORTS][ESP32_PORT_NAME_MAX];
+	int count;
+	uint32_t generation;
+	esp32_port_change_t log[PORTS_LOG_SIZE];
+	uint32_t logged;
+	PendingPort pending[ESP32_MAX_PORTS];
+	int pending_count;
+	int watch_fd;
+	bool ready;
+} PortRegistry;
+
+static PortRegistry registry = {.watch_fd = -1};
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool is_candidate_port(const char *name)
+{
+	return (strstr(name, "USB") || strstr(name, "usb") ||
+			strstr(name, "ACM") || strstr(name, "acm") ||
+			strstr(name, "COM") || strstr(name, "slab") ||
+			strstr(name, "wch"));
+}
+
+static int registry_find(const char *name)
+{
+	for (int i = 0; i < registry.count; i++)
+	{
+		if (strcmp(registry.names[i], name) == 0)
+			return i;
+	}
+	return -1;
+}
+
+// Toda mudança avança a geração em um e entra no histórico circular.
+static void registry_log(const char *name, bool added)
+{
+	esp32_port_change_t *change = &registry.log[registry.logged % PORTS_LOG_SIZE];
+	snprintf(change->name, sizeof(change->name), "%s", name);
+	change->generation = ++registry.generation;
+	change->added = added;
+	registry.logged++;
+}
+
+static void registry_add(const char *name)
+{
+	if (!is_candidate_port(name) || strlen(name) >= ESP32_PORT_NAME_MAX ||
+		registry.count >= ESP32_MAX_PORTS || registry_find(name) >= 0)
+		return;
+
+	snprintf(registry.names[registry.count++], ESP32_PORT_NAME_MAX, "%s", name);
+	registry_log(name, true);
+}
+
+static void registry_remove(const char *name)
+{
+	int index = registry_find(name);
+	if (index < 0)
+		return;
+
+	registry_log(name, false);
+	registry.count--;
+	memmove(registry.names[index], registry.names[index + 1],
+			(size_t)(registry.count - index) * ESP32_PORT_NAME_MAX);
+}
+
+// Varredura completa; aplicada como diferença, mantém o histórico coerente.
+static bool registry_enumerate(void)
+{
+	struct sp_port **ports;
+	if (sp_list_ports(&ports) != SP_OK)
+		return false;
+
+	for (int i = registry.count - 1; i >= 0; i--)
+	{
+		bool present = false;
+		for (int j = 0; ports[j] && !present; j++)
+		{
+			const char *name = sp_get_port_name(ports[j]);
+			present = name && strcmp(name, registry.names[i]) == 0;
+		}
+		if (!present)
+			registry_remove(registry.names[i]);
+	}
+	for (int j = 0; ports[j]; j++)
+	{
+		const char *name = sp_get_port_name(ports[j]);
+		if (name)
+			registry_add(name);
+	}
+	sp_free_port_list(ports);
+	return true;
+}
+
+#ifdef PLATFORM_LINUX
+static void registry_watch(void)
+{
+	registry.watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (registry.watch_fd >= 0 &&
+		inotify_add_watch(registry.watch_fd, PORTS_DEV_DIR, IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO) < 0)
+	{
+		close(registry.watch_fd);
+		registry.watch_fd = -1;
+	}
+}
+
+static int pending_find(const char *name)
+{
+	for (int i = 0; i < registry.pending_count; i++)
+	{
+		if (strcmp(registry.pending[i].name, name) == 0)
+			return i;
+	}
+	return -1;
+}
+
+static void pending_remove(int index)
+{
+	registry.pending_count--;
+	memmove(&registry.pending[index], &registry.pending[index + 1],
+			(size_t)(registry.pending_count - index) * sizeof(PendingPort));
+}
+
+static void registry_offer(const char *name)
+{
+	if (!is_candidate_port(name) || strlen(name) >= ESP32_PORT_NAME_MAX || registry_find(name) >= 0 ||
+		pending_find(name) >= 0 || registry.pending_count >= ESP32_MAX_PORTS)
+		return;
+
+	PendingPort *port = &registry.pending[registry.pending_count++];
+	snprintf(port->name, sizeof(port->name), "%s", name);
+	port->seen_ns = platform_monotonic_ns();
+}
+
+// 1: entra no registro; 0: ainda esperando; -1: descartado.
+// O nó precisa ser um tty com dispositivo por trás (o mesmo critério do sp_list_ports). O devtmpfs cria
+// o nó antes de o udev aplicar permissões e ACLs, então EACCES logo após a criação é só espera.
+static int pending_state(const PendingPort *port, uint64_t now_ns)
+{
+	bool expired = now_ns - port->seen_ns >= PORTS_SETTLE_MS * 1000000ull;
+	char sys_path[ESP32_PORT_NAME_MAX + sizeof(PORTS_SYSFS_TTY) + 8];
+	snprintf(sys_path, sizeof(sys_path), PORTS_SYSFS_TTY "%s/device", port->name + strlen(PORTS_DEV_DIR));
+
+	if (access(sys_path, F_OK) != 0)
+		return expired ? -1 : 0;
+	if (access(port->name, R_OK | W_OK) == 0)
+		return 1;
+	if (errno == ENOENT)
+		return -1;
+	return expired ? 1 : 0;
+}
+
+static void registry_settle(void)
+{
+	uint64_t now_ns = platform_monotonic_ns();
+	for (int i = registry.pending_count - 1; i >= 0; i--)
+	{
+		int state = pending_state(&registry.pending[i], now_ns);
+		if (state == 0)
+			continue;
+		if (state > 0)
+			registry_add(registry.pending[i].name);
+		pending_remove(i);
+	}
+}
+
+// Só os nós criados ou removidos em /dev desde a última consulta; overflow da fila volta à varredura.
+static void registry_drain(void)
+{
+	_Alignas(struct inotify_event) char buffer[PORTS_EVENT_BUFFER];
+	char name[ESP32_PORT_NAME_MAX];
+	bool resync = false;
+
+	ssize_t len;
+	while ((len = read(registry.watch_fd, buffer, sizeof(buffer))) > 0)
+	{
+		for (char *cursor = buffer; cursor < buffer + len;)
+		{
+			const struct inotify_event *event = (const struct inotify_event *)cursor;
+			cursor += sizeof(struct inotify_event) + event->len;
+
+			if (event->mask & (IN_Q_OVERFLOW | IN_IGNORED))
+			{
+				resync = true;
+				continue;
+			}
+			if (!event->len || snprintf(name, sizeof(name), PORTS_DEV_DIR "%s", event->name) >= (int)sizeof(name))
+				continue;
+
+			if (event->mask & (IN_CREATE | IN_MOVED_TO))
+			{
+				registry_offer(name);
+				continue;
+			}
+			int pending = pending_find(name);
+			if (pending >= 0)
+				pending_remove(pending);
+			registry_remove(name);
+		}
+	}
+
+	if (resync)
+		registry_enumerate();
+	registry_settle();
+}
+#endif
+
+static void registry_refresh(void)
+{
+	// Só uma enumeração bem-sucedida libera o caminho incremental; até lá, cada consulta tenta de novo.
+	if (!registry.ready)
+	{
+#ifdef PLATFORM_LINUX
+		if (registry.watch_fd < 0)
+			registry_watch();
+#endif
+		registry.ready = registry_enumerate();
+		return;
+	}
+
+#ifdef PLATFORM_LINUX
+	if (registry.watch_fd >= 0)
+	{
+		registry_drain();
+		return;
+	}
+#endif
+	registry_enumerate();
+}
+
+int esp32_list_ports(char (*names)[ESP32_PORT_NAME_MAX], int max_ports)
+{
+	if (!names || max_ports <= 0)
+		return -1;
+
+	pthread_mutex_lock(&registry_lock);
+	registry_refresh();
+	int count = registry.count < max_ports ? registry.count : max_ports;
+	memcpy(names, registry.names, (size_t)count * ESP32_PORT_NAME_MAX);
+	pthread_mutex_unlock(&registry_lock);
+	return count;
+}
+
+uint32_t esp32_ports_generation(void)
+{
+	pthread_mutex_lock(&registry_lock);
+	registry_refresh();
+	uint32_t generation = registry.generation;
+	pthread_mutex_unlock(&registry_lock);
+	return generation;
+}
+
+// Mudanças posteriores a generation, da mais antiga para a mais nova; -1 se o histórico já as descartou.
+int esp32_ports_changed_since(uint32_t generation, esp32_port_change_t *changes_out, int max_changes)
+{
+	if (!changes_out || max_changes <= 0)
+		return -1;
+
+	pthread_mutex_lock(&registry_lock);
+	registry_refresh();
+	uint32_t pending = registry.generation - generation;
+	uint32_t kept = registry.logged < PORTS_LOG_SIZE ? registry.logged : PORTS_LOG_SIZE;
+	int count = -1;
+	if (generation <= registry.generation && pending <= kept)
+	{
+		count = pending < (uint32_t)max_changes ? (int)pending : max_changes;
+		for (int i = 0; i < count; i++)
+			changes_out[i] = registry.log[(registry.logged - pending + (uint32_t)i) % PORTS_LOG_SIZE];
+	}
+	pthread_mutex_unlock(&registry_lock);
+	return count;
+}
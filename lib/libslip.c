@@ -0,0 +1,226 @@
+#include <stdlib.h>
+#include <string.h>
+#include "libslip.h"
+
+#define SWAR_ONES 0x0101010101010101ull
+#define SWAR_HIGHS 0x8080808080808080ull
+#define SWAR_END (SWAR_ONES * SLIP_BYTE_END)
+#define SWAR_ESC (SWAR_ONES * SLIP_BYTE_ESC)
+#define SWAR_SHORT_SPAN 64
+#define BUFFER_MIN_CAP 256
+
+static inline uint64_t swar_has_zero(uint64_t word)
+{
+	return (word - SWAR_ONES) & ~word & SWAR_HIGHS;
+}
+
+// Índice do primeiro END/ESC em p, ou len. Varre 8 bytes por vez; a palavra com
+// candidato é reexaminada byte a byte, o que também descarta falsos positivos.
+static size_t scan_special(const uint8_t *p, size_t len)
+{
+	size_t i = 0;
+	for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t))
+	{
+		uint64_t word;
+		memcpy(&word, p + i, sizeof(word));
+		if (swar_has_zero(word ^ SWAR_END) | swar_has_zero(word ^ SWAR_ESC))
+			break;
+	}
+	for (; i < len; i++)
+	{
+		if (p[i] == SLIP_BYTE_END || p[i] == SLIP_BYTE_ESC)
+			return i;
+	}
+	return len;
+}
+
+bool slip_buffer_reserve(slip_buffer_t *buffer, size_t extra)
+{
+	if (buffer->cap - buffer->len >= extra)
+		return true;
+
+	size_t cap = buffer->cap ? buffer->cap : BUFFER_MIN_CAP;
+	while (cap - buffer->len < extra)
+	{
+		if (cap > SIZE_MAX / 2)
+			return false;
+		cap *= 2;
+	}
+
+	uint8_t *data = realloc(buffer->data, cap);
+	if (!data)
+		return false;
+	buffer->data = data;
+	buffer->cap = cap;
+	return true;
+}
+
+void slip_buffer_free(slip_buffer_t *buffer)
+{
+	free(buffer->data);
+	buffer->data = NULL;
+	buffer->len = 0;
+	buffer->cap = 0;
+}
+
+// dst precisa de 2 * len bytes no pior caso; retorna quantos foram escritos.
+size_t slip_encode_span(const uint8_t *src, size_t len, uint8_t *dst)
+{
+	size_t in = 0;
+	size_t out = 0;
+
+	// Cabeçalhos e comandos curtos: o laço simples sai mais barato que memcpy.
+	if (len < SWAR_SHORT_SPAN)
+	{
+		for (; in < len; in++)
+		{
+			if (src[in] == SLIP_BYTE_END || src[in] == SLIP_BYTE_ESC)
+			{
+				dst[out++] = SLIP_BYTE_ESC;
+				dst[out++] = src[in] == SLIP_BYTE_END ? SLIP_BYTE_ESC_END : SLIP_BYTE_ESC_ESC;
+			}
+			else
+			{
+				dst[out++] = src[in];
+			}
+		}
+		return out;
+	}
+
+	while (in < len)
+	{
+		size_t span = scan_special(src + in, len - in);
+		memcpy(dst + out, src + in, span);
+		in += span;
+		out += span;
+		if (in < len)
+		{
+			dst[out++] = SLIP_BYTE_ESC;
+			dst[out++] = src[in++] == SLIP_BYTE_END ? SLIP_BYTE_ESC_END : SLIP_BYTE_ESC_ESC;
+		}
+	}
+	return out;
+}
+
+static size_t encode_frame(uint8_t op, const uint8_t *data, uint16_t len, uint32_t checksum, uint8_t *out)
+{
+	uint8_t header[SLIP_HEADER_SIZE] = {
+		0x00, op, (uint8_t)(len & 0xFF), (uint8_t)(len >> 8),
+		(uint8_t)(checksum & 0xFF), (uint8_t)(checksum >> 8),
+		(uint8_t)(checksum >> 16), (uint8_t)(checksum >> 24)};
+	size_t index = 0;
+
+	out[index++] = SLIP_BYTE_END;
+	index += slip_encode_span(header, SLIP_HEADER_SIZE, out + index);
+	index += slip_encode_span(data, len, out + index);
+	out[index++] = SLIP_BYTE_END;
+	return index;
+}
+
+// Retorna o tamanho do quadro codificado, ou -1 se o pior caso não couber em out.
+int slip_encode_frame(uint8_t op, const uint8_t *data, uint16_t len, uint32_t checksum, uint8_t *out, size_t out_size)
+{
+	if (!out || (len > 0 && !data) || out_size < SLIP_ENCODED_MAX(len))
+		return -1;
+	return (int)encode_frame(op, data, len, checksum, out);
+}
+
+bool slip_encode_append(slip_buffer_t *out, uint8_t op, const uint8_t *data, uint16_t len, uint32_t checksum)
+{
+	if (!out || (len > 0 && !data) || !slip_buffer_reserve(out, SLIP_ENCODED_MAX(len)))
+		return false;
+	out->len += encode_frame(op, data, len, checksum, out->data + out->len);
+	return true;
+}
+
+void slip_decoder_init(slip_decoder_t *decoder)
+{
+	memset(decoder, 0, sizeof(slip_decoder_t));
+}
+
+void slip_decoder_reset(slip_decoder_t *decoder)
+{
+	decoder->frame.len = 0;
+	decoder->in_frame = false;
+	decoder->escaped = false;
+	decoder->complete = false;
+}
+
+void slip_decoder_free(slip_decoder_t *decoder)
+{
+	slip_buffer_free(&decoder->frame);
+	slip_decoder_reset(decoder);
+}
+
+static bool frame_append(slip_decoder_t *decoder, const uint8_t *src, size_t len)
+{
+	if (!slip_buffer_reserve(&decoder->frame, len))
+		return false;
+	memcpy(decoder->frame.data + decoder->frame.len, src, len);
+	decoder->frame.len += len;
+	return true;
+}
+
+// Consome bytes de in até fechar um quadro. Retorna true com o quadro em
+// decoder->frame; *consumed indica quanto de in foi usado nos dois casos.
+bool slip_decode(slip_decoder_t *decoder, const uint8_t *in, size_t len, size_t *consumed)
+{
+	size_t i = 0;
+
+	if (decoder->complete)
+		slip_decoder_reset(decoder);
+
+	while (i < len)
+	{
+		if (!decoder->in_frame)
+		{
+			const uint8_t *start = memchr(in + i, SLIP_BYTE_END, len - i);
+			if (!start)
+			{
+				i = len;
+				break;
+			}
+			i = (size_t)(start - in) + 1;
+			decoder->in_frame = true;
+			decoder->frame.len = 0;
+			continue;
+		}
+
+		if (decoder->escaped)
+		{
+			uint8_t byte = in[i++];
+			if (byte == SLIP_BYTE_ESC_END)
+				byte = SLIP_BYTE_END;
+			else if (byte == SLIP_BYTE_ESC_ESC)
+				byte = SLIP_BYTE_ESC;
+			decoder->escaped = false;
+			if (!frame_append(decoder, &byte, 1))
+				decoder->in_frame = false;
+			continue;
+		}
+
+		size_t span = scan_special(in + i, len - i);
+		if (span > 0 && !frame_append(decoder, in + i, span))
+		{
+			decoder->in_frame = false;
+			continue;
+		}
+		i += span;
+		if (i == len)
+			break;
+
+		if (in[i++] == SLIP_BYTE_ESC)
+		{
+			decoder->escaped = true;
+			continue;
+		}
+
+		decoder->in_frame = false;
+		decoder->complete = true;
+		*consumed = i;
+		return true;
+	}
+
+	*consumed = i;
+	return false;
+}
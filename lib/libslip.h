@@ -0,0 +1,43 @@
+#ifndef LIBSLIP_H
+#define LIBSLIP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SLIP_BYTE_END 0xC0
+#define SLIP_BYTE_ESC 0xDB
+#define SLIP_BYTE_ESC_END 0xDC
+#define SLIP_BYTE_ESC_ESC 0xDD
+
+#define SLIP_HEADER_SIZE 8
+#define SLIP_ENCODED_MAX(len) (2 * (SLIP_HEADER_SIZE + (size_t)(len)) + 2)
+
+typedef struct
+{
+	uint8_t *data;
+	size_t len;
+	size_t cap;
+} slip_buffer_t;
+
+typedef struct
+{
+	slip_buffer_t frame;
+	bool in_frame;
+	bool escaped;
+	bool complete;
+} slip_decoder_t;
+
+bool slip_buffer_reserve(slip_buffer_t *buffer, size_t extra);
+void slip_buffer_free(slip_buffer_t *buffer);
+
+size_t slip_encode_span(const uint8_t *src, size_t len, uint8_t *dst);
+int slip_encode_frame(uint8_t op, const uint8_t *data, uint16_t len, uint32_t checksum, uint8_t *out, size_t out_size);
+bool slip_encode_append(slip_buffer_t *out, uint8_t op, const uint8_t *data, uint16_t len, uint32_t checksum);
+
+void slip_decoder_init(slip_decoder_t *decoder);
+void slip_decoder_reset(slip_decoder_t *decoder);
+void slip_decoder_free(slip_decoder_t *decoder);
+bool slip_decode(slip_decoder_t *decoder, const uint8_t *in, size_t len, size_t *consumed);
+
+#endif
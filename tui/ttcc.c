@@ -4,10 +4,17 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <locale.h>
+#include <stdatomic.h>
 
 #include "platform.h"
 #include "libds4.h"
 #include "libesp32.h"
+#include "libpool.h"
+#include "libledger.h"
+#include "libmacpool.h"
+#include "libpipeline.h"
+#include "eventring.h"
+#include "metrics.h"
 
 #ifdef PLATFORM_WINDOWS
 #ifndef _WIN32_WINNT
@@ -40,6 +47,7 @@
 #define FONT_PATH "font.ttf"
 #define WIN_COLS 99
 #define WIN_ROWS 30
+#define BENCH_STARTUP_TIMEOUT_NS 10000000000ull
 
 #ifndef KEY_ESC
 #define KEY_ESC 27
@@ -80,19 +88,80 @@ typedef struct
 {
 	char ds4_mac[32];
 	char esp_mac[32];
+	char ds4_path[DS4_PATH_MAX];
+	char esp_port[ESP32_PORT_NAME_MAX];
 	char status[128];
 	int status_pair;
 	bool ds4_ok;
 	bool esp_ok;
+	bool ds4_stale;
+	bool esp_stale;
 	bool is_editing;
+	bool esp_pooled;
+	bool pool_held;
+	uint8_t pool_mac[6];
+	int pool_writes;
 	Button buttons[BTN_COUNT];
 	int selected_idx;
 	int pressed_btn_idx;
 	int last_col_btn;
 	bool running;
 	bool dirty;
+	device_pool_t *pool;
+	uint32_t pool_gen;
+	ledger_t *ledger;
+	macpool_t *macpool;
+	pipeline_t *pipeline;
+	// MAC (48 bits, 0 = nenhum) cujo reuso o operador confirmou; lido pela thread de gravação.
+	_Atomic uint64_t reuse_confirmed;
 } AppState;
 
+// Operações do pipeline sobre os dispositivos já abertos pelo pool.
+static bool pair_read_esp32(pipeline_unit_t *unit, void *user)
+{
+	pool_entry_t entry;
+	if (!pool_find(user, unit->esp32, &entry) || entry.stale)
+	{
+		return false;
+	}
+	snprintf(unit->mac, sizeof(unit->mac), "%s", entry.mac);
+	return true;
+}
+
+static bool pair_identify_ds4(pipeline_unit_t *unit, void *user)
+{
+	unit->device_known = pool_ds4_device_mac(user, unit->ds4, unit->device_mac);
+	return true;
+}
+
+static bool pair_write_ds4(pipeline_unit_t *unit, void *user)
+{
+	return pool_ds4_set_mac(user, unit->ds4, unit->target);
+}
+
+static uint64_t mac_key(const uint8_t *mac)
+{
+	uint64_t key = 0;
+	for (int i = 0; i < DS4_MAC_ADDR_LEN; i++)
+	{
+		key = key << 8 | mac[i];
+	}
+	return key;
+}
+
+// Um MAC já pareado com outro controle só é gravado depois que o operador pareia de novo.
+static bool pair_confirm_reuse(const pipeline_unit_t *unit, void *user)
+{
+	AppState *s = user;
+	return atomic_load(&s->reuse_confirmed) == mac_key(unit->target);
+}
+
+static bool pair_verify_ds4(pipeline_unit_t *unit, void *user)
+{
+	uint8_t readback[DS4_MAC_ADDR_LEN];
+	return pool_ds4_read_mac(user, unit->ds4, readback) && memcmp(readback, unit->target, DS4_MAC_ADDR_LEN) == 0;
+}
+
 void set_status(AppState *s, const char *msg, int pair)
 {
 	snprintf(s->status, sizeof(s->status), "%s", msg);
@@ -110,84 +179,264 @@ void force_render_sync(AppState *s)
 
 void action_scan_ds4(AppState *s)
 {
-	ds4_context_t *ctx = ds4_create_context();
-	if (!ctx)
+	pool_entry_t entry;
+	if (!pool_get_ds4(s->pool, &entry))
 	{
 		set_status(s, ICON_ERROR "Erro: DS4 desconectado.", CP_STATUS_RED);
 		s->ds4_ok = false;
+		pool_refresh(s->pool);
 		return;
 	}
-	uint8_t raw[6];
-	if (ds4_get_mac(ctx, raw))
+	snprintf(s->ds4_mac, sizeof(s->ds4_mac), "%s", entry.mac);
+	snprintf(s->ds4_path, sizeof(s->ds4_path), "%.*s", (int)sizeof(s->ds4_path) - 1, entry.name);
+	s->ds4_ok = true;
+	s->ds4_stale = entry.stale;
+	if (entry.stale)
 	{
-		ds4_mac_to_string(raw, s->ds4_mac);
-		s->ds4_ok = true;
-		set_status(s, ICON_CHECK "Sucesso: DS4 Lido.", CP_STATUS_GREEN);
+		set_status(s, ICON_ERROR "Aviso: DS4 desconectado (valor antigo).", CP_STATUS_YELLOW);
 	}
 	else
 	{
-		s->ds4_ok = false;
-		set_status(s, ICON_ERROR "Erro: Falha na leitura.", CP_STATUS_RED);
+		set_status(s, ICON_CHECK "Sucesso: DS4 Lido.", CP_STATUS_GREEN);
 	}
-	ds4_destroy_context(ctx);
 }
 
-void action_scan_esp(AppState *s)
+// O MAC do pool só volta quando nenhum painel o mostra e nenhuma gravação com ele está no pipeline;
+// com gravação em andamento, quem decide é pair_done.
+void settle_pool_mac(AppState *s)
 {
-	set_status(s, ICON_SYNC "Escaneando...", CP_STATUS_YELLOW);
-	force_render_sync(s);
-	if (esp32_find_any_mac(s->esp_mac, sizeof(s->esp_mac)))
+	if (s->pool_held && !s->esp_pooled && s->pool_writes == 0)
 	{
-		s->esp_ok = true;
-		set_status(s, ICON_CHECK "Sucesso: ESP32 Encontrado.", CP_STATUS_GREEN);
+		macpool_release(s->macpool, s->pool_mac);
+		s->pool_held = false;
 	}
-	else
+}
+
+void release_pool_mac(AppState *s)
+{
+	s->esp_pooled = false;
+	settle_pool_mac(s);
+}
+
+void action_scan_esp(AppState *s)
+{
+	release_pool_mac(s);
+	pool_entry_t entry;
+	if (!pool_get_esp32(s->pool, &entry))
 	{
 		s->esp_ok = false;
 		set_status(s, ICON_ERROR "Erro: Nenhum ESP32.", CP_STATUS_RED);
+		pool_refresh(s->pool);
+		return;
+	}
+	snprintf(s->esp_mac, sizeof(s->esp_mac), "%s", entry.mac);
+	snprintf(s->esp_port, sizeof(s->esp_port), "%s", entry.name);
+	s->esp_ok = true;
+	s->esp_stale = entry.stale;
+	if (entry.stale)
+	{
+		set_status(s, ICON_ERROR "Aviso: ESP32 desconectado (valor antigo).", CP_STATUS_YELLOW);
 	}
+	else
+	{
+		set_status(s, ICON_CHECK "Sucesso: ESP32 Encontrado.", CP_STATUS_GREEN);
+	}
+}
+
+void sync_pool_state(AppState *s)
+{
+	pool_entry_t entry;
+	if (s->ds4_ok && s->ds4_path[0] != '\0' && pool_find(s->pool, s->ds4_path, &entry))
+	{
+		snprintf(s->ds4_mac, sizeof(s->ds4_mac), "%s", entry.mac);
+		s->ds4_stale = entry.stale;
+	}
+	if (s->esp_ok && s->esp_port[0] != '\0')
+	{
+		if (pool_find(s->pool, s->esp_port, &entry))
+		{
+			snprintf(s->esp_mac, sizeof(s->esp_mac), "%s", entry.mac);
+			s->esp_stale = entry.stale;
+		}
+	}
+	s->dirty = true;
+}
+
+// Dispositivo descoberto com o painel vazio aparece sozinho, sem esperar o botão de leitura.
+bool show_discovered(AppState *s)
+{
+	pool_entry_t entry;
+	bool found = false;
+	if (pool_get_ds4(s->pool, &entry) && !entry.stale)
+	{
+		found = true;
+		if (!s->ds4_ok)
+		{
+			action_scan_ds4(s);
+		}
+	}
+	if (pool_get_esp32(s->pool, &entry) && !entry.stale)
+	{
+		found = true;
+		if (!s->esp_ok && !s->is_editing)
+		{
+			action_scan_esp(s);
+		}
+	}
+	return found;
 }
 
 void action_manual_input(AppState *s)
 {
+	release_pool_mac(s);
 	s->is_editing = true;
 	s->esp_ok = false;
+	s->esp_stale = false;
 	memset(s->esp_mac, 0, sizeof(s->esp_mac));
+	memset(s->esp_port, 0, sizeof(s->esp_port));
 	set_status(s, "DIGITE O MAC. ENTER Confirma.", CP_STATUS_YELLOW);
 }
 
-void action_pair(AppState *s)
+// Controles pareados com dongles: o MAC vem do pool da estação no lugar do ESP32.
+void action_pool_mac(AppState *s)
 {
-	if (!s->esp_ok)
+	if (s->is_editing || s->esp_pooled)
 	{
-		set_status(s, ICON_ERROR "Origem inválida.", CP_STATUS_RED);
 		return;
 	}
-	ds4_context_t *ctx = ds4_create_context();
-	if (!ctx)
+	if (s->pool_held)
 	{
-		set_status(s, ICON_USB "Conecte o DS4.", CP_STATUS_RED);
+		set_status(s, ICON_ERROR "Aguarde: gravação do MAC do pool em andamento.", CP_STATUS_YELLOW);
+		return;
+	}
+	if (!macpool_allocate(s->macpool, s->ledger, s->pool_mac))
+	{
+		set_status(s, ICON_ERROR "Pool de MACs vazio (ttds4 --pool-add).", CP_STATUS_RED);
+		return;
+	}
+	s->pool_held = true;
+	ds4_mac_to_string(s->pool_mac, s->esp_mac);
+	s->esp_port[0] = '\0';
+	s->esp_ok = true;
+	s->esp_stale = false;
+	s->esp_pooled = true;
+	set_status(s, ICON_CHECK "MAC reservado do pool.", CP_STATUS_GREEN);
+}
+
+// A TUI não tem stderr visível: o anel de eventos vai para o diretório de cache.
+bool save_event_trace(char *path, size_t size)
+{
+	FILE *out;
+	if (!platform_cache_path("ttcc-trace.log", path, size) || !(out = fopen(path, "w")))
+		return false;
+	ring_dump(out);
+	fclose(out);
+	return true;
+}
+
+void action_save_trace(AppState *s)
+{
+	char path[512];
+	char msg[sizeof(s->status)];
+	if (save_event_trace(path, sizeof(path)))
+	{
+		snprintf(msg, sizeof(msg), ICON_CHECK "Trace salvo em %.*s", (int)(sizeof(msg) - sizeof(ICON_CHECK "Trace salvo em ")),
+				 path);
+		set_status(s, msg, CP_STATUS_GREEN);
+	}
+	else
+	{
+		set_status(s, ICON_ERROR "Falha ao salvar o trace.", CP_STATUS_RED);
+	}
+}
+
+void action_pair(AppState *s)
+{
+	if (!s->esp_ok)
+	{
+		set_status(s, ICON_ERROR "Origem inválida.", CP_STATUS_RED);
 		return;
 	}
 	uint8_t target[6];
 	if (!ds4_string_to_mac(s->esp_mac, target))
 	{
 		set_status(s, ICON_ERROR "Formato MAC inválido.", CP_STATUS_RED);
-		ds4_destroy_context(ctx);
+		return;
+	}
+	pool_entry_t entry;
+	if (!pool_get_ds4(s->pool, &entry) || entry.stale)
+	{
+		set_status(s, ICON_USB "Conecte o DS4.", CP_STATUS_RED);
+		pool_refresh(s->pool);
 		return;
 	}
 
-	if (ds4_set_mac(ctx, target))
+	// A gravação segue no pipeline; o resultado chega em pair_done sem travar a interface.
+	void *tag = s->esp_pooled ? s->pool_mac : NULL;
+	if (pipeline_try_submit(s->pipeline, s->esp_mac, entry.name, tag))
 	{
-		ds4_mac_to_string(target, s->ds4_mac);
+		if (tag)
+		{
+			s->pool_writes++;
+		}
+		set_status(s, ICON_SYNC "Gravando...", CP_STATUS_YELLOW);
+	}
+	else
+	{
+		set_status(s, ICON_ERROR "Aguarde: gravações em andamento.", CP_STATUS_YELLOW);
+	}
+}
+
+void pair_done(AppState *s, const pipeline_unit_t *unit)
+{
+	if (unit->tag == s->pool_mac)
+	{
+		s->pool_writes--;
+		if (unit->ok && s->pool_held)
+		{
+			macpool_commit(s->macpool, s->pool_mac);
+			s->pool_held = false;
+			s->esp_pooled = false;
+		}
+		settle_pool_mac(s);
+	}
+	if (!unit->ok && unit->reused && unit->error && strcmp(unit->error, "reuso") == 0)
+	{
+		char other[18];
+		char msg[128];
+		ds4_mac_to_string(unit->previous_ds4, other);
+		snprintf(msg, sizeof(msg), ICON_ERROR "MAC já usado no controle %s. Pareie de novo para confirmar.", other);
+		set_status(s, msg, CP_STATUS_YELLOW);
+		atomic_store(&s->reuse_confirmed, mac_key(unit->target));
+		return;
+	}
+	atomic_store(&s->reuse_confirmed, 0);
+	if (unit->ok)
+	{
+		ds4_mac_to_string(unit->target, s->ds4_mac);
+		snprintf(s->ds4_path, sizeof(s->ds4_path), "%s", unit->ds4);
 		s->ds4_ok = true;
-		set_status(s, ICON_CHECK "SUCESSO! Pareado.", CP_STATUS_GREEN);
+		s->ds4_stale = false;
+		if (unit->reused)
+		{
+			char other[18];
+			char msg[128];
+			ds4_mac_to_string(unit->previous_ds4, other);
+			snprintf(msg, sizeof(msg), ICON_CHECK "Pareado. Aviso: MAC já usado no controle %s.", other);
+			set_status(s, msg, CP_STATUS_YELLOW);
+		}
+		else
+		{
+			set_status(s, ICON_CHECK "SUCESSO! Pareado.", CP_STATUS_GREEN);
+		}
 	}
 	else
 	{
-		set_status(s, ICON_ERROR "Erro na gravação.", CP_STATUS_RED);
+		char path[512];
+		set_status(s, save_event_trace(path, sizeof(path)) ? ICON_ERROR "Erro na gravação (trace salvo no cache)."
+														   : ICON_ERROR "Erro na gravação.",
+				   CP_STATUS_RED);
 	}
-	ds4_destroy_context(ctx);
 }
 
 void trigger_action(AppState *s, int btn_idx)
@@ -296,12 +545,12 @@ void draw_button(Button *b, bool selected, bool pressed)
 	wattroff(stdscr, COLOR_PAIR(pair) | A_BOLD);
 }
 
-void draw_panel(int x, int y, int w, int h, const char *title, const char *mac, bool active, bool editing)
+void draw_panel(int x, int y, int w, int h, const char *title, const char *mac, bool active, bool stale, bool editing)
 {
-	int pair = editing ? CP_EDIT : (active ? CP_STATUS_GREEN : CP_DEFAULT);
+	int pair = editing ? CP_EDIT : (stale ? CP_STATUS_YELLOW : (active ? CP_STATUS_GREEN : CP_DEFAULT));
 	wattron(stdscr, COLOR_PAIR(pair));
 	draw_outline(x, y, w, h);
-	mvwprintw(stdscr, y, x + 2, " %s ", title);
+	mvwprintw(stdscr, y, x + 2, " %s%s ", title, stale ? " (antigo)" : "");
 	wattroff(stdscr, COLOR_PAIR(pair));
 	int mac_pair = editing ? CP_EDIT : CP_FIELD;
 	wattron(stdscr, COLOR_PAIR(mac_pair) | A_BOLD);
@@ -324,8 +573,8 @@ void render(AppState *s)
 	mvwprintw(stdscr, 2, cx - 20, "%s Tamandutech Core Collections (TTCC) %s", ICON_GAMEPAD, ICON_CHIP);
 	wattroff(stdscr, COLOR_PAIR(CP_ACCENT) | A_BOLD);
 
-	draw_panel(cx - 28, 5, 26, 5, "DualShock 4", s->ds4_mac, s->ds4_ok, false);
-	draw_panel(cx + 2, 5, 26, 5, "ESP32 Device", s->esp_mac, s->esp_ok, s->is_editing);
+	draw_panel(cx - 28, 5, 26, 5, "DualShock 4", s->ds4_mac, s->ds4_ok, s->ds4_stale, false);
+	draw_panel(cx + 2, 5, 26, 5, "ESP32 Device", s->esp_mac, s->esp_ok, s->esp_stale, s->is_editing);
 	mvwprintw(stdscr, 7, cx - 1, "\uf060");
 
 	for (int i = 0; i < BTN_COUNT; i++)
@@ -363,9 +612,10 @@ void handle_text(AppState *s, int ch)
 {
 	if (ch == '\n' || ch == KEY_ENTER)
 	{
-		uint8_t dummy[6];
-		if (ds4_string_to_mac(s->esp_mac, dummy))
+		uint8_t typed[6];
+		if (ds4_string_to_mac(s->esp_mac, typed))
 		{
+			ds4_mac_to_string(typed, s->esp_mac);
 			s->is_editing = false;
 			s->esp_ok = true;
 			set_status(s, "MAC Manual definido.", CP_STATUS_GREEN);
@@ -441,6 +691,14 @@ void handle_nav(AppState *s, int ch)
 		else if (s->selected_idx == BTN_MANUAL)
 			s->selected_idx = BTN_PAIR;
 		break;
+	case 'd':
+	case 'D':
+		action_save_trace(s);
+		break;
+	case 'p':
+	case 'P':
+		action_pool_mac(s);
+		break;
 	case '\n':
 	case KEY_ENTER:
 	case ' ':
@@ -690,8 +948,49 @@ void window_apply_theme()
 }
 #endif
 
-int main(void)
+// USB e serial só sobem depois do primeiro quadro; a enumeração segue na thread do pool.
+void start_devices(AppState *s)
+{
+	s->pool = pool_create();
+	s->ledger = ledger_open(NULL);
+	s->macpool = macpool_open(NULL);
+
+	pipeline_ops_t ops = {pair_read_esp32, pair_identify_ds4, pair_write_ds4, pair_verify_ds4, NULL, s->pool};
+	pipeline_config_t config;
+	pipeline_config_default(&config);
+	config.ops = &ops;
+	config.ledger = s->ledger;
+	config.confirm_reuse = pair_confirm_reuse;
+	config.user = s;
+	s->pipeline = pipeline_create(&config);
+}
+
+int main(int argc, char **argv)
 {
+	uint64_t start_ns = platform_monotonic_ns();
+	bool bench_startup = false;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc)
+		{
+			if (!metrics_start(argv[++i], "ttcc"))
+			{
+				fprintf(stderr, "[ERRO]: Não foi possível criar %s.\n", argv[i]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--bench-startup") == 0)
+		{
+			bench_startup = true;
+		}
+		else
+		{
+			fprintf(stdout, "[HELP]: %s [--metrics <arquivo>] [--bench-startup]\n", argv[0]);
+			fprintf(stdout, "        --bench-startup: Mede o tempo até o primeiro quadro e até o primeiro dispositivo, e sai\n");
+			return strcmp(argv[i], "-h") != 0;
+		}
+	}
+
 	load_custom_font();
 	configure_terminal();
 
@@ -702,9 +1001,35 @@ int main(void)
 
 	AppState state;
 	init_state(&state);
+	render(&state);
+	uint64_t first_frame_ns = platform_monotonic_ns() - start_ns;
+	uint64_t first_device_ns = 0;
+	start_devices(&state);
 
 	while (state.running)
 	{
+		pipeline_unit_t unit;
+		while (pipeline_poll(state.pipeline, &unit))
+		{
+			pair_done(&state, &unit);
+		}
+
+		uint32_t pool_gen = pool_generation(state.pool);
+		if (pool_gen != state.pool_gen)
+		{
+			state.pool_gen = pool_gen;
+			sync_pool_state(&state);
+			if (show_discovered(&state) && first_device_ns == 0)
+			{
+				first_device_ns = platform_monotonic_ns() - start_ns;
+			}
+		}
+
+		if (bench_startup && (first_device_ns != 0 || platform_monotonic_ns() - start_ns > BENCH_STARTUP_TIMEOUT_NS))
+		{
+			state.running = false;
+		}
+
 		int ch;
 		while ((ch = getch()) != ERR)
 		{
@@ -733,7 +1058,33 @@ int main(void)
 	printf("\033[?1003l\n");
 #endif
 	endwin();
+	pipeline_destroy(state.pipeline);
+	// O resultado de gravações em andamento se perdeu com o pipeline: na dúvida, o MAC fica como gravado.
+	if (state.pool_held && state.pool_writes > 0)
+	{
+		macpool_commit(state.macpool, state.pool_mac);
+		state.pool_held = false;
+	}
+	release_pool_mac(&state);
+	macpool_close(state.macpool);
+	pool_destroy(state.pool);
+	ledger_close(state.ledger);
+	metrics_stop();
 	unload_custom_font();
 
+	if (bench_startup)
+	{
+		fprintf(stdout, "[INFO]: Primeiro quadro em %.1f ms.\n", (double)first_frame_ns / 1e6);
+		if (first_device_ns != 0)
+		{
+			fprintf(stdout, "[INFO]: Primeiro dispositivo em %.1f ms.\n", (double)first_device_ns / 1e6);
+		}
+		else
+		{
+			fprintf(stdout, "[INFO]: Nenhum dispositivo em %llu ms.\n",
+					(unsigned long long)(BENCH_STARTUP_TIMEOUT_NS / 1000000ull));
+		}
+	}
+
 	return 0;
 }